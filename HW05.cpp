@@ -13,6 +13,45 @@
 // **********************************************************************************
 #include <iostream>
 #include <cmath>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <cstdlib>
+#include <cerrno>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#  define HW05_X86 // SSE2/AVX2/AVX-512 span fills of the CPU rasterizer
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  endif
+#endif
+#ifdef __linux__
+#  define GL_GLEXT_PROTOTYPES // Framebuffer object functions used by the headless renderer
+#  include <EGL/egl.h>
+#  include <EGL/eglext.h>
+#endif
+#include <sys/stat.h>
+#ifdef _WIN32
+#  include <direct.h>
+#else
+#  include <csignal>
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
 #ifdef __APPLE__
 #  include <GLUT/glut.h>
 #else
@@ -25,6 +64,20 @@ using namespace std;
 
 #define PI 3.14159265358979323846
 
+// Functions using instructions beyond SSE2 are compiled for them individually and only called
+// after the CPU has been checked, so the program still runs on any x86-64 processor.
+#if defined(HW05_X86) && (defined(__GNUC__) || defined(__clang__))
+#  define HW05_TARGET(isa) __attribute__((target(isa)))
+#else
+#  define HW05_TARGET(isa)
+#endif
+#ifndef HW05_PROFILE
+#  define HW05_PROFILE 1 // Profiling instrumentation for the HUD and "--trace", compile with -DHW05_PROFILE=0 to leave it out
+#endif
+#ifndef HW05_COUNT_ALLOCATIONS
+#  define HW05_COUNT_ALLOCATIONS 0 // Count the calls of operator new for "--check-allocations" and the HUD, compile with -DHW05_COUNT_ALLOCATIONS=1 (CMake Debug builds do) to put it in
+#endif
+
 
 // **********************************************************************************
 // *********** 3. Function prototypes **************
@@ -40,13 +93,26 @@ void mouse(int button, int state, int x, int y);      // call back function for
 
 // Draws the specified text at the given position
 void drawText(const char* text, float x, float y); 
+// Width, in pixels, of a string drawn by drawText()
+int textWidth(const char* text);
+// Lays a string out as quads of the atlas, relative to its pen position, for placeText()
+struct TextVertex;
+void layoutText(const char* text, vector<TextVertex>& quads);
+// Adds quads laid out by layoutText() to the frame's text batch at a point of the view
+void placeText(const TextVertex* quads, size_t count, float x, float y);
+// Packs the embedded glyphs into the text atlas, once, and uploads it to the current OpenGL context
+void buildTextAtlas();
+// Draws the text batched by drawText() since the last call, with one glDrawArrays
+void flushText();
+// Times drawing 1 to 10,000 labels per frame through the text atlas
+int runTextBenchmark();
 // Creates the right-click context menu
 void createMenu(); 
 // Handles the menu item selection
 void menu(int item); 
 
 // Function to draw an ellipse
-void drawEllipse(float xCenter, float yCenter, float xRadius, float yRadius, float red, float green, float blue);
+void drawEllipse(float xCenter, float yCenter, float xRadius, float yRadius, float red, float green, float blue, bool outline = true);
 // Function to draw an arc
 void drawArc(float xCenter, float yCenter, float xRadius, float yRadius, float startAngle, float endAngle, float red, float green, float blue);
 // Function to draw a filled arc
@@ -54,7 +120,31 @@ void drawFilledArc(float xCenter, float yCenter, float radiusX, float radiusY, f
 // Function to draw a line
 void drawLine(float x1, float y1, float x2, float y2, float red, float green, float blue);
 // Function to draw a rectangle
-void drawRectangle(float x1, float y1, float x2, float y2, float r, float g, float b);
+void drawRectangle(float x1, float y1, float x2, float y2, float r, float g, float b, bool outline = true);
+// Draws the whole scene into the frame command buffer
+void drawScene();
+// Draws one character, from the scene file if one is loaded
+void drawCharacter();
+// Places the characters of the crowd in and around the view
+void buildCrowd(int count);
+// Draws every character of the crowd that is on screen
+void drawCrowd();
+// Draws a frame around the character under the current transform, to show it is selected
+void drawSelectionBox();
+// Times the crowd with both backends for 1 to 100,000 characters
+int runCrowdBenchmark();
+// Crowd characters stored as one array per attribute and animation channel
+struct CrowdActors;
+// Sets the animation channels of every character of the crowd to their values at a point of the animation
+void updateCrowdAnimation(CrowdActors& actors, double time);
+// Sine of a non-negative angle in radians, within FAST_SINE_ERROR of sin()
+float fastSine(float x);
+// Times updateCrowdAnimation() for 1 to 1,000,000 characters and checks fastSine()
+int runAnimationBenchmark();
+// Renders the animation twice with each backend and fails if a frame of the second pass allocates
+int runAllocationCheck();
+// Sizes the frame arena, the meshes and the frame buffers for the largest frame of the character
+void reserveFramePools();
 // Function to draw a Doraemon character
 void drawDoraemon(); // Draws the Doraemon character
 // Draws the bamboo copter on Doraemon's head
@@ -64,22 +154,807 @@ void drawBalloons();
 
 // Updates the animation parameters
 void update(int value);
+// Arms the update timer if the animation is running and the timer is not armed yet
+void scheduleUpdate();
+// Starts or stops the animation
+void setAnimationRunning(bool running);
+// Prints the repaints, timer ticks and menu allocations of the last minute, if there were any
+void reportLoopStatistics(int value);
+// Advances the simulation clock to the current time and interpolates the state to draw
+void advanceAnimation();
+// Animation state of a frame
+struct AnimationState;
+// Returns the state a fraction of the way from one animation state to the next one
+AnimationState interpolateAnimation(const AnimationState& previous, const AnimationState& next, float fraction);
+// Returns the animation state that follows the given one
+AnimationState stepAnimation(const AnimationState& state);
+// Returns the animation state of a frame, frame 0 being the start of the animation
+AnimationState stateAt(int frame);
+
+// Reads the command-line options, returns false if they are invalid
+bool parseArguments(int argc, char** argv);
+// Renders frames into an offscreen framebuffer without creating a window
+int runHeadless();
+// Splits the headless frames into ranges rendered by separate processes
+int runHeadlessJobs();
+// Times both rendering backends on the Doraemon scene at 1080p and 4K
+int runBenchmark();
+// Creates an OpenGL context without a window and an offscreen framebuffer of the given size
+bool openOffscreenContext(int width, int height);
+// Releases the offscreen framebuffer and context
+void closeOffscreenContext();
+// Renders (and optionally saves) frames with the selected backend, returns the elapsed seconds or -1 on failure
+double renderFrames(int firstFrame, int frames, const char* output);
+// Copies the finished frame into RGB bytes, bottom row first
+void readFramePixels(unsigned char* pixels);
+// Writes an RGB image, stored bottom row first as returned by glReadPixels, to a binary PPM file
+bool writePPM(const char* path, int width, int height, const unsigned char* pixels);
+// Streams the headless frames to a Y4M file or to an encoder's standard input, returns false if it cannot be opened
+bool openVideoExport(const char* target, int width, int height, double frameRate);
+// Hands the finished frame to the video writer thread, returns false if writing has failed
+bool queueVideoFrame();
+// Drains the pending readbacks, stops the writer thread and reports the export rate, returns false if writing failed
+bool closeVideoExport();
+// Converts RGBA pixels, stored bottom row first, into the Y, U and V planes of a 4:2:0 frame, top row first
+void convertToYUV420(const unsigned char* rgba, int width, int height, unsigned char* planes);
+// Copies the part of a WAV file that plays during the exported frames, returns false on failure
+bool writeAudioTrack(const char* input, const char* output, double start, double duration);
+
+// Poster export: one frame rendered in tiles of a much larger image and streamed into a PNG file
+struct PngWriter;
+// CRC-32 of the bytes, continuing the CRC of the bytes before them
+uint32_t pngCrc32(uint32_t crc, const unsigned char* data, size_t size);
+// Writes a PNG chunk with its length and CRC, returns false on failure
+bool writePngChunk(PngWriter& png, const char* type, const unsigned char* data, size_t size);
+// Appends bits to the deflate stream of a PNG file
+void putPngBits(PngWriter& png, uint32_t value, int count);
+// Appends the fixed Huffman code of a literal, length or end-of-block symbol to the deflate stream
+void putPngSymbol(PngWriter& png, int symbol);
+// Creates a PNG file for an RGB image and starts its compressed data, returns false on failure
+bool openPng(PngWriter& png, const char* path, int width, int height);
+// Filters and compresses the next row of a PNG file, returns false on failure
+bool writePngRow(PngWriter& png, const unsigned char* rgb);
+// Finishes the compressed data and closes a PNG file, returns false on failure
+bool closePng(PngWriter& png);
+// Makes the framebuffer hold the given part of the window, or all of it
+void setRenderRegion(int x, int y, int width, int height);
+// Renders a frame tile by tile into PNG rows or an image, returns false on failure
+bool renderPosterBands(int frame, int tileWidth, int tileHeight, PngWriter* png, unsigned char* image);
+// Renders one frame as a PNG poster of any size
+int runPoster();
+// Compares frames rendered in tiles with the same frames rendered whole, returns 0 if they are identical
+int runPosterCheck();
+// Input recording and replay: the window's events are written to a file with the simulation step they happened at
+// and played back headless, one frame per step
+struct InputEvent;
+// Creates a recording and writes its header, returns false on failure
+bool openInputRecording(const char* path);
+// Appends an event of the window to the recording, if one is open
+void recordInputEvent(int type, int code, int state, int x, int y);
+// Ends and closes the recording when the program exits
+void closeInputRecording();
+// Writes the header of a recording with the options that change the frames, returns false on failure
+bool writeRecordingHeader(FILE* file);
+// Writes one event to a recording, returns false on failure
+bool writeInputEvent(FILE* file, const InputEvent& event);
+// Reads a recording and applies the options of its header, returns false if it is not a valid recording
+bool readRecording(FILE* file, const char* name, vector<InputEvent>& events);
+// Passes a recorded event to the window's callback
+void applyInputEvent(const InputEvent& event);
+// Draws one frame per step of a recording and hashes each, returns the elapsed seconds
+double replayRecording(const vector<InputEvent>& events, vector<uint32_t>& hashes);
+// Replays the recording given by "--replay" headless as fast as it can
+int runReplay();
+// Checks that replaying a recording twice draws identical frames, returns 0 if it does
+int runReplayCheck();
+// Asks GLUT to redraw the window, unless there is no window
+void requestRedisplay();
+
+// Compares the adaptive tessellation with the fixed one, returns 0 if it stays within lodPixelError
+int runLodCheck();
+// Times the table-driven ellipse and arc tessellation against per-vertex cos/sin
+int runTessellationBenchmark();
+
+// Retained geometry cache: shapes are tessellated once into packed arrays and replayed every frame
+struct Mesh;
+// Starts a primitive, either recording it into the mesh being built or submitting it to the frame
+void beginShape(GLenum mode, float red, float green, float blue);
+// Adds a vertex to the current primitive
+void shapeVertex(double x, double y);
+// Finishes the current primitive and converts it to a triangle or line list
+void endShape();
+// Tessellates the mesh on first use (by calling tessellate) and then submits it from the cache, optionally with another fill color
+void drawCachedMesh(Mesh& mesh, void (*tessellate)(), const GLfloat* fillColor = nullptr);
+// Appends a tessellated mesh to the frame command buffer under the current transform, optionally with another fill color
+void submitMesh(const Mesh& mesh, const GLfloat* fillColor = nullptr);
+// Forces every cached mesh to be tessellated again
+void invalidateMeshCache();
+// Level of detail of the current transform: its largest stretch in pixels per unit, on a logarithmic ladder
+int currentLodLevel();
+// Number of segments an elliptic arc needs to stay within lodPixelError of the true curve
+int arcSegments(float xRadius, float yRadius, double sweep, int referenceSegments);
+// Adds the vertices of an ellipse with a segment count of the ladder to the current primitive
+void emitEllipse(int segments, float xCenter, float yCenter, float xRadius, float yRadius);
+// Adds the vertices of an arc through whole degrees, step degrees apart, to the current primitive
+void emitArc(float xCenter, float yCenter, float xRadius, float yRadius, int startAngle, int endAngle, int step);
+// Adds the quad of a ShapeKind drawn analytically, instead of tessellated, to the mesh being recorded or to the frame
+void addAnalyticShape(int kind, float xCenter, float yCenter, float xRadius, float yRadius, int startAngle, int endAngle, float red, float green, float blue);
+// Submits the primitives built in dynamicMesh to the frame, unless a mesh is being recorded
+void submitDynamicMesh();
+// Widens the quad of an analytic shape to cover its outline and edge on screen and appends it to frameQuads
+struct ShapeVertex;
+void submitShapeQuad(const ShapeVertex* quad, const GLfloat* fillColor);
+// Compiles the shader program that draws the analytic shapes, returns false if the context cannot
+bool buildShapeProgram();
+// Compares the analytic shapes with the tessellated ones on both backends, returns 0 if they match
+int runShapeCheck();
+
+// Frame command buffer: all shapes of a frame are batched and drawn with one glDrawArrays per topology
+// Saves the current transform
+void pushTransform();
+// Restores the last saved transform
+void popTransform();
+// Multiplies the current transform by a translation
+void translateTransform(float x, float y);
+// Multiplies the current transform by a scale
+void scaleTransform(float x, float y);
+// Multiplies the current transform by a rotation (in degrees, counterclockwise)
+void rotateTransform(float degrees);
+// Draws the batched triangles, lines and analytic shapes of the frame and empties the buffer
+void flushFrame();
+
+// Picking: the filled shapes of the frame, mapped to world coordinates, in a uniform grid over the view
+// Adds a filled ellipse, rectangle or elliptic sector to the pickable shapes of the mesh being recorded
+void addPickShape(int kind, float xCenter, float yCenter, float xRadius, float yRadius, int startAngle = 0, int endAngle = 360);
+// Adds the pickable shapes of a mesh submitted to the displayed frame, under the transform it was drawn with, to pickShapes
+struct PickSubmission;
+void recordPickShapes(const PickSubmission& submission);
+// Collects the filled shapes of the displayed frame and sorts them into the cells of the pick grid
+void buildPickIndex();
+// Whether a point in world coordinates lies inside a shape of pickShapes
+struct PickShape;
+bool pickShapeContains(const PickShape& shape, float x, float y);
+// Returns the topmost shape covering a point in world coordinates, -1 for none
+int pickAt(float x, float y);
+// Finds the character and the part under a click on the displayed frame, returns false for the background
+bool pickClick(float x, float y, int& character, int& part);
+// Times picking for 1 to 100,000 characters and checks it against testing every shape
+int runPickBenchmark();
+
+// Scene files: the character described as text, compiled once into a binary cache that is memory-mapped
+// Loads a scene, from its cache if it is up to date and compiling it otherwise, returns false on failure
+bool loadScene(const char* path);
+// Releases the loaded scene, the built-in character is drawn again
+void closeScene();
+// Parses a text scene into a binary scene blob, returns false and reports the line on failure
+bool compileScene(const char* path, const struct stat& source, vector<uint64_t>& blob);
+// Modification time of a file, in nanoseconds where the system records them
+int64_t fileModificationTime(const struct stat& status);
+// Maps a whole file into memory read-only, returns nullptr on failure
+const unsigned char* mapSceneFile(const char* path, size_t& size);
+// Checks that the numbers of a scene shape or transform can be drawn, returns what is wrong or an empty string
+string sceneShapeProblem(const struct SceneShape& shape);
+string sceneTransformProblem(const struct SceneTransform& transform);
+// Checks a binary scene and makes it the one drawn, returns false if it is not a valid scene
+bool openSceneBlob(const unsigned char* data, size_t size);
+// Draws the character of the loaded scene under the current transform
+void drawSceneCharacter();
+// Draws the fixed shapes of tessellatingNode with the usual draw functions
+void tessellateSceneNode();
+// Times compiling, loading and drawing a generated scene of 12,000 shapes
+int runSceneBenchmark();
+
+// CPU rasterizer backend: the frame command buffer is drawn into an RGBA buffer without OpenGL
+// Picks the widest span fill the processor supports
+void detectSimdLevel();
+// Fills count pixels with one color
+void fillSpan(uint32_t* pixels, int count, uint32_t color);
+// Resizes the CPU framebuffer to the window and requests it to be cleared with the background color
+void clearCPUFramebuffer();
+// Fills the part of a convex polygon, given in pixel coordinates, that lies inside a clipping rectangle, returns the pixels filled
+int rasterizeConvexPolygon(const float* x, const float* y, int n, uint32_t color, int clipX0, int clipY0, int clipX1, int clipY1);
+// Shades the band around the edge of an analytic shape and fills its inside, returns the pixels written
+struct RasterShape;
+int rasterizeShape(const RasterShape& shape, uint32_t color, int clipX0, int clipY0, int clipX1, int clipY1);
+// Rasterizes the frame command buffer into the CPU framebuffer
+void rasterizeFrame();
+// Whether a polygon of the frame draws the same pixels as one of the previous frame
+struct RasterPolygon;
+bool samePolygon(const RasterPolygon& polygon, const RasterPolygon& previous);
+// Rasterizes the dirty rectangles of every tile as set up by passBase, passFirstPolygon and passEndPolygon
+void rasterizePass();
+// Finds the rectangles around the polygons that changed since the previous frame
+void findDirtyRects(int firstPolygon);
+// Converts the frame command buffer to pixel-space polygons and sorts them into the screen tiles they touch
+void binFramePolygons();
+// Clears one screen tile and fills the polygons binned into it
+void rasterizeTile(int tile);
+// Rasterizes tiles taken from a worker's own queue, then stolen from the others, until none are left
+void runTileQueue(int worker);
+// Main function of a rasterizer worker thread
+void rasterWorker(int worker);
+// Stops and joins the rasterizer worker threads
+void stopRasterWorkers();
+// Times the CPU backend at 4K with 1, 2, 4, 8 and 16 rasterizer threads
+void runScalingBenchmark();
+// Times the drawing primitives, the animation update, the scene build and whole frames, and saves the results as JSON
+int runBenchmarkSuite();
+
+#if HW05_PROFILE
+// Profiling instrumentation: CPU time per zone, work counters and GPU time of every frame
+// Keeps the finished frame's time and counters for the HUD and the trace, and starts counting the next one
+void finishProfileFrame(double start, double duration);
+// Returns the frame time, in microseconds, below which the fraction p of the recent frames stay
+double frameTimePercentile(double p);
+// Starts timing the frame's OpenGL commands on the GPU, if timer queries are available
+void beginGpuTimer();
+// Stops timing the frame's OpenGL commands on the GPU
+void endGpuTimer();
+// Draws the frame time percentiles, the time per zone and the counters over the scene
+void drawProfileHud();
+// Writes the recorded zones and counters as a Chrome trace, at exit
+void writeProfileTrace();
+#endif
 
 
 //Some global variables
 int windowPositionX = 500, windowPositionY = 100; // Position of the window
 int windowWidth = 800, windowHeight = 600; // Size of the window
-float angle = 0.0f; // Angle for the bamboo copter
 float angularSpeed = 0.1f; // Speed of rotation for the bamboo copter
-float scaleCharacter = 0.5; // Scale of the character
 float scaleSpeedCharacter = 0.01; // Speed of scaling for the character
-float scaleRightLeg = 1.0; // Scale for the right leg
-float scaleLeftLeg = 1.0; // Scale for the left leg
-float balloonAngle = 0.0f; // Angle for the balloons
-float balloonDirection = 2.0f; // Direction of movement for the balloons
-float balloonColor[] = { 0.8, 0.6, 1.0 }; // Color of the balloons
+float balloonColor[] = { 0.8, 0.6, 1.0, 0.8, 0.6, 1.0 }; // Colors of the left and the right balloon
 bool displayFigureName = true; // Flag to display the figure name
 bool animationRunning = false; // Flag to control the animation
+bool updateTimerArmed = false; // Whether an update() timer is pending; it is parked while the animation is stopped
+const int SIMULATION_STEP = 80; // Milliseconds of animation time between two animation steps (12.5 steps per second)
+const double SIMULATION_RATE = 1000.0 / SIMULATION_STEP; // Animation steps per second
+const double MAX_FRAME_TIME = 250; // Longest time, in milliseconds, simulated for one frame, so a stalled window does not fast-forward
+// "--fps N" sets both rates below; a run either has a window or renders headless, so only one of them is ever used
+double windowFrameRate = 60; // Frames per second the window is redrawn at while the animation runs, 0 for as fast as possible ("--fps N")
+double headlessFrameRate = SIMULATION_RATE; // Headless frames per second of animation time ("--fps N"), one frame per step by default
+const int LOOP_STATISTICS_INTERVAL = 60000; // Milliseconds between two reports of reportLoopStatistics()
+int repaintCount = 0, timerTickCount = 0, menuAllocationCount = 0; // Event loop counters since the last report
+bool statisticsTimerArmed = false; // Whether a reportLoopStatistics() timer is pending; it is parked while the animation is stopped
+bool headlessMode = false; // Render offscreen without a window ("--headless")
+bool benchmarkMode = false; // Compare the backends instead of rendering the animation ("--benchmark")
+bool benchmarkSuiteMode = false; // Run the benchmark suite instead of rendering the animation ("--bench-suite")
+const char* benchmarkJsonOutput = nullptr; // File the suite's results are written to ("--bench-json out.json")
+const double BENCH_TRIAL_SECONDS = 0.05; // Shortest run of a benchmark case the suite times
+const int BENCH_TRIALS = 7; // Runs of each case, the median is kept
+const int BENCH_FRAME_START = 150, BENCH_FRAME_WINDOW = 50; // Frames each repetition of a whole-frame case renders, the character grown
+int headlessFrames = 100; // Number of frames rendered in headless mode ("--frames N")
+int headlessStart = 0; // Index of the first frame rendered in headless mode ("--start N")
+int headlessJobs = 1; // Number of processes the headless frames are split across ("--jobs N")
+const char* headlessOutput = nullptr; // Directory the headless frames are written to ("--out dir/"), or nullptr to only time them
+const char* videoOutput = nullptr; // Y4M file, or "|command" to pipe to an encoder, the headless frames are streamed to ("--video")
+const char* audioInput = nullptr; // WAV file whose matching part is saved next to the video ("--audio")
+bool videoExportOpen = false; // Whether openVideoExport() succeeded and closeVideoExport() has not run yet
+const char* posterOutput = nullptr; // PNG file one frame is rendered to in tiles, at the size of "--size" ("--poster out.png")
+bool posterCheckMode = false; // Check tiled frames against whole ones instead of rendering the animation ("--check-poster")
+const int POSTER_TILE_WIDTH = 4096, POSTER_TILE_HEIGHT = 256; // Largest tile of a poster, well within the viewport limit of OpenGL drivers
+const int POSTER_MAX_SIZE = 65536; // Largest width and height of a poster
+// Pixels drawn around every tile and then dropped. OpenGL clips a wide line by its center line, so a line just
+// outside a tile would lose the pixels its width puts inside; the margin keeps such lines in the tile's view.
+const int POSTER_TILE_MARGIN = 4;
+int regionX = 0, regionY = 0; // Window pixel at the bottom left of the framebuffer, only moved by the tiles of a poster
+int regionWidth = 0, regionHeight = 0; // Size of the framebuffer's part of the window, 0 for the whole window
+
+// Input recording and replay
+// What an event's code, state, x and y hold: EVENT_RESHAPE - x, y: the new size; EVENT_KEYBOARD - code: the key,
+// x, y: the mouse position; EVENT_MOUSE - code: the button, state: GLUT_DOWN or GLUT_UP, x, y: the mouse position;
+// EVENT_MENU - code: the menu item; EVENT_END - nothing, it marks the step the session ended at
+enum InputEventType { EVENT_RESHAPE, EVENT_KEYBOARD, EVENT_MOUSE, EVENT_MENU, EVENT_END };
+struct InputEvent {
+    uint32_t tick; // Simulation steps taken before the event, simulationSteps when it happened
+    InputEventType type;
+    int code, state;
+    int x, y;
+};
+const char RECORDING_MAGIC[9] = "HW05REC1"; // First 8 bytes of a recording
+const size_t RECORDING_HEADER_SIZE = 20, RECORDING_EVENT_SIZE = 16; // Bytes of the header and of each event in a recording
+const uint32_t RECORDING_MAX_TICK = 1080000; // Last step of a recording, a day of steps: the replay draws a frame per step
+const char* recordOutput = nullptr; // File the window's events are recorded to ("--record file.rec")
+FILE* recordFile = nullptr; // The open recording, or nullptr when nothing is recorded
+const char* replayInput = nullptr; // Recording replayed headless instead of rendering the animation ("--replay file.rec")
+const char* replayHashOutput = nullptr; // File the step and hash of every replayed frame are written to ("--replay-hashes out.txt")
+bool replayCheckMode = false; // Check that replays are deterministic instead of rendering the animation ("--check-replay")
+
+// Everything that changes while the animation runs. A frame's state only depends on its index,
+// see stateAt(), so any frame can be rendered without drawing the ones before it.
+struct AnimationState {
+    float angle; // Angle for the bamboo copter
+    float scaleCharacter; // Scale of the character
+    float scaleRightLeg; // Scale for the right leg
+    float scaleLeftLeg; // Scale for the left leg
+    float balloonAngle; // Angle for the balloons
+    float balloonDirection; // Direction of movement for the balloons
+};
+const AnimationState initialAnimation = { 0.0f, 0.5f, 1.0f, 1.0f, 0.0f, 2.0f }; // State of frame 0
+const float MAX_CHARACTER_SCALE = 1.8f; // The character stops growing at this scale
+const float MIN_LEG_SCALE = 0.8f, MAX_LEG_SCALE = 1.2f; // Range of the leg scales while the character grows
+const float LEG_FREQUENCY = 3.5f; // Leg swings per radian of copter angle; increase this to make the leg movement faster
+AnimationState animation = initialAnimation; // State of the frame being drawn
+const int ANIMATION_CHECKPOINT_INTERVAL = 1024; // Frames between the states remembered by stateAt()
+vector<AnimationState> animationCheckpoints; // States of frames 0, 1024, 2048, ...
+mutex animationCheckpointMutex;
+AnimationState previousAnimation = initialAnimation, simulatedAnimation = initialAnimation; // The last two simulated states
+double simulationLag = 0; // Milliseconds of animation time since simulatedAnimation, always below SIMULATION_STEP
+long long simulationSteps = 0; // Steps simulated so far, simulatedAnimation is the state after them
+chrono::steady_clock::time_point simulationClock; // When the simulation was last advanced
+
+// An interleaved position + color vertex, as handed to glVertexPointer/glColorPointer.
+// z holds the draw-order layer of the primitive, see flushFrame().
+struct BatchVertex {
+    GLfloat x, y, z;
+    GLfloat r, g, b;
+};
+
+// A primitive inside a cached mesh: GL_TRIANGLES or GL_LINES and the range of vertices it uses.
+// A GL_TRIANGLES primitive is always the triangle fan (v0, v1, v2), (v0, v2, v3), ... of a convex polygon,
+// which lets the CPU rasterizer fill it as one polygon. A GL_QUADS primitive is an analytic shape, the 4 vertices
+// of its quad in Mesh::quads or frameQuads.
+struct MeshPrimitive {
+    GLenum mode;
+    GLint first;
+    GLsizei count;
+};
+
+// An ellipse, an elliptic arc or a sector drawn as one quad around it ("--shapes sdf"). Every pixel of the quad
+// finds its distance to the shape's edge from where it falls on the unit circle the shape is a stretched copy of,
+// and from that its coverage by the fill and by the outline, so no curve is ever tessellated.
+enum ShapeKind {
+    SHAPE_FILL,         // A filled ellipse
+    SHAPE_FILL_OUTLINE, // A filled ellipse outlined in black, lineWidth pixels wide
+    SHAPE_ARC,          // An outline from the first to the last edge, in the shape's color
+    SHAPE_SECTOR        // The filled part of the ellipse between the first and the last edge
+};
+enum ShapeSweep { SWEEP_CONVEX, SWEEP_REFLEX, SWEEP_FULL }; // Arcs and sectors of at most 180 degrees, of more, of a full turn
+struct ShapeVertex {
+    GLfloat x, y, z;
+    GLfloat r, g, b; // Fill color, or the color of an arc
+    GLfloat u, v; // The vertex on the plane of the unit circle
+    GLfloat kind, sweep; // ShapeKind and ShapeSweep, as floats for the vertex arrays
+    GLfloat startX, startY, endX, endY; // Unit vectors along the first and the last edge, counterclockwise
+};
+
+// A 2D affine transform: x' = a * x + c * y + tx, y' = b * x + d * y + ty
+// It replaces the model-view matrix so that shapes drawn under different transforms can share a batch.
+struct Transform2D {
+    float a, b, c, d;
+    float tx, ty;
+};
+
+// A filled shape that can be picked with the mouse, stored as the transform that maps it onto the unit circle or,
+// for a rectangle, onto the square [-1, 1] x [-1, 1]. An elliptic sector is the part of the circle between two edges.
+enum PickShapeKind { PICK_ELLIPSE, PICK_RECTANGLE, PICK_SECTOR };
+enum PickPart { PICK_BODY, PICK_LEFT_BALLOON, PICK_RIGHT_BALLOON };
+struct PickShape {
+    PickShapeKind kind;
+    Transform2D toUnit; // From mesh coordinates in a Mesh, from world coordinates in pickShapes
+    float startX, startY, endX, endY; // Sectors: unit vectors along the first and the last edge, counterclockwise
+    bool reflex; // Sectors: whether they sweep more than 180 degrees
+    PickPart part; // Part of the character the shape belongs to
+    int character; // Crowd character the shape belongs to, 0 for the single character
+    float x0, y0, x1, y1; // Bounds in world coordinates
+};
+
+// A mesh with pickable shapes as drawScene() submitted it, kept until the next frame so a click can pick that frame
+struct Mesh;
+struct PickSubmission {
+    const Mesh* mesh; // The cached mesh, or nullptr for shapes of dynamicMesh, copied to framePickShapes
+    int first, count; // Without a mesh: the shapes in framePickShapes
+    Transform2D transform; // currentTransform at the submission
+    PickPart part; // pickPart at the submission
+    int character; // pickCharacter at the submission
+};
+
+// A retained, pre-tessellated piece of the scene.
+// Fills are stored as triangle lists and outlines as line lists so a mesh can be appended
+// to the frame command buffer without any cos/sin work.
+struct Mesh {
+    vector<BatchVertex> vertices;
+    vector<ShapeVertex> quads; // Quads of its analytic shapes
+    vector<MeshPrimitive> primitives;
+    vector<PickShape> pickShapes; // Its filled shapes, for picking
+    bool built = false; // Cleared to force the mesh to be tessellated again
+    int lodLevel = 0; // Level of detail the mesh was tessellated for, see currentLodLevel()
+};
+
+Mesh* recordingMesh = nullptr; // Mesh being tessellated, or nullptr to submit shapes to the frame
+Mesh dynamicMesh; // Holds a shape that is drawn outside of any cached mesh until it is submitted
+GLenum shapeMode; // Mode of the primitive currently being recorded
+float shapeColor[3]; // Color of the primitive currently being recorded
+vector<BatchVertex> shapeVertices; // Vertices of the primitive currently being recorded
+
+Transform2D currentTransform = { 1, 0, 0, 1, 0, 0 }; // Transform applied to submitted shapes
+vector<Transform2D> transformStack; // Transforms saved by pushTransform()
+vector<BatchVertex> frameTriangles; // All filled shapes of the frame
+vector<BatchVertex> frameLines; // All outlines and lines of the frame
+vector<ShapeVertex> frameQuads; // All analytic shapes of the frame
+vector<MeshPrimitive> framePrimitives; // Primitives of the frame in draw order, indexing frameTriangles or frameLines
+int frameLayer = 0; // Draw-order layer of the next submitted primitive
+const int FRAME_LAYER_LIMIT = 1 << 20; // Layers that fit between the near plane and the middle of the depth range
+
+// The viewing volume set up by myReshape() and the parameters shared by both backends
+double clippingPlanLeft = -1.2, clippingPlanRight = 1.2;
+double clippingPlanBottom = -0.6, clippingPlanTop = 2.0;
+GLfloat backgroundColor[4] = { 1.0, 1.0, 0.8, 0.0 }; // Color the display window is cleared with
+GLfloat lineWidth = 3.0; // Width, in pixels, of all outlines and lines
+
+// Analytic shapes
+bool analyticShapes = false; // Draw ellipses, arcs and sectors as quads shaded from their distance to the edge ("--shapes sdf")
+// Pixels a shape's quad reaches past its outline, which is lineWidth / 2 past its edge: the half pixel the
+// antialiased edge fades over, and one more so rounding never cuts a pixel off
+const float SHAPE_QUAD_MARGIN = 1.5f;
+GLuint shapeProgram = 0; // Shader program drawing the analytic shapes in the current OpenGL context, 0 without shaders
+bool shapeCheckMode = false; // Compare analytic shapes with tessellated ones instead of rendering the animation ("--check-shapes")
+
+// Adaptive tessellation of ellipses and arcs
+float lodPixelError = 0.25f; // Largest distance, in pixels, between a tessellated curve and the true one ("--lod-error px"); 0 for the fixed 300-segment / 1-degree tessellation
+const int LOD_LEVELS_PER_OCTAVE = 4; // Steps of the level-of-detail ladder each time the screen scale doubles
+bool lodCheckMode = false; // Check the adaptive tessellation instead of rendering the animation ("--check-lod")
+bool tessellationBenchmarkMode = false; // Time the table-driven tessellation against per-vertex cos/sin ("--bench-tessellation")
+int lodLevelOverride = INT_MIN; // Level of detail used for every mesh instead of currentLodLevel()'s, INT_MIN for none
+
+// Compile-time unit-circle tables
+// sin(x) for |x| <= PI / 2 from its Taylor series, usable in constant expressions (unlike std::sin)
+constexpr double taylorSine(double x) {
+    double term = x, sum = x;
+    for (int n = 1; n < 14; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+// sin(x) for 0 <= x <= 2 * PI, folded into [-PI / 2, PI / 2] first
+constexpr double constantSine(double x) {
+    if (x > PI) {
+        x -= 2 * PI;
+    }
+    if (x > PI / 2) {
+        x = PI - x;
+    }
+    else if (x < -PI / 2) {
+        x = -PI - x;
+    }
+    return taylorSine(x);
+}
+// cos(x) for 0 <= x <= 2 * PI
+constexpr double constantCosine(double x) {
+    return constantSine(x + PI / 2 > 2 * PI ? x + PI / 2 - 2 * PI : x + PI / 2);
+}
+// cos and sin of 2 * PI * i / N for i = 0..N, computed by the compiler
+template <int N>
+struct UnitCircle {
+    double cosine[N + 1], sine[N + 1];
+    constexpr UnitCircle() : cosine{}, sine{} {
+        for (int i = 0; i <= N; i++) {
+            cosine[i] = constantCosine(2 * PI * i / N);
+            sine[i] = constantSine(2 * PI * i / N);
+        }
+    }
+};
+template <int N>
+constexpr UnitCircle<N> unitCircle = UnitCircle<N>();
+// Segment counts an ellipse can have, each with its own table. Counts chosen by arcSegments() are rounded up to the
+// next one; the steps are about a fifth apart, like the level-of-detail ladder, and end at the fixed 300.
+const int ELLIPSE_SEGMENT_LADDER[] = { 8, 10, 12, 14, 16, 20, 24, 28, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 300 };
+
+// Rendering backends
+enum RenderBackend {
+    BACKEND_OPENGL, // Draw the frame command buffer with glDrawArrays
+    BACKEND_CPU     // Rasterize the frame command buffer into cpuFramebuffer
+};
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512 };
+RenderBackend renderBackend = BACKEND_OPENGL; // Selected with "--backend gl|cpu"
+bool openGLContext = false; // Whether an OpenGL context exists (not the case for the headless CPU backend)
+SimdLevel simdLevel = SIMD_SCALAR; // Widest span fill usable on this processor, limited with "--simd"
+vector<uint32_t> cpuFramebuffer; // RGBA pixels of the CPU backend, bottom row first like OpenGL
+int cpuFramebufferWidth = 0, cpuFramebufferHeight = 0;
+int cpuFramebufferX = 0, cpuFramebufferY = 0; // Window pixel at its bottom left, see regionX
+uint32_t cpuClearColor = 0; // Packed background color used to clear the tiles
+
+// Tiled, multithreaded rasterization of the CPU backend
+// Size of a screen tile, in pixels. Tiles are wide and short so every tile row is a long run of contiguous
+// memory; tall tiles make the clear and the span fills stride through the framebuffer a row at a time.
+const int TILE_WIDTH = 512, TILE_HEIGHT = 32;
+// A primitive converted to pixel space: a convex polygon with its color and pixel bounds
+struct RasterPolygon {
+    int first, count; // Vertices in rasterX/rasterY
+    uint32_t color;
+    int x0, y0, x1, y1; // Covered pixels are in [x0, x1) x [y0, y1)
+    int shape; // For the quad of an analytic shape, its RasterShape in rasterShapes, -1 otherwise
+};
+// An analytic shape in pixel space: where window pixels fall on the plane of the unit circle
+struct RasterShape {
+    float x, y; // A pixel position...
+    float u, v; // ...and where it falls
+    float ux, vx, uy, vy; // Change of u and v per pixel to the right and per pixel up
+    float stretch; // Largest change of (u, v) per pixel, in any direction
+    // Signed distance, in pixels, to the line along the first and along the last edge at (x, y), positive on the
+    // side of the sweep, and its change per pixel to the right and up
+    float start[3], end[3];
+    ShapeKind kind;
+    ShapeSweep sweep;
+    float red, green, blue; // Fill color, or the color of an arc, from 0 to 255
+};
+// The tiles a worker still has to rasterize: next tile in the low 32 bits, end of its range in the high
+// 32 bits. The owner takes tiles from the front and other workers steal from the back, both with one
+// compare-and-swap, so the queues need no lock.
+struct TileQueue {
+    atomic<uint64_t> range;
+    char padding[64 - sizeof(atomic<uint64_t>)]; // Keep every queue on its own cache line
+};
+int renderThreads = 1; // Number of threads rasterizing the CPU frame ("--threads N")
+vector<float> rasterX, rasterY; // Pixel-space vertices of the frame's polygons
+vector<RasterPolygon> rasterPolygons; // The frame's polygons in draw order
+vector<RasterShape> rasterShapes; // The frame's analytic shapes, in draw order
+vector<vector<int>> tileBins; // For every tile, the polygons touching it in draw order
+int tileColumns = 0, tileRows = 0;
+unique_ptr<TileQueue[]> tileQueues; // One queue per rasterizing thread
+vector<thread> rasterWorkers; // Threads helping the main thread, renderThreads - 1 of them
+mutex rasterMutex; // Guards the frame hand-off below, never the framebuffer
+condition_variable rasterStart, rasterDone;
+int rasterGeneration = 0; // Incremented to start the workers on a new frame
+int rasterWorkersBusy = 0; // Workers still rasterizing the current frame
+bool rasterShutdown = false;
+
+// Static layer and dirty rectangles of the CPU backend
+// Polygons at the start of the frame that did not change since the previous frame are kept, already rasterized
+// over the background, in a static layer. A frame then only redraws the rectangles around the polygons that
+// changed: it copies them from the layer and draws the later polygons over them.
+struct PixelRect {
+    int x0, y0, x1, y1; // Pixels in [x0, x1) x [y0, y1)
+};
+enum TileBase {
+    TILE_CLEAR,   // Start from the background color
+    TILE_RESTORE, // Start from the static layer
+    TILE_KEEP     // Draw over what the framebuffer holds
+};
+bool layerCacheEnabled = true; // Redraw only what changed; "--full-redraw" redraws every frame completely
+vector<uint32_t> cpuStaticLayer; // The background with the first staticLayerPolygons polygons drawn over it
+int staticLayerPolygons = 0; // Number of polygons in the static layer, 0 when there is none
+uint32_t previousClearColor = 0; // Background color of the previous frame and the static layer
+bool cpuFrameValid = false; // Whether cpuFramebuffer holds the previous frame at the current size
+vector<float> previousRasterX, previousRasterY; // The polygons of the previous frame
+vector<RasterPolygon> previousRasterPolygons;
+vector<RasterShape> previousRasterShapes;
+vector<PixelRect> dirtyRects; // Parts of the framebuffer the current pass redraws
+int passFirstPolygon = 0, passEndPolygon = 0; // Polygons drawn by the current pass
+TileBase passBase = TILE_CLEAR; // What the dirty rectangles of the current pass start from
+atomic<long long> framePixelsWritten(0); // Pixels cleared, restored or filled for the current frame
+long long totalPixelsWritten = 0; // Pixels written by all frames since it was reset
+
+// Static parts of the scene, tessellated once
+Mesh doraemonBodyMesh; // Face, eyes, mustache, smile, hands, stomach, neck band and bell
+Mesh leftLegMesh, rightLegMesh; // Legs, scaled by animation.scaleLeftLeg/scaleRightLeg every frame
+Mesh legLineMesh; // Line between the legs
+Mesh copterBaseMesh; // Surface and attacher of the bamboo copter
+Mesh balloonThreadsMesh; // Threads of both balloons
+Mesh leftBalloonMesh, rightBalloonMesh; // Balloons, rotated by animation.balloonAngle every frame and filled with balloonFill
+const GLfloat* balloonFill = balloonColor; // Fill colors of the left and the right balloon being drawn
+
+// Crowd mode: many characters sharing the cached meshes, each with its own place, size, phase and balloon color.
+// Every attribute and every animation channel is one contiguous array, so updateCrowdAnimation() streams through
+// them with SIMD loads and stores; character i is element i of each array.
+struct CrowdActors {
+    vector<float> x, y; // Position of the character's origin
+    vector<float> scale; // Scale of the fully grown character
+    vector<float> phase; // Animation steps the character is ahead of the others, below CROWD_PHASES
+    vector<GLfloat> balloonColor; // Fill colors of its left and right balloon, 6 values per character
+    // Animation channels, see updateCrowdAnimation()
+    vector<float> angle; // Copter angle, like AnimationState::angle
+    vector<float> growth; // Current scale divided by MAX_CHARACTER_SCALE
+    vector<float> scaleRightLeg, scaleLeftLeg; // Leg scales, like AnimationState
+    vector<float> balloonAngle; // Balloon angle, like AnimationState::balloonAngle
+};
+const int MAX_CROWD = 100000; // Largest crowd "--crowd N" accepts
+const float CROWD_PHASES = 64; // The phases of the crowd are spread over this many animation steps
+const float GROWTH_STEPS = 130; // Steps the character grows for, from initialAnimation.scaleCharacter to MAX_CHARACTER_SCALE
+const float BALLOON_PERIOD = 52; // Steps of one balloon swing there and back: 26 degrees either way, 2 degrees per step
+const float CROWD_CYCLE = 46800; // Steps after which copter and balloons are back where they started: 3600 and 52 both divide it
+const float FAST_SINE_ERROR = 5e-6f; // Largest difference between fastSine() and sin()
+const float CHARACTER_BOUNDS[4] = { -0.85f, -0.16f, 0.85f, 1.03f }; // Left, bottom, right and top of a character at scale 1, balloons included
+int crowdSize = 0; // Number of characters in crowd mode ("--crowd N"), 0 for the single character
+bool crowdBenchmarkMode = false; // Time the crowd for growing sizes instead of rendering the animation ("--bench-crowd")
+CrowdActors crowd; // The characters, back to front
+bool animationBenchmarkMode = false; // Time the crowd animation channels instead of rendering ("--bench-animation")
+double animationTime = 0; // Time of the frame being drawn, in animation steps since frame 0
+int crowdVisible = 0; // Characters drawn in the last frame, the others were culled
+bool crowdLabels = false; // Label every character of the crowd with its number ("--labels")
+
+// Text: the glyphs are packed into one texture and every string of a frame becomes quads of one batch
+struct Glyph {
+    int advance; // Pixels from this character to the next
+    int left, bottom, width, height; // Box around the glyph's pixels, from the pen position moved FONT_Y_ORIGIN down
+    GLfloat u0, v0, u1, v1; // The box in the atlas
+};
+struct TextVertex {
+    GLfloat x, y; // Window coordinates, in pixels
+    GLfloat u, v; // Atlas coordinates
+    GLfloat r, g, b;
+};
+const int FIRST_GLYPH = 32, GLYPH_COUNT = 95; // Printable ASCII, from ' ' to '~'
+const int FONT_HEIGHT = 23; // Rows of every glyph
+const int FONT_Y_ORIGIN = 5; // Rows of every glyph below the baseline
+extern const unsigned char FONT_GLYPHS[]; // Bitmaps of the glyphs, stored with the text renderer
+const int TEXT_ATLAS_SIZE = 256; // Width and height of the atlas texture
+Glyph glyphs[GLYPH_COUNT]; // Filled by buildTextAtlas()
+vector<unsigned char> textAtlas; // Coverage of the atlas texels, 0 or 255
+GLuint textAtlasTexture = 0; // The atlas in the current OpenGL context
+vector<TextVertex> frameText; // Quads of the text drawn since the last flushText()
+vector<TextVertex> textLayout; // Quads of the string drawText() is drawing, reused from one string to the next
+// The label of every crowd character, laid out once: character i's quads start at crowdLabelStart[i] and end where
+// character i + 1's start, and the label is crowdLabelWidth[i] pixels wide. Emptied by buildCrowd()
+vector<TextVertex> crowdLabelQuads;
+vector<int> crowdLabelStart, crowdLabelWidth;
+bool textBenchmarkMode = false; // Time the text renderer instead of rendering the animation ("--bench-text")
+
+// Picking with the left mouse button
+bool pickRecording = false; // Whether submitted meshes are kept in framePickSubmissions, set while drawScene() runs
+vector<PickSubmission> framePickSubmissions; // Meshes with pickable shapes of the displayed frame, in draw order
+vector<PickShape> framePickShapes; // Pickable shapes the displayed frame drew outside of any cached mesh
+PickPart pickPart = PICK_BODY; // Part of the character the meshes being submitted belong to
+int pickCharacter = 0; // Crowd character the meshes being submitted belong to
+vector<PickShape> pickShapes; // Filled shapes of the displayed frame in draw order
+vector<int> pickCellStart; // Shapes of grid cell i are pickCellShapes[pickCellStart[i]] to pickCellShapes[pickCellStart[i + 1] - 1]
+vector<int> pickCellShapes; // Shapes overlapping each cell, in draw order
+int pickColumns = 0, pickRows = 0; // Cells of the grid, which covers the viewing volume
+const int PICK_GRID_LIMIT = 1024; // Most columns and most rows of the grid
+bool pickIndexValid = false; // Whether the index holds the displayed frame, cleared by every redraw
+int selectedCharacter = -1; // Character chosen with a left click, -1 for none
+const GLfloat PICK_BALLOON_COLORS[][3] = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } }; // Colors a clicked balloon cycles through, those of the menu
+bool pickBenchmarkMode = false; // Time picking instead of rendering the animation ("--bench-pick")
+
+// Scene files. The compiled blob is a header followed by the node, transform and shape arrays, each 8-byte aligned,
+// in the byte order of the machine that compiled it; it is a cache, not an exchange format.
+enum SceneChannel { CHANNEL_ANGLE, CHANNEL_SCALE_LEFT_LEG, CHANNEL_SCALE_RIGHT_LEG, CHANNEL_BALLOON_ANGLE, CHANNEL_COUNT }; // Animation values a scene can bind
+const char* const SCENE_CHANNEL_NAMES[CHANNEL_COUNT] = { "angle", "scaleLeftLeg", "scaleRightLeg", "balloonAngle" };
+enum SceneTransformKind { SCENE_TRANSLATE, SCENE_ROTATE, SCENE_SCALE };
+enum SceneShapeKind { SCENE_ELLIPSE, SCENE_ARC, SCENE_FILLED_ARC, SCENE_LINE, SCENE_RECTANGLE, SCENE_SPOKE, SCENE_SHAPE_KINDS };
+const char SCENE_MAGIC[8] = { 'H', 'W', '0', '5', 'S', 'C', 'N', '\0' };
+const uint32_t SCENE_VERSION = 1;
+struct SceneHeader {
+    char magic[8]; // SCENE_MAGIC
+    uint32_t version; // SCENE_VERSION
+    uint32_t nodeCount, transformCount, shapeCount;
+    uint32_t nodeOffset, transformOffset, shapeOffset; // Bytes from the start of the blob to each array
+    uint32_t size; // Bytes of the whole blob
+    uint64_t sourceSize; // Size and modification time of the text it was compiled from, to tell when the cache is stale
+    int64_t sourceTime; // See fileModificationTime()
+};
+struct SceneNode {
+    int32_t parent; // Index of the parent node, always smaller, or -1 for the character itself
+    uint32_t firstTransform, transformCount; // Applied in order after the parent's transform
+    uint32_t firstShape, fixedShapes, spokes; // The fixed shapes, cached as one mesh, then the spokes
+    int32_t fill; // PICK_LEFT_BALLOON or PICK_RIGHT_BALLOON to fill it with that balloon's color, PICK_BODY to keep the colors
+    uint32_t padding;
+};
+struct SceneTransform {
+    uint32_t kind; // SceneTransformKind
+    int32_t channel[2]; // Channel each value is taken from, or -1 for the constant
+    uint32_t padding;
+    double value[2]; // Translation or scale in x and y, or the rotation in degrees
+};
+struct SceneShape {
+    uint32_t kind; // SceneShapeKind
+    uint32_t outline; // Whether an ellipse or a rectangle is outlined in black
+    int32_t channel; // A spoke's channel
+    uint32_t padding;
+    double p[6]; // The arguments of the draw function, up to the color; a spoke has center, radii and angle offset
+    float color[3];
+    float padding2;
+};
+const double SCENE_COORDINATE_LIMIT = 1000; // Largest magnitude of a coordinate, radius, translation or scale in a scene
+const double SCENE_ANGLE_LIMIT = 3600; // Largest magnitude of an angle, spoke offset or rotation in a scene
+const char* sceneInput = nullptr; // Scene file drawn instead of the built-in character ("--scene file")
+const SceneHeader* scene = nullptr; // The loaded scene, nullptr for the built-in character
+const SceneNode* sceneNodes = nullptr; // The arrays of the loaded scene, pointing into the blob
+const SceneTransform* sceneTransforms = nullptr;
+const SceneShape* sceneShapes = nullptr;
+void* sceneMapping = nullptr; // The mapped file the scene lives in, if any
+size_t sceneMappingSize = 0;
+vector<uint64_t> sceneBlob; // The scene when it lives in memory instead: compiled but not cached, or read without mmap
+vector<Mesh> sceneMeshes; // Cached fixed shapes of every node
+vector<Transform2D> sceneNodeTransforms; // Transform of every node in the character being drawn
+const SceneNode* tessellatingNode = nullptr; // Node whose mesh tessellateSceneNode() draws
+bool sceneBenchmarkMode = false; // Time a large scene instead of rendering the animation ("--bench-scene")
+
+bool allocationCheckMode = false; // Check that steady-state frames allocate nothing instead of rendering the animation ("--check-allocations")
+const int ALLOCATION_CHECK_FRAMES = 200; // Frames rendered by each pass of the check, past the 130 steps the character grows for
+#if HW05_COUNT_ALLOCATIONS
+atomic<long long> allocationCount(0); // Calls of the global operator new since the start
+#endif
+// Scratch memory of a frame: allocate() bumps through one block and myDisplay() resets it at the start of every frame
+// A frame that needs more than the block gets the rest from the heap, and reset() then grows the block to fit, so only
+// a frame larger than every earlier one allocates.
+struct FrameArena {
+    vector<max_align_t> block; // The memory handed out, in units aligned for any type
+    vector<unique_ptr<max_align_t[]>> overflow; // Memory of the current frame that did not fit in block
+    size_t used = 0; // Units of block handed out since the last reset
+    size_t demand = 0; // Units asked for since the last reset, including the overflow
+    void reserve(size_t bytes) {
+        block.resize(max(block.size(), (bytes + sizeof(max_align_t) - 1) / sizeof(max_align_t)));
+    }
+    template <class T> T* allocate(size_t count) {
+        size_t units = (count * sizeof(T) + sizeof(max_align_t) - 1) / sizeof(max_align_t);
+        demand += units;
+        if (used + units <= block.size()) {
+            used += units;
+            return (T*)(block.data() + used - units);
+        }
+        overflow.emplace_back(new max_align_t[units]);
+        return (T*)overflow.back().get();
+    }
+    void reset() {
+        if (!overflow.empty()) {
+            overflow.clear();
+            block.resize(demand);
+        }
+        used = demand = 0;
+    }
+};
+const size_t FRAME_ARENA_SIZE = 256 << 10; // Bytes the frame arena starts with
+FrameArena frameArena; // Scratch memory of the frame being drawn, and of the pick index built for it
+vector<unsigned char> framePixels; // RGB readback of the last saved frame, kept for the next one
+
+#if HW05_PROFILE
+// Parts of a frame whose CPU time is measured, and the work counted in every frame
+enum ProfileZone { ZONE_FRAME, ZONE_UPDATE, ZONE_DRAW_DORAEMON, ZONE_DRAW_COPTER, ZONE_DRAW_BALLOONS, ZONE_FLUSH_FRAME, ZONE_PRESENT, ZONE_COUNT };
+const char* const PROFILE_ZONE_NAMES[ZONE_COUNT] = { "myDisplay", "update", "drawDoraemon", "drawBambooCopter", "drawBalloons", "flushFrame", "glFlush" };
+enum ProfileCounter { COUNT_VERTICES, COUNT_PRIMITIVES, COUNT_GL_CALLS, COUNT_TRIG, COUNT_ALLOCATIONS, COUNTER_COUNT };
+const char* const PROFILE_COUNTER_NAMES[COUNTER_COUNT] = { "vertices", "primitives", "GL calls", "cos/sin", "allocations" };
+const int PROFILE_HISTORY = 240; // Frames the HUD's percentiles are taken over
+const size_t PROFILE_TRACE_LIMIT = 1 << 20; // Most zones and most frames kept for the trace
+struct TraceZone { int zone; double start, duration; }; // A zone of the trace, in microseconds since profileOrigin
+struct TraceFrame { double end; long long counters[COUNTER_COUNT]; double gpuTime; }; // The counters of a frame of the trace
+bool profilingActive = false; // Whether zones are timed and work is counted: the HUD is shown or a trace is recorded
+bool hudVisible = false; // Draw the profiling HUD over the scene ('p')
+const char* traceOutput = nullptr; // Chrome trace file written at exit ("--trace out.json")
+chrono::steady_clock::time_point profileOrigin = chrono::steady_clock::now(); // Time 0 of the trace
+double zoneTime[ZONE_COUNT]; // Microseconds spent in each zone during the current frame
+long long profileCounters[COUNTER_COUNT]; // Work counted during the current frame
+double lastZoneTime[ZONE_COUNT]; // Zone times and counters of the last finished frame, shown by the HUD
+long long lastCounters[COUNTER_COUNT];
+double lastGpuTime = -1; // Microseconds the GPU took for a recent frame, -1 without timer queries
+double frameHistory[PROFILE_HISTORY]; // Times of the recent frames, in microseconds
+int frameHistoryCount = 0; // Frames finished since profiling started
+vector<TraceZone> traceZones; // Recorded for "--trace"
+vector<TraceFrame> traceFrames;
+
+// Measures the CPU time from its construction to the end of its scope and adds it to its zone
+// Closing the ZONE_FRAME scope finishes the frame.
+struct ProfileScope {
+    ProfileZone zone;
+    bool active;
+    chrono::steady_clock::time_point start;
+    explicit ProfileScope(ProfileZone zone) : zone(zone), active(profilingActive) {
+        if (active) {
+            start = chrono::steady_clock::now();
+        }
+    }
+    ~ProfileScope() {
+        if (!active) {
+            return;
+        }
+        chrono::steady_clock::time_point end = chrono::steady_clock::now();
+        double startTime = chrono::duration<double, micro>(start - profileOrigin).count();
+        double duration = chrono::duration<double, micro>(end - start).count();
+        zoneTime[zone] += duration;
+        if (traceOutput && traceZones.size() < PROFILE_TRACE_LIMIT) {
+            traceZones.push_back({ zone, startTime, duration });
+        }
+        if (zone == ZONE_FRAME) {
+            finishProfileFrame(startTime, duration);
+        }
+    }
+};
+#  define PROFILE_SCOPE(zone) ProfileScope profileScope(zone)
+#  define PROFILE_COUNT(counter, n) do { if (profilingActive) profileCounters[counter] += (n); } while (0)
+#else
+#  define PROFILE_SCOPE(zone) ((void)0)
+#  define PROFILE_COUNT(counter, n) ((void)0)
+#endif
 
 
 // **********************************************************************************
@@ -87,11 +962,77 @@ bool animationRunning = false; // Flag to control the animation
 // **********************************************************************************
 int main(int argc, char** argv)
 {
+    // 0. Read the command-line options. With "--headless" the animation is rendered offscreen
+    //    and written to image files instead of being shown in a window.
+    if (!parseArguments(argc, argv)) {
+        return 1;
+    }
+    detectSimdLevel();
+    if (sceneInput && !loadScene(sceneInput)) {
+        return 1;
+    }
+#if HW05_PROFILE
+    if (traceOutput) {
+        atexit(writeProfileTrace); // Also runs when the window is closed, GLUT then calls exit()
+    }
+#endif
+    if (benchmarkMode) {
+        return runBenchmark();
+    }
+    if (benchmarkSuiteMode) {
+        return runBenchmarkSuite();
+    }
+    if (textBenchmarkMode) {
+        return runTextBenchmark();
+    }
+    if (pickBenchmarkMode) {
+        return runPickBenchmark();
+    }
+    if (sceneBenchmarkMode) {
+        return runSceneBenchmark();
+    }
+    if (lodCheckMode) {
+        return runLodCheck();
+    }
+    if (shapeCheckMode) {
+        return runShapeCheck();
+    }
+    if (replayCheckMode) {
+        return runReplayCheck();
+    }
+    if (replayInput) {
+        return runReplay();
+    }
+    if (tessellationBenchmarkMode) {
+        return runTessellationBenchmark();
+    }
+    if (crowdBenchmarkMode) {
+        return runCrowdBenchmark();
+    }
+    if (animationBenchmarkMode) {
+        return runAnimationBenchmark();
+    }
+    if (allocationCheckMode) {
+        return runAllocationCheck();
+    }
+    if (posterCheckMode) {
+        return runPosterCheck();
+    }
+    if (posterOutput) {
+        return runPoster();
+    }
+    if (headlessMode) {
+        return runHeadless();
+    }
+    if (recordOutput && !openInputRecording(recordOutput)) {
+        return 1;
+    }
+
     // 1. Initialize GLUT.
     glutInit(&argc, argv);
 
     // 2. Initialize display mode to specify single/double buffer and RGB/index.
-    glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB);    // Use "GLUT_SINGLE" if single buffer is used
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);    // Draw into a back buffer so no partial frame is ever shown, the depth buffer keeps batched shapes in draw order
 
     // 3. Set up the initial position (X,Y) of the display window
     glutInitWindowPosition(windowPositionX, windowPositionY);
@@ -101,6 +1042,7 @@ int main(int argc, char** argv)
 
     // 5. Create the display window with the title "Doraemon"
     glutCreateWindow("Doraemon");
+    openGLContext = true;
 
     // 6. Call user defined functions such as functions to display instructions and
     //    functions to execute one time jobs
@@ -110,10 +1052,12 @@ int main(int argc, char** argv)
     // 7. Register callback functions to be called by GLUT event processing loop
     glutDisplayFunc(myDisplay);	 // Register a display callback function for window repaint event
     glutReshapeFunc(myReshape);  // Register a reshape callback function for window resize event
-    glutTimerFunc(80, update, 0); // Register a timer callback function to be triggered after a specified time
+    simulationClock = chrono::steady_clock::now(); // Start the simulation clock
+    scheduleUpdate(); // Register a timer callback function to be triggered after a specified time, if the animation runs
 
     glutKeyboardFunc(keyboard); // Register a keyboard callback function for keyboard event
     glutMouseFunc(mouse); // Register a mouse callback function for mouse event
+    createMenu(); // Create the right-click menu once, it never changes
 
     // 8. Start the GLUT event processing loop
     glutMainLoop();
@@ -135,8 +1079,11 @@ int main(int argc, char** argv)
 void Instructions() {
     cout << "Instructions for user interactions:" << std::endl;
     cout << "1. Press 's' to start/stop the animation." << std::endl;
-    cout << "2. Left click to start/stop the animation." << std::endl;
+    cout << "2. Left click a balloon to change its color, click Doraemon to select it, or click elsewhere to start/stop the animation." << std::endl;
     cout << "3. Right click to open the menu. You can change the color of the balloons and toggle the figure name." << std::endl;
+#if HW05_PROFILE
+    cout << "4. Press 'p' to show/hide the frame times, the time spent in each part of the frame and the work counters." << std::endl;
+#endif
 }
 
 // What: A function to do some one-time jobs
@@ -147,10 +1094,26 @@ void Instructions() {
 void Init()
 {
     cout << "Funciton Init() is called.\n";
-    double colorRed = 1.0, colorGreen = 1.0, colorBlue = 0.8, alphaValue = 0.0;
+    buildTextAtlas();
+    reserveFramePools();
+    if (!openGLContext) {
+        return; // The CPU backend reads backgroundColor and lineWidth directly
+    }
 
     // 1. Set the background color of the display window
-    glClearColor(colorRed, colorGreen, colorBlue, alphaValue);
+    glClearColor(backgroundColor[0], backgroundColor[1], backgroundColor[2], backgroundColor[3]);
+
+    // 2. All outlines and lines in the scene are 3 pixels wide
+    glLineWidth(lineWidth);
+
+    // 3. The analytic shapes are shaded by their own program, built only when OpenGL draws them
+    shapeProgram = 0; // A program of another context went with it
+    if (analyticShapes && renderBackend == BACKEND_OPENGL && !buildShapeProgram()) {
+        cerr << "The analytic shapes cannot be drawn in this context, the shapes are drawn as polygons." << endl;
+        analyticShapes = false;
+        invalidateMeshCache(); // The meshes reserveFramePools() built hold analytic quads
+        reserveFramePools();
+    }
 }
 
 
@@ -168,8 +1131,12 @@ void Init()
 void myReshape(int w, int h)
 {
     cout << "Function myReshapeFunc() is called.\n";
-    double clippingPlanLeft = -1.2, clippingPlanRight = 1.2;
-    double clippingPlanBottom = -0.6, clippingPlanTop = 2.0;
+    recordInputEvent(EVENT_RESHAPE, 0, 0, w, h);
+    windowWidth = w; // The CPU backend renders at the size of the window
+    windowHeight = h;
+    if (!openGLContext) {
+        return;
+    }
 
     // 1. Set up the viewport(whole or part of the display window)
     glViewport(0, 0, (GLsizei)w, (GLsizei)h);
@@ -194,32 +1161,68 @@ void myReshape(int w, int h)
 // Input: None
 // Output: None
 void myDisplay() {
+    PROFILE_SCOPE(ZONE_FRAME);
+#if HW05_COUNT_ALLOCATIONS && HW05_PROFILE
+    long long allocationsBefore = allocationCount.load(memory_order_relaxed);
+#endif
+    frameArena.reset(); // Nothing drawn before lives on
+#if HW05_PROFILE
+    beginGpuTimer();
+#endif
+
     //1. Clear the background color of the display window and be ready to color the display window
     //   with the color defined by "glClearColor()" function.
-    glClear(GL_COLOR_BUFFER_BIT);
-    createMenu(); // Create the menu
-
-    // If the displayFigureName flag is true, draw the text "Doraemon" at the specified coordinates
-    if (displayFigureName) {
-        drawText("Doraemon", -0.2, 1.8);
+    if (renderBackend == BACKEND_CPU) {
+        clearCPUFramebuffer();
     }
+    else {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        PROFILE_COUNT(COUNT_GL_CALLS, 1);
+    }
+    repaintCount++;
 
-    glLoadIdentity(); // Reset the current matrix to the identity matrix
-
-    // Translate to the current y position
-    glPushMatrix(); // Save the current matrix
-    glScalef(scaleCharacter, scaleCharacter, 1.0); // Scale the character
+    if (openGLContext) {
+        glLoadIdentity(); // Reset the current matrix to the identity matrix, shapes are transformed on the CPU
+        PROFILE_COUNT(COUNT_GL_CALLS, 1);
+    }
 
     // Draw the Doraemon character, a Bamboo Copter, and balloons
-    drawDoraemon();
-    drawBambooCopter();
-    drawBalloons();
+    drawScene();
 
-    glPopMatrix(); // Restore the saved matrix
+    // Draw the batched shapes of the frame
+    flushFrame();
+#if HW05_PROFILE
+    endGpuTimer();
+#endif
 
+    // If the displayFigureName flag is true, draw the text "Doraemon" at the specified coordinates.
+    // It is drawn last so it also shows on top of the CPU backend's image; no shape reaches it.
+    // Headless frames leave it out, so both backends export the same picture.
+    if (displayFigureName && !headlessMode) {
+        drawText("Doraemon", -0.2, 1.8);
+    }
+#if HW05_PROFILE
+    if (hudVisible) {
+        drawProfileHud();
+    }
+#endif
+    flushText(); // All the text of the frame at once
 
     // 3. Flush the buffer to display the image into the display window, i.e., show the image
-    glFlush();  // When single buffer is used.
+    {
+        PROFILE_SCOPE(ZONE_PRESENT);
+        if (headlessMode) {
+            glFlush(); // The offscreen framebuffer is read back, not shown
+            PROFILE_COUNT(COUNT_GL_CALLS, 1);
+        }
+        else if (openGLContext) {
+            glutSwapBuffers(); // Show the finished back buffer
+            PROFILE_COUNT(COUNT_GL_CALLS, 1);
+        }
+    }
+#if HW05_COUNT_ALLOCATIONS && HW05_PROFILE
+    PROFILE_COUNT(COUNT_ALLOCATIONS, allocationCount.load(memory_order_relaxed) - allocationsBefore);
+#endif
 }
 
 
@@ -228,10 +1231,18 @@ void myDisplay() {
 // Output: None
 // Action: The function handles the keyboard input and performs actions based on the key pressed.
 void keyboard(unsigned char key, int x, int y) {
+    recordInputEvent(EVENT_KEYBOARD, key, 0, x, y);
     switch (key) {
     case 's': // Press 's' to start/stop the animation
-        animationRunning = !animationRunning;
+        setAnimationRunning(!animationRunning);
         break;
+#if HW05_PROFILE
+    case 'p': // Press 'p' to show/hide the profiling HUD
+        hudVisible = !hudVisible;
+        profilingActive = hudVisible || traceOutput;
+        requestRedisplay();
+        break;
+#endif
     }
 }
 
@@ -240,77 +1251,328 @@ void keyboard(unsigned char key, int x, int y) {
 //       state - press (GLUT_DOWN) or release (GLUT_UP) action of a mouse button
 //       x, y - the window relative coordinates when the mouse button state changed
 // Output: None
-// Actions: Start or stop the animation by clicking on left button;
+// Actions: A left click on a balloon gives it the next color of PICK_BALLOON_COLORS, a left click on any shape of a
+//          character selects the character, and a left click elsewhere starts or stops the animation.
+//          The shapes under the mouse are found with pickClick(), without drawing anything.
 void mouse(int button, int state, int x, int y) {
-    if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
-        // Left click to start/stop the animation
-        animationRunning = !animationRunning;
+    recordInputEvent(EVENT_MOUSE, button, state, x, y);
+    if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN) {
+        return;
+    }
+    // The center of the clicked pixel in the viewing volume; window rows count from the top
+    float worldX = (float)(clippingPlanLeft + (x + 0.5) * (clippingPlanRight - clippingPlanLeft) / windowWidth);
+    float worldY = (float)(clippingPlanTop - (y + 0.5) * (clippingPlanTop - clippingPlanBottom) / windowHeight);
+    int character, part;
+    if (!pickClick(worldX, worldY, character, part)) {
+        // Left click on the background to start/stop the animation
+        selectedCharacter = -1;
+        setAnimationRunning(!animationRunning);
+        requestRedisplay();
+        return;
+    }
+
+    selectedCharacter = character;
+    if (part != PICK_BODY) {
+        GLfloat* fill = crowdSize > 0 ? &crowd.balloonColor[(size_t)character * 6] : balloonColor;
+        fill += part == PICK_RIGHT_BALLOON ? 3 : 0;
+        const int colors = sizeof(PICK_BALLOON_COLORS) / sizeof(PICK_BALLOON_COLORS[0]);
+        int next = 0; // The first color, unless the balloon has one of them already
+        for (int i = 0; i < colors; i++) {
+            if (equal(fill, fill + 3, PICK_BALLOON_COLORS[i])) {
+                next = (i + 1) % colors;
+            }
+        }
+        copy(PICK_BALLOON_COLORS[next], PICK_BALLOON_COLORS[next] + 3, fill);
+    }
+    requestRedisplay();
+}
+
+// What: Function to ask for the window to be redrawn
+//       The callbacks also run headless, when a recording is replayed, and GLUT is not initialized then.
+// Input: None
+// Output: None
+// Action: The function calls glutPostRedisplay() unless headlessMode is set.
+// Caller: keyboard(), mouse() and menu()
+void requestRedisplay() {
+    if (!headlessMode) {
+        glutPostRedisplay();
     }
 }
 
 
 // What: Function to update the animation parameters
+//       The timer only runs while the animation does. When it is stopped, the timer is not armed again, so a paused
+//       window gets no events at all until the user does something and the picture is not repainted for nothing.
+//       The timer sets how often the window is redrawn; how far the animation moves only depends on the time that passed.
 // Input: An integer value that is not used
 // Output: None
 // Action: The function updates the animation parameters such as the angle of rotation, scale of the character, and direction of movement. It also controls the animation of the bamboo copter and the balloons.
-// Caller: glutTimerFunc(80, update, 0)
+// Caller: glutTimerFunc(frame interval, update, 0)
 void update(int value) {
-    // Check if the animation is running
+    PROFILE_SCOPE(ZONE_UPDATE);
+    updateTimerArmed = false;
+    timerTickCount++;
+    if (!animationRunning) {
+        return; // Stopped since the timer was armed: park it
+    }
+    advanceAnimation();
+
+    // Redisplay the window and set the timer for the next update
+    glutPostRedisplay();
+    scheduleUpdate();
+}
+
+// What: Function to arm the update timer
+//       At most one update() timer is pending, so stopping and restarting the animation quickly never runs it twice as fast.
+// Input: None
+// Output: None
+// Action: The function registers update() to run after one frame at windowFrameRate (at once when it is 0) if the
+//         animation runs, no timer is pending and there is a window; a replay steps the animation itself.
+// Caller: main(), update() and setAnimationRunning()
+void scheduleUpdate() {
+    if (animationRunning && !updateTimerArmed && !headlessMode) {
+        updateTimerArmed = true;
+        glutTimerFunc(windowFrameRate > 0 ? (unsigned)(1000 / windowFrameRate) : 0, update, 0);
+    }
+}
+
+// What: Function to start or stop the animation
+//       Starting or stopping does not change the picture, so nothing is repainted here.
+// Input: running - whether the animation should run
+// Output: None
+// Action: The function sets animationRunning, restarts the simulation clock and arms the update timer and, unless
+//         it is still pending, the statistics timer when the animation starts.
+// Caller: keyboard() and mouse()
+void setAnimationRunning(bool running) {
+    if (running && !animationRunning) {
+        simulationClock = chrono::steady_clock::now(); // The paused time is not simulated
+    }
+    animationRunning = running;
+    scheduleUpdate();
+    if (running && !statisticsTimerArmed && !headlessMode) {
+        statisticsTimerArmed = true;
+        glutTimerFunc(LOOP_STATISTICS_INTERVAL, reportLoopStatistics, 0);
+    }
+}
+
+// What: Function to report what the event loop did
+//       Like the update timer, this one only runs while the animation does, so a paused window stays asleep and silent.
+// Input: An integer value that is not used
+// Output: None
+// Action: The function prints the repaints, update timer ticks and menu allocations of the last minute if there
+//         were any, resets the counters, and arms itself again if the animation still runs.
+// Caller: glutTimerFunc(LOOP_STATISTICS_INTERVAL, reportLoopStatistics, 0)
+void reportLoopStatistics(int value) {
+    statisticsTimerArmed = false;
+    if (repaintCount > 0 || timerTickCount > 0 || menuAllocationCount > 0) {
+        cout << "Last minute: " << repaintCount << " repaints, " << timerTickCount << " timer ticks, "
+            << menuAllocationCount << " menus created." << endl;
+    }
+    repaintCount = 0;
+    timerTickCount = 0;
+    menuAllocationCount = 0;
     if (animationRunning) {
-        // Update the angle for the bamboo copter
-        angle += angularSpeed;
-        if (angle > 360.f) {
-            angle -= 360.f;  // Wrap around if the angle exceeds 360
-        }
-
-        // Define the parameters for the leg movement
-        const float maxScale = 1.8; // Maximum scale value
-        const float legScaleSpeed = 0.05; // Speed of leg movement
-        const float minLegScale = 0.8; // Minimum leg scale
-        const float maxLegScale = 1.2; // Maximum leg scale
-        const float frequencyFactor = 3.5; // Increase this to make the leg movement faster
-
-        // Update the scale and leg movement
-        if (scaleCharacter < maxScale) {
-            scaleCharacter += scaleSpeedCharacter; // Increase the scale
-            // Alternate the scale of the legs
-            scaleRightLeg = minLegScale + (maxLegScale - minLegScale) * (sin(frequencyFactor * angle) + 1) / 2;
-            scaleLeftLeg = maxLegScale - (maxLegScale - minLegScale) * (sin(frequencyFactor * angle) + 1) / 2;
-        }
-        else {
-            // Stop the leg movement when maximum scale is reached
-            scaleRightLeg = 1.0;
-            scaleLeftLeg = 1.0;
-        }
+        statisticsTimerArmed = true;
+        glutTimerFunc(LOOP_STATISTICS_INTERVAL, reportLoopStatistics, 0);
+    }
+}
+
+// What: Function to advance the animation to the current time
+//       The animation is simulated in fixed steps of SIMULATION_STEP milliseconds, the 80 ms of the original timer, so
+//       the states it goes through are exactly those of the 12.5 Hz timeline however often or irregularly the window
+//       is redrawn. The frame shows the state between the last two steps, at the time left over after the last one.
+// Input: None
+// Output: None
+// Action: If the animation is running, the function runs stepAnimation() once for every whole step of time that
+//         passed since the last call and sets animation to the interpolated state to draw, and animationTime to its time.
+// Caller: update()
+void advanceAnimation() {
+    // Check if the animation is running
+    if (!animationRunning) {
+        return;
+    }
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    simulationLag += min(MAX_FRAME_TIME, chrono::duration<double, milli>(now - simulationClock).count());
+    simulationClock = now;
+    while (simulationLag >= SIMULATION_STEP) {
+        previousAnimation = simulatedAnimation;
+        simulatedAnimation = stepAnimation(simulatedAnimation);
+        simulationLag -= SIMULATION_STEP;
+        simulationSteps++;
+    }
+    animation = interpolateAnimation(previousAnimation, simulatedAnimation, (float)(simulationLag / SIMULATION_STEP));
+    animationTime = max(0.0, simulationSteps - 1 + simulationLag / SIMULATION_STEP);
+}
 
-        // Update the balloon angle
-        balloonAngle += balloonDirection;
+// What: Function to interpolate between two animation states
+//       The copter angle wraps from 360 to 0, so across the wrap the earlier angle is moved down by 360 first and the
+//       blades keep turning forwards. The balloon direction is not a position and is taken from the later state.
+// Input: previous, next - two consecutive animation states
+//        fraction - how far to go from previous (0) to next (1)
+// Output: The interpolated animation state, which is previous itself for fraction 0
+// Action: The function linearly interpolates every position, angle and scale.
+// Caller: advanceAnimation() and renderFrames()
+AnimationState interpolateAnimation(const AnimationState& previous, const AnimationState& next, float fraction) {
+    if (fraction <= 0) {
+        return previous;
+    }
+    auto mix = [fraction](float from, float to) { return from + (to - from) * fraction; };
+    AnimationState state = next;
+    state.angle = mix(next.angle < previous.angle - 180.f ? previous.angle - 360.f : previous.angle, next.angle);
+    state.scaleCharacter = mix(previous.scaleCharacter, next.scaleCharacter);
+    state.scaleRightLeg = mix(previous.scaleRightLeg, next.scaleRightLeg);
+    state.scaleLeftLeg = mix(previous.scaleLeftLeg, next.scaleLeftLeg);
+    state.balloonAngle = mix(previous.balloonAngle, next.balloonAngle);
+    return state;
+}
 
-        // Change the direction of the balloon movement if it exceeds the limits
-        if (balloonAngle > 25.0f || balloonAngle < -25.0f) {
-            balloonDirection *= -1; // Change direction
-        }
+// What: Function to compute the next step of the animation
+// Input: state - the animation state of a frame
+// Output: The animation state of the next frame
+// Action: The function moves the bamboo copter, the character scale, the legs and the balloons one step forward.
+// Caller: advanceAnimation(), stateAt() and renderFrames()
+AnimationState stepAnimation(const AnimationState& state) {
+    AnimationState next = state;
+    // Update the angle for the bamboo copter
+    next.angle += angularSpeed;
+    if (next.angle > 360.f) {
+        next.angle -= 360.f;  // Wrap around if the angle exceeds 360
     }
 
-    // Redisplay the window and set the timer for the next update
-    glutPostRedisplay();
-    glutTimerFunc(80, update, 0);
+    // Update the scale and leg movement
+    if (next.scaleCharacter < MAX_CHARACTER_SCALE) {
+        next.scaleCharacter += scaleSpeedCharacter; // Increase the scale
+        // Alternate the scale of the legs
+        next.scaleRightLeg = MIN_LEG_SCALE + (MAX_LEG_SCALE - MIN_LEG_SCALE) * (sin(LEG_FREQUENCY * next.angle) + 1) / 2;
+        next.scaleLeftLeg = MAX_LEG_SCALE - (MAX_LEG_SCALE - MIN_LEG_SCALE) * (sin(LEG_FREQUENCY * next.angle) + 1) / 2;
+        PROFILE_COUNT(COUNT_TRIG, 2);
+    }
+    else {
+        // Stop the leg movement when maximum scale is reached
+        next.scaleRightLeg = 1.0;
+        next.scaleLeftLeg = 1.0;
+    }
+
+    // Update the balloon angle
+    next.balloonAngle += next.balloonDirection;
+
+    // Change the direction of the balloon movement if it exceeds the limits
+    if (next.balloonAngle > 25.0f || next.balloonAngle < -25.0f) {
+        next.balloonDirection *= -1; // Change direction
+    }
+
+    return next;
+}
+
+// What: Function to seek the animation to a frame
+//       The copter angle is a running float sum and the character scale stops at a clamp, so no closed form reproduces
+//       the stepped values bit for bit. Instead the state of every 1024th frame is remembered, and a frame is reached
+//       by stepping from the checkpoint before it: at most 1023 steps, giving exactly the state the window would show.
+// Input: frame - the index of the frame, 0 being the initial state
+// Output: The animation state of that frame
+// Action: The function extends the checkpoints up to the frame if needed and steps from the last one before it.
+// Caller: renderFrames()
+AnimationState stateAt(int frame) {
+    int checkpoint = frame / ANIMATION_CHECKPOINT_INTERVAL;
+    AnimationState state;
+    {
+        lock_guard<mutex> lock(animationCheckpointMutex);
+        if (animationCheckpoints.empty()) {
+            animationCheckpoints.push_back(initialAnimation);
+        }
+        while ((int)animationCheckpoints.size() <= checkpoint) {
+            state = animationCheckpoints.back();
+            for (int i = 0; i < ANIMATION_CHECKPOINT_INTERVAL; i++) {
+                state = stepAnimation(state);
+            }
+            animationCheckpoints.push_back(state);
+        }
+        state = animationCheckpoints[checkpoint];
+    }
+    for (int i = checkpoint * ANIMATION_CHECKPOINT_INTERVAL; i < frame; i++) {
+        state = stepAnimation(state);
+    }
+    return state;
 }
 
 
 // What: Function to draw text on the screen
-//       This function uses GLUT's bitmap character rendering function to draw text.
+//       The text looks like GLUT's Helvetica 18 bitmap font, but it is not drawn character by character with
+//       glutBitmapCharacter(): the glyphs come from the text atlas and the string becomes textured quads, which are
+//       drawn with all the other text of the frame by flushText().
 // Input: const char* text - The text to be drawn
 //        float x, y - The coordinates where the text should be drawn
 // Output: None
-// Action: The function sets the color and position for the text, and then iterates over each character in the text string, drawing it on the screen.
-// Caller: myDisplay()
+// Action: The function lays the string out with layoutText() and places it with placeText().
+// Caller: myDisplay(), drawProfileHud() and runTextBenchmark()
 void drawText(const char* text, float x, float y) {
-    glColor3f(0.0, 0.0, 0.0); // Set the color of the text to black
-    glRasterPos2f(x, y); // Set the position where the text will start
-    while (*text) { // Iterate over each character in the text string
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *text++); // Draw the current character and move to the next one
+    if (!openGLContext) {
+        return; // The text is drawn with OpenGL, the headless CPU backend has no context
+    }
+    textLayout.clear();
+    layoutText(text, textLayout);
+    placeText(textLayout.data(), textLayout.size(), x, y);
+}
+
+// What: Function to lay out a string
+//       The glyphs sit on whole pixels from the pen position, so a string's quads only depend on its characters, and
+//       a string drawn every frame, like a crowd label, can be laid out once and only moved afterwards.
+// Input: text - the string
+//        quads - receives the quads
+// Output: None
+// Action: The function iterates over each character in the text string and appends the quad of its glyph, in pixels
+//         from the pen position rounded down and FONT_Y_ORIGIN rows below it, in black.
+// Caller: drawText() and drawCrowd()
+void layoutText(const char* text, vector<TextVertex>& quads) {
+    int penX = 0;
+    const GLfloat r = 0.0f, g = 0.0f, b = 0.0f; // Black text
+    for (; *text; text++) { // Iterate over each character in the text string
+        int index = (unsigned char)*text - FIRST_GLYPH;
+        if (index < 0 || index >= GLYPH_COUNT) {
+            continue; // Not in the atlas
+        }
+        const Glyph& glyph = glyphs[index];
+        if (glyph.width > 0) { // Only the glyph's pixels, not its whole cell: spaces cost nothing
+            GLfloat x0 = (GLfloat)(penX + glyph.left), x1 = x0 + glyph.width;
+            GLfloat y0 = (GLfloat)glyph.bottom, y1 = y0 + glyph.height;
+            quads.insert(quads.end(), {
+                { x0, y0, glyph.u0, glyph.v0, r, g, b }, { x1, y0, glyph.u1, glyph.v0, r, g, b },
+                { x1, y1, glyph.u1, glyph.v1, r, g, b }, { x0, y1, glyph.u0, glyph.v1, r, g, b } });
+        }
+        penX += glyph.advance; // Move to the next character
+    }
+}
+
+// What: Function to place laid-out text
+// Input: quads, count - the vertices made by layoutText()
+//        x, y - the pen position in the view
+// Output: None
+// Action: The function finds the window position of (x, y) like glRasterPos2f(), rounds it to whole pixels like
+//         glBitmap(), and appends the quads moved there to the frame's text batch.
+// Caller: drawText(), drawCrowd() and runTextBenchmark()
+void placeText(const TextVertex* quads, size_t count, float x, float y) {
+    GLfloat left = (GLfloat)floor((x - clippingPlanLeft) / (clippingPlanRight - clippingPlanLeft) * windowWidth);
+    GLfloat bottom = (GLfloat)floor((y - clippingPlanBottom) / (clippingPlanTop - clippingPlanBottom) * windowHeight - FONT_Y_ORIGIN);
+    for (size_t i = 0; i < count; i++) {
+        TextVertex vertex = quads[i];
+        vertex.x += left;
+        vertex.y += bottom;
+        frameText.push_back(vertex);
+    }
+}
+
+// What: Function to measure a string
+// Input: text - the string
+// Output: The width, in pixels, drawText() gives it
+// Action: The function adds the advances of the glyphs.
+// Caller: drawCrowd()
+int textWidth(const char* text) {
+    int width = 0;
+    for (; *text; text++) {
+        int index = (unsigned char)*text - FIRST_GLYPH;
+        width += index >= 0 && index < GLYPH_COUNT ? glyphs[index].advance : 0;
     }
+    return width;
 }
 
 
@@ -320,39 +1582,43 @@ void drawText(const char* text, float x, float y) {
 // Action: The function changes the balloon color or toggles the figure name display based on the menu item selected.
 // Caller: createMenu()
 void menu(int item) {
+    recordInputEvent(EVENT_MENU, item, 0, 0, 0);
+    // Both balloons of the character take the color
+    auto setBalloonColors = [](GLfloat red, GLfloat green, GLfloat blue) {
+        for (int i = 0; i < 6; i += 3) {
+            balloonColor[i] = red;
+            balloonColor[i + 1] = green;
+            balloonColor[i + 2] = blue;
+        }
+    };
     switch (item) {
     case 1: // Red
-        balloonColor[0] = 1.0;
-        balloonColor[1] = 0.0;
-        balloonColor[2] = 0.0;
+        setBalloonColors(1.0, 0.0, 0.0);
         break;
     case 2: // Green
-        balloonColor[0] = 0.0;
-        balloonColor[1] = 1.0;
-        balloonColor[2] = 0.0;
+        setBalloonColors(0.0, 1.0, 0.0);
         break;
     case 3: // Blue
-        balloonColor[0] = 0.0;
-        balloonColor[1] = 0.0;
-        balloonColor[2] = 1.0;
+        setBalloonColors(0.0, 0.0, 1.0);
         break;
     case 4: // Toggle figure name
         displayFigureName = !displayFigureName;
         break;
     }
 
-    glutPostRedisplay();
+    requestRedisplay();
 }
 
 // What: Function to create a menu
 // Input: None
 // Output: None
 // Action: The function creates a new pop-up menu, adds menu entries to it, and attaches the menu to the right mouse button.
-// Caller: myDisplay()
+// Caller: main()
 void createMenu() {
     // Step 1: Create a new pop-up menu
     // Step 2: Create the callback function menu (int item)
     glutCreateMenu(menu);
+    menuAllocationCount++;
 
     // Step 4: Add menu entries or sub-menu(s) to the menu
     glutAddMenuEntry("Red Balloons", 1);
@@ -365,232 +1631,6292 @@ void createMenu() {
 }
 
 
-// Below are implementations of creating shapes
-
-// What: Function to draw an ellipse
-// Input: center coordinates (xCenter, yCenter), radii (xRadius, yRadius), color (red, green, blue)
-// Output: None
-// Action: The function first draws a filled ellipse with the specified color, then outlines it in black.
-// Caller: drawDoraemon(), drawBambooCopter() and drawBalloons()
-void drawEllipse(float xCenter, float yCenter, float xRadius, float yRadius, float red, float green, float blue) {
-    glColor3f(red, green, blue);
-    glBegin(GL_POLYGON);
-    for (int i = 0; i <= 300; i++) {
-        double angle = 2 * PI * i / 300;
-        double x = xRadius * cos(angle) + xCenter;
-        double y = yRadius * sin(angle) + yCenter;
-        glVertex2d(x, y);
-    }
-    glEnd();
-
-    glColor3f(0.0, 0.0, 0.0);
-    glLineWidth(3.0);
-    glBegin(GL_LINE_LOOP);
-    for (int i = 0; i <= 300; i++) {
-        double angle = 2 * PI * i / 300;
-        double x = xRadius * cos(angle) + xCenter;
-        double y = yRadius * sin(angle) + yCenter;
-        glVertex2d(x, y);
-    }
-    glEnd();
-}
+// Below is the command line and the headless offscreen renderer
 
-// What: Function to draw an arc
-//       An arc is a portion of the circumference of an ellipse, which is defined by the start and end angles
-// Input: center coordinates (xCenter, yCenter), radii (xRadius, yRadius), start and end angles (startAngle, endAngle), color (red, green, blue)
-// Output: None
-// Action: The function draws an arc from the start angle to the end angle with the specified color.
-// Caller: drawDoraemon()
-void drawArc(float xCenter, float yCenter, float xRadius, float yRadius, float startAngle, float endAngle, float red, float green, float blue) {
-    glColor3f(red, green, blue);
-    glBegin(GL_LINE_STRIP);
-    if (startAngle <= endAngle) {
-        for (int i = startAngle; i <= endAngle; i++) {
-            double angle = 2 * PI * i / 360;
-            double x = xRadius * cos(angle) + xCenter;
-            double y = yRadius * sin(angle) + yCenter;
-            glVertex2d(x, y);
+// What: Function to read the command-line options
+// Input: argc, argv - the arguments of main()
+// Output: true if the options are valid, false otherwise
+// Action: The function recognizes:
+//           --headless      render offscreen instead of opening a window
+//           --frames N      number of frames to render in headless mode
+//           --start N       index of the first frame to render in headless mode
+//           --jobs N        number of processes rendering the headless frames
+//           --size WxH      size of the window or of the offscreen frames
+//           --out dir/      directory the headless frames are written to
+//           --backend gl|cpu   draw with OpenGL or with the CPU rasterizer
+//           --simd scalar|sse2|avx2|avx512   widest span fill the CPU rasterizer may use
+//           --threads N     number of threads rasterizing with the CPU backend
+//           --benchmark     time both backends at 1080p and 4K, then the CPU backend with 1 to 16 threads
+//           --lod-error px  largest distance between a tessellated curve and the true one, 0 for the fixed tessellation
+//           --check-lod     check that the adaptive tessellation stays within that distance of the fixed one
+//           --bench-tessellation   time the table-driven tessellation against per-vertex cos/sin
+//           --full-redraw   make the CPU backend redraw every frame completely instead of only what changed
+//           --fps N         frames per second of the window (0: as fast as possible), or headless frames per second of animation
+//                           (0: one per step); the one option sets both rates, and the mode of the run decides which applies
+//           --crowd N       draw a crowd of N characters instead of one
+//           --bench-crowd   time the crowd for 1 to 100,000 characters with both backends
+//           --bench-animation   time the crowd's animation channels for 1 to 1,000,000 characters
+//           --video file.y4m   stream the headless frames to a Y4M file, or to an encoder with "|command"
+//           --audio file.wav   save the part of a WAV file that plays during those frames as file.y4m.wav
+//           --trace out.json   record the time of every profiled zone and the counters of every frame as a Chrome trace
+//           --bench-suite   time the drawing primitives, the animation update, the scene build and whole frames
+//           --bench-json out.json   file the benchmark suite writes its results to
+//           --labels        label every character of the crowd with its number
+//           --bench-text    time drawing 1 to 10,000 labels per frame
+//           --bench-pick    time picking for 1 to 100,000 characters and check it against testing every shape
+//           --scene file    draw the character described by a scene file, see scenes/doraemon.scene
+//           --bench-scene   time compiling, loading and drawing a generated scene of 12,000 shapes
+//           --shapes polygon|sdf   tessellate ellipses, arcs and sectors, or draw them as antialiased analytic shapes
+//           --check-shapes  compare the analytic shapes with the tessellated ones on both backends
+//           --record file.rec   record the window's keyboard, mouse, menu and resize events
+//           --replay file.rec   replay a recording headless, one frame per simulation step, as fast as possible
+//           --replay-hashes out.txt   file the replay writes the hash of every frame to
+//           --check-replay  check that replaying a recording twice draws identical frames on both backends
+// Caller: main()
+bool parseArguments(int argc, char** argv) {
+    simdLevel = SIMD_AVX512; // Use the widest span fill available unless "--simd" says otherwise
+    renderThreads = max(1u, thread::hardware_concurrency()); // Use every core unless "--threads" says otherwise
+    auto printUsage = [argv]() {
+        cerr << "Usage: " << argv[0] << " [--headless] [--frames N] [--start N] [--jobs N] [--size WxH] [--out dir/] [--backend gl|cpu]"
+            << " [--simd scalar|sse2|avx2|avx512] [--threads N] [--benchmark] [--lod-error px] [--check-lod] [--bench-tessellation] [--full-redraw] [--fps N]"
+            << " [--crowd N] [--bench-crowd] [--bench-animation] [--video file.y4m|\"|command\"] [--audio file.wav] [--trace out.json]"
+            << " [--bench-suite] [--bench-json out.json] [--labels] [--bench-text] [--bench-pick] [--scene file] [--bench-scene]"
+            << " [--check-allocations] [--poster out.png] [--check-poster] [--shapes polygon|sdf] [--check-shapes]"
+            << " [--record file.rec] [--replay file.rec] [--replay-hashes out.txt] [--check-replay]" << endl;
+    };
+    // Reads a whole decimal number of at least minimum; anything else, like "10x" or "" that atoi() reads as a number, is refused
+    auto parseCount = [](const char* text, long minimum, int& value) {
+        char* end;
+        errno = 0;
+        long number = strtol(text, &end, 10);
+        if (end == text || *end != '\0' || errno == ERANGE || number < minimum || number > INT_MAX) {
+            return false;
         }
-    }
-    else {
-        for (int i = startAngle; i >= endAngle; i--) {
-            double angle = 2 * PI * i / 360;
-            double x = xRadius * cos(angle) + xCenter;
-            double y = yRadius * sin(angle) + yCenter;
-            glVertex2d(x, y);
+        value = (int)number;
+        return true;
+    };
+    for (int i = 1; i < argc; i++) {
+        string option = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (option == "--headless") {
+            headlessMode = true;
         }
-    }
-    glEnd();
-}
-
-// What: Function to draw a filled arc
-//       An arc is a portion of the circumference of an ellipse, which is defined by the start and end angles
-// Input: center coordinates (xCenter, yCenter), radii (radiusX, radiusY), start and end angles (startAngle, endAngle), color (red, green, blue)
-// Output: None
-// Action: The function draws a filled arc from the start angle to the end angle with the specified color.
-// Caller: drawDoraemon()
-void drawFilledArc(float xCenter, float yCenter, float radiusX, float radiusY, float startAngle, float endAngle, float red, float green, float blue) {
-    glColor3f(red, green, blue);
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2d(xCenter, yCenter);
-    if (startAngle <= endAngle) {
-        for (int i = startAngle; i <= endAngle; i++) {
-            double angle = 2 * PI * i / 360;
-            double x = radiusX * cos(angle) + xCenter;
-            double y = radiusY * sin(angle) + yCenter;
-            glVertex2d(x, y);
+        else if (option == "--frames" && hasValue) {
+            if (!parseCount(argv[++i], 1, headlessFrames)) {
+                cerr << "The number of frames must be a whole number of at least 1, not \"" << argv[i] << "\"." << endl;
+                printUsage();
+                return false;
+            }
         }
-    }
-    else {
-        for (int i = startAngle; i >= endAngle; i--) {
-            double angle = 2 * PI * i / 360;
-            double x = radiusX * cos(angle) + xCenter;
-            double y = radiusY * sin(angle) + yCenter;
-            glVertex2d(x, y);
+        else if (option == "--start" && hasValue) {
+            if (!parseCount(argv[++i], 0, headlessStart)) {
+                cerr << "The first frame must be a whole number of at least 0, not \"" << argv[i] << "\"." << endl;
+                printUsage();
+                return false;
+            }
         }
-    }
-    glEnd();
-}
-
-// What: Function to draw a line
-// Input: start and end coordinates (x1, y1, x2, y2), color (red, green, blue)
-// Output: None
-// Action: The function draws a line from the start coordinates to the end coordinates with the specified color.
-// Caller: drawDoraemon(), drawBambooCopter() and drawBalloons()
-void drawLine(float x1, float y1, float x2, float y2, float red, float green, float blue) {
-    glColor3f(red, green, blue);
-    glBegin(GL_LINES);
-    glVertex2d(x1, y1);
-    glVertex2d(x2, y2);
-    glEnd();
-}
-
-// What: Function to draw a rectangle
-// Input: corner coordinates (x1, y1, x2, y2), color (r, g, b)
-// Output: None
-// Action: The function first draws a filled rectangle with the specified color, then outlines it in black.
-//         The corner coordinates (x1, y1) and (x2, y2) represent the bottom-left and top-right OR 
-//         bottom-right and top-left corners of the rectangle, respectively
-// Caller: drawDoraemon()
-void drawRectangle(float x1, float y1, float x2, float y2, float r, float g, float b) {
-    glColor3f(r, g, b);
-    glBegin(GL_QUADS);
-    glVertex2f(x1, y1);
-    glVertex2f(x2, y1);
-    glVertex2f(x2, y2);
-    glVertex2f(x1, y2);
-    glEnd();
-
-    glColor3f(0.0, 0.0, 0.0);
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(x1, y1);
-    glVertex2f(x2, y1);
-    glVertex2f(x2, y2);
-    glVertex2f(x1, y2);
-    glEnd();
-}
-
-
-// Below are implementation of some objects
-
-// What: Function to draw a Bamboo Copter
-//       This function uses various shapes like lines and ellipses to draw a Bamboo Copter.
-// Input: None
-// Output: None
-// Action: The function draws a Bamboo Copter with a surface, an attacher, and three fans.
-// Caller: myDisplay()
+        else if (option == "--jobs" && hasValue) {
+            if (!parseCount(argv[++i], 1, headlessJobs)) {
+                cerr << "The number of jobs must be a whole number of at least 1, not \"" << argv[i] << "\"." << endl;
+                printUsage();
+                return false;
+            }
+        }
+        else if (option == "--size" && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &windowWidth, &windowHeight) != 2 || windowWidth <= 0 || windowHeight <= 0) {
+                cerr << "Invalid size \"" << argv[i] << "\", expected WIDTHxHEIGHT." << endl;
+                return false;
+            }
+        }
+        else if (option == "--out" && hasValue) {
+            headlessOutput = argv[++i];
+        }
+        else if (option == "--backend" && hasValue) {
+            string backend = argv[++i];
+            if (backend != "gl" && backend != "cpu") {
+                cerr << "Unknown backend \"" << backend << "\", expected gl or cpu." << endl;
+                return false;
+            }
+            renderBackend = backend == "cpu" ? BACKEND_CPU : BACKEND_OPENGL;
+        }
+        else if (option == "--simd" && hasValue) {
+            const char* names[] = { "scalar", "sse2", "avx2", "avx512" };
+            int level = 0;
+            while (level < 4 && strcmp(argv[i + 1], names[level]) != 0) {
+                level++;
+            }
+            if (level == 4) {
+                cerr << "Unknown SIMD level \"" << argv[i + 1] << "\", expected scalar, sse2, avx2 or avx512." << endl;
+                return false;
+            }
+            simdLevel = (SimdLevel)level; // Lowered by detectSimdLevel() if the processor cannot run it
+            i++;
+        }
+        else if (option == "--threads" && hasValue) {
+            if (!parseCount(argv[++i], 1, renderThreads)) {
+                cerr << "The number of threads must be a whole number of at least 1, not \"" << argv[i] << "\"." << endl;
+                printUsage();
+                return false;
+            }
+        }
+        else if (option == "--benchmark") {
+            benchmarkMode = true;
+        }
+        else if (option == "--lod-error" && hasValue) {
+            lodPixelError = (float)atof(argv[++i]);
+            if (lodPixelError < 0) {
+                cerr << "The tessellation error must be at least 0 pixels." << endl;
+                return false;
+            }
+        }
+        else if (option == "--check-lod") {
+            lodCheckMode = true;
+        }
+        else if (option == "--shapes" && hasValue) {
+            string shapes = argv[++i];
+            if (shapes != "polygon" && shapes != "sdf") {
+                cerr << "The shapes must be \"polygon\" or \"sdf\"." << endl;
+                return false;
+            }
+            analyticShapes = shapes == "sdf";
+        }
+        else if (option == "--check-shapes") {
+            shapeCheckMode = true;
+        }
+        else if (option == "--record" && hasValue) {
+            recordOutput = argv[++i];
+        }
+        else if (option == "--replay" && hasValue) {
+            replayInput = argv[++i];
+        }
+        else if (option == "--replay-hashes" && hasValue) {
+            replayHashOutput = argv[++i];
+        }
+        else if (option == "--check-replay") {
+            replayCheckMode = true;
+        }
+        else if (option == "--bench-tessellation") {
+            tessellationBenchmarkMode = true;
+        }
+        else if (option == "--full-redraw") {
+            layerCacheEnabled = false;
+        }
+        else if (option == "--crowd" && hasValue) {
+            if (!parseCount(argv[++i], 1, crowdSize) || crowdSize > MAX_CROWD) {
+                cerr << "The crowd must have between 1 and " << MAX_CROWD << " characters." << endl;
+                return false;
+            }
+        }
+        else if (option == "--bench-crowd") {
+            crowdBenchmarkMode = true;
+        }
+        else if (option == "--bench-animation") {
+            animationBenchmarkMode = true;
+        }
+        else if (option == "--labels") {
+            crowdLabels = true;
+        }
+        else if (option == "--bench-text") {
+            textBenchmarkMode = true;
+        }
+        else if (option == "--bench-pick") {
+            pickBenchmarkMode = true;
+        }
+        else if (option == "--scene" && hasValue) {
+            sceneInput = argv[++i];
+        }
+        else if (option == "--bench-scene") {
+            sceneBenchmarkMode = true;
+        }
+        else if (option == "--check-allocations") {
+            allocationCheckMode = true;
+        }
+        else if (option == "--poster" && hasValue) {
+            posterOutput = argv[++i];
+        }
+        else if (option == "--check-poster") {
+            posterCheckMode = true;
+        }
+        else if (option == "--bench-suite") {
+            benchmarkSuiteMode = true;
+        }
+        else if (option == "--bench-json" && hasValue) {
+            benchmarkJsonOutput = argv[++i];
+        }
+        else if (option == "--trace" && hasValue) {
+#if HW05_PROFILE
+            traceOutput = argv[++i];
+            profilingActive = true;
+#else
+            cerr << "The profiling instrumentation was compiled out (HW05_PROFILE=0), \"--trace\" is not available." << endl;
+            return false;
+#endif
+        }
+        else if (option == "--video" && hasValue) {
+            videoOutput = argv[++i];
+            headlessMode = true;
+        }
+        else if (option == "--audio" && hasValue) {
+            audioInput = argv[++i];
+        }
+        else if (option == "--fps" && hasValue) {
+            windowFrameRate = headlessFrameRate = atof(argv[++i]); // Whichever the run uses, see windowFrameRate
+            if (windowFrameRate < 0) {
+                cerr << "The frame rate must be at least 0." << endl;
+                return false;
+            }
+        }
+        else {
+            cerr << "Unknown option \"" << option << "\"." << endl;
+            printUsage();
+            return false;
+        }
+    }
+    if (videoOutput && headlessJobs > 1) {
+        cerr << "A video is written by a single process, \"--video\" cannot be used with \"--jobs\"." << endl;
+        return false;
+    }
+#if HW05_PROFILE
+    if (traceOutput && headlessJobs > 1) {
+        cerr << "A trace is recorded by a single process, \"--trace\" cannot be used with \"--jobs\"." << endl;
+        return false;
+    }
+#endif
+    if (posterOutput && (windowWidth > POSTER_MAX_SIZE || windowHeight > POSTER_MAX_SIZE)) {
+        cerr << "A poster can be at most " << POSTER_MAX_SIZE << " pixels wide and high." << endl;
+        return false;
+    }
+#ifndef __linux__
+    if (analyticShapes && renderBackend == BACKEND_OPENGL) {
+        cerr << "The OpenGL backend draws analytic shapes with shaders only on Linux, use \"--backend cpu\" with \"--shapes sdf\"." << endl;
+        return false;
+    }
+#endif
+    if (recordOutput && (headlessMode || replayInput)) {
+        cerr << "\"--record\" records the events of the window, it cannot be used with \"--headless\", \"--video\" or \"--replay\"." << endl;
+        return false;
+    }
+    if (replayHashOutput && !replayInput) {
+        cerr << "\"--replay-hashes\" needs a recording to replay, given with \"--replay\"." << endl;
+        return false;
+    }
+    if (audioInput && (!videoOutput || videoOutput[0] == '|')) {
+        cerr << "\"--audio\" needs a video file, the track is saved next to it." << endl;
+        return false;
+    }
+    return true;
+}
+
+#ifdef __linux__
+EGLDisplay offscreenDisplay = EGL_NO_DISPLAY; // EGL display and context of the headless OpenGL backend
+EGLContext offscreenContext = EGL_NO_CONTEXT;
+GLuint offscreenFramebuffer = 0, offscreenRenderbuffers[2]; // Framebuffer object with its color and depth buffers
+#endif
+
+// What: Function to render the animation without a window
+//       With the OpenGL backend, a context is created with EGL on Mesa's surfaceless platform (llvmpipe when
+//       there is no GPU), so neither an X server nor a GPU is needed. The CPU backend needs no context at all.
+//       The frames are drawn by the same myDisplay() used for the window, and the animation is stepped by stepAnimation().
+// Input: None (uses headlessStart, headlessFrames, headlessJobs, headlessOutput, videoOutput, audioInput, windowWidth,
+//        windowHeight and renderBackend)
+// Output: 0 on success, 1 on failure
+// Action: The function renders headlessFrames frames starting at frame headlessStart, writes them to headlessOutput
+//         named by their frame index (frame_00000.ppm, frame_00001.ppm, ...), streams them to videoOutput, saves the
+//         matching audio and reports the number of frames per second.
+// Caller: main() and runHeadlessJobs()
+int runHeadless() {
+    // 0. Hand long exports to several processes
+    if (headlessJobs > 1) {
+        return runHeadlessJobs();
+    }
+
+    // 1. Create the OpenGL context and the offscreen framebuffer, unless the CPU backend is used
+    if (renderBackend == BACKEND_OPENGL) {
+        if (!openOffscreenContext(windowWidth, windowHeight)) {
+            return 1;
+        }
+        cout << "Rendering headless with " << glGetString(GL_RENDERER) << "." << endl;
+    }
+    else {
+        const char* names[] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+        cout << "Rendering headless with the CPU rasterizer (" << names[simdLevel] << " span fills)." << endl;
+    }
+
+    // 2. Do the same one-time jobs as the window
+    Init();
+    myReshape(windowWidth, windowHeight);
+
+    // 3. Render, save and step every frame, streaming them to the video if there is one
+    double frameRate = headlessFrameRate > 0 ? headlessFrameRate : SIMULATION_RATE;
+    if (videoOutput && !openVideoExport(videoOutput, windowWidth, windowHeight, frameRate)) {
+        closeOffscreenContext();
+        return 1;
+    }
+    totalPixelsWritten = 0;
+    double seconds = renderFrames(headlessStart, headlessFrames, headlessOutput);
+    if (videoOutput && !closeVideoExport()) {
+        seconds = -1;
+    }
+    if (seconds >= 0 && audioInput) {
+        string audioOutput = string(videoOutput) + ".wav";
+        if (!writeAudioTrack(audioInput, audioOutput.c_str(), headlessStart / frameRate, headlessFrames / frameRate)) {
+            seconds = -1;
+        }
+    }
+    if (seconds >= 0) {
+        cout << "Rendered " << headlessFrames << " frames of " << windowWidth << "x" << windowHeight << " in " << seconds << " s ("
+            << headlessFrames / seconds << " frames per second)." << endl;
+        if (renderBackend == BACKEND_CPU && headlessFrames > 0) {
+            double perFrame = (double)totalPixelsWritten / headlessFrames;
+            printf("Wrote %.0f pixels per frame on average, %.1f%% of the frame's size.\n", perFrame, 100 * perFrame / ((double)windowWidth * windowHeight));
+        }
+    }
+
+    // 4. Release the framebuffer and the context
+    closeOffscreenContext();
+    return seconds >= 0 ? 0 : 1;
+}
+
+// What: Function to render the headless frames with several processes
+//       Every frame's animation state comes from stateAt(), so each process can start at its own first frame and the
+//       files it writes are byte for byte the ones a single process would write. The processes share nothing, not even
+//       the OpenGL context: they are forked before any context or rasterizer thread exists.
+// Input: None (uses headlessStart, headlessFrames, headlessJobs and renderThreads)
+// Output: 0 if every process succeeded, 1 otherwise
+// Action: The function splits the frames into headlessJobs contiguous ranges, renders each one in a child process
+//         running runHeadless(), waits for all of them and reports the overall number of frames per second.
+// Caller: runHeadless()
+int runHeadlessJobs() {
+#ifdef _WIN32
+    cerr << "Splitting the frames across processes needs fork(), rendering them in this process." << endl;
+    headlessJobs = 1;
+    return runHeadless();
+#else
+    int jobs = min(headlessJobs, max(1, headlessFrames));
+    int firstFrame = headlessStart, frames = headlessFrames;
+    vector<pid_t> children;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    cout.flush(); // Do not let the children print what is still buffered
+    for (int job = 0; job < jobs; job++) {
+        int begin = firstFrame + (int)((long long)frames * job / jobs);
+        int end = firstFrame + (int)((long long)frames * (job + 1) / jobs);
+        pid_t child = fork();
+        if (child == 0) {
+            headlessStart = begin;
+            headlessFrames = end - begin;
+            headlessJobs = 1;
+            renderThreads = max(1, renderThreads / jobs); // The processes already keep the cores busy
+            int result = runHeadless();
+            cout.flush();
+            _exit(result);
+        }
+        if (child < 0) {
+            cerr << "Could not start the process for frames " << begin << " to " << end - 1 << "." << endl;
+            break;
+        }
+        children.push_back(child);
+    }
+
+    bool ok = (int)children.size() == jobs;
+    for (pid_t child : children) {
+        int status = 0;
+        ok = waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0 && ok;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (ok) {
+        cout << "Rendered frames " << firstFrame << " to " << firstFrame + frames - 1 << " with " << jobs << " processes in " << seconds << " s ("
+            << frames / seconds << " frames per second)." << endl;
+    }
+    return ok ? 0 : 1;
+#endif
+}
+
+// What: Function to compare the rendering backends
+//       The OpenGL backend runs on whatever the surfaceless EGL platform provides (llvmpipe in a container without a GPU).
+// Input: None (uses headlessFrames)
+// Output: 0 on success, 1 on failure
+// Action: For 1920x1080 and 3840x2160, the function renders headlessFrames frames of the running animation with
+//         each backend, starting from the same animation state, and prints the frames per second of each run.
+// Caller: main()
+int runBenchmark() {
+    const int sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+    const RenderBackend backends[] = { BACKEND_OPENGL, BACKEND_CPU };
+    const char* simdNames[] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+
+    headlessMode = true;
+    cout << "Benchmark: " << headlessFrames << " frames of the running animation per run." << endl;
+    for (const int* size : sizes) {
+        for (RenderBackend backend : backends) {
+            renderBackend = backend;
+            string name = "CPU rasterizer (" + string(simdNames[simdLevel]) + ")";
+            if (backend == BACKEND_OPENGL) {
+                if (!openOffscreenContext(size[0], size[1])) {
+                    continue;
+                }
+                name = "OpenGL (" + string((const char*)glGetString(GL_RENDERER)) + ")";
+            }
+            Init();
+            myReshape(size[0], size[1]);
+
+            double seconds = renderFrames(0, headlessFrames, nullptr);
+            closeOffscreenContext();
+            if (seconds < 0) {
+                return 1;
+            }
+            printf("  %4dx%-4d  %-50s %8.2f frames per second\n", size[0], size[1], name.c_str(), headlessFrames / seconds);
+        }
+    }
+
+    runScalingBenchmark();
+    return 0;
+}
+
+// What: Function to measure how the CPU backend scales with the number of threads
+// Input: None (uses headlessFrames)
+// Output: None
+// Action: The function renders headlessFrames frames at 3840x2160 with 1, 2, 4, 8 and 16 rasterizer threads,
+//         each time from the same animation state, and prints the frames per second and the speed-up over one thread.
+// Caller: runBenchmark()
+void runScalingBenchmark() {
+    const char* simdNames[] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+    int savedThreads = renderThreads;
+    double singleThreaded = 0;
+
+    renderBackend = BACKEND_CPU;
+    Init();
+    myReshape(3840, 2160);
+    cout << "CPU rasterizer (" << simdNames[simdLevel] << ") at 3840x2160, " << thread::hardware_concurrency() << " hardware threads:" << endl;
+    for (int threads = 1; threads <= 16; threads *= 2) {
+        stopRasterWorkers();
+        renderThreads = threads;
+
+        double framesPerSecond = headlessFrames / renderFrames(0, headlessFrames, nullptr);
+        if (threads == 1) {
+            singleThreaded = framesPerSecond;
+        }
+        printf("  %2d thread%s %8.2f frames per second  (%.2fx)\n", threads, threads == 1 ? " " : "s", framesPerSecond, framesPerSecond / singleThreaded);
+    }
+    stopRasterWorkers();
+    renderThreads = savedThreads;
+}
+
+// What: Function to run the benchmark suite
+//       Every case runs its body with more and more repetitions until one run lasts BENCH_TRIAL_SECONDS, then runs it
+//       BENCH_TRIALS times and keeps the median run, with the spread of the runs left after dropping the fastest and
+//       the slowest as the case's noise. bench/compare.py allows each case its noise on top of the threshold.
+//       The cases are:
+//         - primitive/*: one call of drawEllipse(), drawArc(), drawFilledArc(), drawLine() and drawRectangle() at
+//           1920x1080, tessellation and submission to the frame command buffer included,
+//         - update/*: one stepAnimation() with the interpolation update() does, and seeking with stateAt(),
+//         - frame/build/*: drawScene() of the single character at each resolution, without drawing the result,
+//         - frame/cpu/* and frame/gl/*: whole frames of the running animation at each resolution with renderFrames(),
+//           the OpenGL backend on whatever the surfaceless EGL platform provides (llvmpipe without a GPU), every
+//           frame drawn completely,
+//         - frame/cpu-dirty/*: the same frames with the CPU backend's static layer and dirty rectangles.
+//       A repetition of a frame case always renders the same BENCH_FRAME_WINDOW frames, of the grown character whose
+//       copter and balloons move and whose legs stand still. With dirty rectangles a
+//       frame costs next to nothing once the one before it is drawn, so timing "the next N frames" would give a
+//       result that depends on how many repetitions the calibration picked.
+// Input: None (uses benchmarkJsonOutput)
+// Output: 0 on success, 1 if the results could not be written
+// Action: The function prints the time of every case and writes them, with the SIMD level, the number of rasterizer
+//         threads and the OpenGL renderer, to benchmarkJsonOutput for bench/compare.py.
+// Caller: main()
+int runBenchmarkSuite() {
+    const int sizes[][2] = { { 800, 600 }, { 1920, 1080 }, { 3840, 2160 } };
+    const char* simdNames[] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+    struct BenchResult { string name; double value, noise; const char* unit; };
+    vector<BenchResult> results;
+    string renderer = "none";
+
+    // Times body(repetitions) and records the median time of one repetition, multiplied by scale, and its noise
+    auto measure = [&results](const string& name, const char* unit, double scale, auto body) {
+        auto run = [&body](int repetitions) {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            body(repetitions);
+            return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        };
+        int repetitions = 1;
+        for (double seconds = run(1); seconds < BENCH_TRIAL_SECONDS && repetitions < (1 << 28); seconds = run(repetitions)) {
+            repetitions = (int)min(1e9, repetitions * max(2.0, 1.2 * BENCH_TRIAL_SECONDS / max(seconds, 1e-9)));
+        }
+        double trials[BENCH_TRIALS];
+        for (double& seconds : trials) {
+            seconds = run(repetitions);
+        }
+        sort(trials, trials + BENCH_TRIALS);
+        double median = trials[BENCH_TRIALS / 2];
+        results.push_back({ name, median / repetitions * scale, (trials[BENCH_TRIALS - 2] - trials[1]) / median, unit });
+        printf("  %-32s %12.3f %s  +-%.1f%%\n", name.c_str(), results.back().value, unit, 50 * results.back().noise);
+        fflush(stdout);
+    };
+    auto resetFrame = []() {
+        frameTriangles.clear();
+        frameLines.clear();
+        framePrimitives.clear();
+        frameLayer = 0;
+    };
+
+    headlessMode = true;
+    renderBackend = BACKEND_CPU;
+    crowdSize = 0;
+    Init();
+    cout << "Benchmark suite, " << simdNames[simdLevel] << " span fills, rasterizer threads: " << renderThreads << endl;
+
+    // 1. Drawing primitives, at the scale of Doraemon's face in a 1080p window
+    myReshape(1920, 1080);
+    auto primitive = [&](const char* name, void (*draw)()) {
+        measure(string("primitive/") + name, "ns", 1e9, [&](int repetitions) {
+            for (int i = 0; i < repetitions; i++) {
+                if ((i & 1023) == 0) {
+                    resetFrame(); // Keep the frame command buffer small, like in a real frame
+                }
+                draw();
+            }
+        });
+    };
+    primitive("drawEllipse", [] { drawEllipse(0.0, 0.5, 0.25, 0.2, 0.6, 0.8, 1.0); });
+    primitive("drawArc", [] { drawArc(-0.032, 0.51, 0.018, 0.025, 40, 180, 0.0, 0.0, 0.0); });
+    primitive("drawFilledArc", [] { drawFilledArc(0.0, 0.413, 0.065, 0.065, 0, -180, 0.98, 0.012, 0.337); });
+    primitive("drawLine", [] { drawLine(0.12, 0.44, 0.2, 0.47, 0.0, 0.0, 0.0); });
+    primitive("drawRectangle", [] { drawRectangle(-0.15, 0.28, 0.15, -0.03, 0.6, 0.8, 1.0); });
+    resetFrame();
+
+    // 2. Animation update
+    volatile float sink = 0; // Keeps the states from being optimized away
+    measure("update/step", "ns", 1e9, [&](int repetitions) {
+        AnimationState previous = initialAnimation, next = stepAnimation(previous);
+        for (int i = 0; i < repetitions; i++) {
+            previous = next;
+            next = stepAnimation(next);
+            sink = sink + interpolateAnimation(previous, next, 0.5f).scaleLeftLeg;
+        }
+    });
+    stateAt(100000); // Fill the checkpoints first, as a long export would
+    measure("update/seek", "us", 1e6, [&](int repetitions) {
+        for (int i = 0; i < repetitions; i++) {
+            sink = sink + stateAt((i * 7919) % 100000).angle;
+        }
+    });
+
+    // 3. Scene build over the first 200 frames, the character growing, at every resolution
+    vector<AnimationState> states(1, initialAnimation);
+    while (states.size() < 200) {
+        states.push_back(stepAnimation(states.back()));
+    }
+    for (const int* size : sizes) {
+        myReshape(size[0], size[1]);
+        measure("frame/build/" + to_string(size[0]) + "x" + to_string(size[1]), "us", 1e6, [&](int repetitions) {
+            for (int i = 0; i < repetitions; i++) {
+                animation = states[i % states.size()];
+                drawScene();
+                resetFrame();
+            }
+        });
+    }
+    animation = initialAnimation;
+
+    // 4. Whole frames with both backends
+    for (int backend = 0; backend < 2; backend++) {
+        renderBackend = backend == 0 ? BACKEND_CPU : BACKEND_OPENGL;
+        for (const int* size : sizes) {
+            if (renderBackend == BACKEND_OPENGL) {
+                if (!openOffscreenContext(size[0], size[1])) {
+                    break;
+                }
+                renderer = (const char*)glGetString(GL_RENDERER);
+            }
+            Init();
+            myReshape(size[0], size[1]);
+            string resolution = to_string(size[0]) + "x" + to_string(size[1]);
+            auto frames = [](int repetitions) {
+                for (int i = 0; i < repetitions; i++) {
+                    renderFrames(BENCH_FRAME_START, BENCH_FRAME_WINDOW, nullptr);
+                }
+            };
+            layerCacheEnabled = false;
+            measure((backend == 0 ? "frame/cpu/" : "frame/gl/") + resolution, "ms", 1e3 / BENCH_FRAME_WINDOW, frames);
+            layerCacheEnabled = true;
+            if (renderBackend == BACKEND_CPU) {
+                measure("frame/cpu-dirty/" + resolution, "ms", 1e3 / BENCH_FRAME_WINDOW, frames);
+            }
+            closeOffscreenContext();
+        }
+    }
+    stopRasterWorkers();
+
+    // 5. Save the results
+    if (!benchmarkJsonOutput) {
+        return 0;
+    }
+    FILE* file = fopen(benchmarkJsonOutput, "w");
+    if (!file) {
+        cerr << "Could not write " << benchmarkJsonOutput << "." << endl;
+        return 1;
+    }
+    fprintf(file, "{\n  \"simd\": \"%s\",\n  \"threads\": %d,\n  \"renderer\": \"%s\",\n  \"results\": [\n",
+        simdNames[simdLevel], renderThreads, renderer.c_str());
+    for (size_t i = 0; i < results.size(); i++) {
+        fprintf(file, "    { \"name\": \"%s\", \"value\": %.6g, \"noise\": %.4f, \"unit\": \"%s\" }%s\n",
+            results[i].name.c_str(), results[i].value, results[i].noise, results[i].unit, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    if (fclose(file) != 0) {
+        cerr << "Could not write " << benchmarkJsonOutput << "." << endl;
+        return 1;
+    }
+    cout << "Wrote " << results.size() << " results to " << benchmarkJsonOutput << "." << endl;
+    return 0;
+}
+
+// What: Function to measure how the frame rate falls as the crowd grows
+// Input: None (uses headlessFrames)
+// Output: 0 on success, 1 on failure
+// Action: For crowds of 1, 10, 100, ... 100,000 characters at 1920x1080, the function renders up to headlessFrames
+//         frames (stopping after 2 seconds) with each backend and prints the frames per second and the characters drawn.
+// Caller: main()
+int runCrowdBenchmark() {
+    const RenderBackend backends[] = { BACKEND_OPENGL, BACKEND_CPU };
+    const char* simdNames[] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+
+    headlessMode = true;
+    cout << "Crowd benchmark at 1920x1080, up to " << headlessFrames << " frames or 2 seconds per run." << endl;
+    for (RenderBackend backend : backends) {
+        renderBackend = backend;
+        string name = "CPU rasterizer (" + string(simdNames[simdLevel]) + ")";
+        if (backend == BACKEND_OPENGL) {
+            if (!openOffscreenContext(1920, 1080)) {
+                continue;
+            }
+            name = "OpenGL (" + string((const char*)glGetString(GL_RENDERER)) + ")";
+        }
+        Init();
+        myReshape(1920, 1080);
+        cout << name << ":" << endl;
+        for (int count = 1; count <= MAX_CROWD; count *= 10) {
+            crowdSize = count;
+            double seconds = 0;
+            int frames = 0;
+            while (frames < headlessFrames && seconds < 2) {
+                double frameSeconds = renderFrames(frames, 1, nullptr);
+                if (frameSeconds < 0) {
+                    closeOffscreenContext();
+                    return 1;
+                }
+                seconds += frameSeconds;
+                frames++;
+            }
+            printf("  %6d characters, %6d drawn  %10.2f frames per second\n", count, crowdVisible, frames / seconds);
+        }
+        closeOffscreenContext();
+    }
+    return 0;
+}
+
+// What: Function to measure the cost of text
+//       A crowd with a label per character, or the profiling HUD, draws far more text than the "Doraemon" label.
+//       The labels are laid out once, like drawCrowd() does, so what is left per frame is placing their quads and
+//       filling them, and the filling grows with the labels' pixels: on a software renderer, hundreds of labels cost
+//       as much as the scene.
+// Input: None (uses headlessFrames)
+// Output: 0 on success, 1 if there is no OpenGL context
+// Action: At 1920x1080 with the OpenGL backend, the function first checks that the atlas draws every glyph exactly
+//         like glBitmap(), which is what glutBitmapCharacter() calls. It then times the scene's frames, and frames of
+//         1, 10, ... 10,000 labels of about 12 characters at fixed random positions, up to headlessFrames frames or
+//         2 seconds each, placed from their layout and drawn through the atlas, and with a glBitmap() per character.
+//         It prints the milliseconds per frame of each, the placing alone, and the atlas's share of a scene frame.
+// Caller: main()
+int runTextBenchmark() {
+    headlessMode = true;
+    renderBackend = BACKEND_OPENGL;
+    if (!openOffscreenContext(1920, 1080)) {
+        return 1;
+    }
+    Init();
+    myReshape(1920, 1080);
+
+    // 1. The bitmap of every glyph, and the way glutBitmapCharacter() draws a string with them
+    vector<const unsigned char*> bitmaps;
+    for (const unsigned char* data = FONT_GLYPHS; bitmaps.size() < GLYPH_COUNT; data += 1 + (*data + 7) / 8 * FONT_HEIGHT) {
+        bitmaps.push_back(data);
+    }
+    auto drawBitmapText = [&bitmaps](const char* text, float x, float y) {
+        glColor3f(0.0, 0.0, 0.0);
+        glRasterPos2f(x, y);
+        for (; *text; text++) {
+            const unsigned char* bitmap = bitmaps[(unsigned char)*text - FIRST_GLYPH];
+            glBitmap(bitmap[0], FONT_HEIGHT, 0, (GLfloat)FONT_Y_ORIGIN, bitmap[0], 0, bitmap + 1);
+        }
+    };
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // 2. Compare both on every printable character, at a position that is not on a whole pixel
+    string sample;
+    for (int c = FIRST_GLYPH; c < FIRST_GLYPH + GLYPH_COUNT; c++) {
+        sample += (char)c;
+    }
+    vector<unsigned char> reference((size_t)windowWidth * windowHeight * 3), atlas(reference.size());
+    float sampleX = (float)(clippingPlanLeft + 0.0137), sampleY = 0.3f;
+    glClear(GL_COLOR_BUFFER_BIT);
+    drawBitmapText(sample.c_str(), sampleX, sampleY);
+    readFramePixels(reference.data());
+    glClear(GL_COLOR_BUFFER_BIT);
+    drawText(sample.c_str(), sampleX, sampleY);
+    flushText();
+    readFramePixels(atlas.data());
+    size_t different = 0;
+    for (size_t i = 0; i < reference.size(); i++) {
+        different += reference[i] != atlas[i];
+    }
+    printf("Atlas against glBitmap() on all %d glyphs: %zu different bytes.\n", GLYPH_COUNT, different);
+
+    double sceneMilliseconds = 1000 * renderFrames(0, headlessFrames, nullptr) / headlessFrames;
+    printf("Text at 1920x1080 with %s, the scene alone takes %.3f ms per frame:\n", (const char*)glGetString(GL_RENDERER), sceneMilliseconds);
+
+    uint32_t seed = 2463534242u;
+    auto random = [&seed]() { // Uniform in [0, 1)
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return (seed >> 8) * (1.0f / 16777216.0f);
+    };
+    for (int count = 1; count <= 10000; count *= 10) {
+        vector<string> labels;
+        vector<float> x, y;
+        vector<TextVertex> quads;
+        vector<int> start;
+        for (int i = 0; i < count; i++) {
+            labels.push_back("Doraemon " + to_string(i));
+            x.push_back((float)(clippingPlanLeft + random() * (clippingPlanRight - clippingPlanLeft)));
+            y.push_back((float)(clippingPlanBottom + random() * (clippingPlanTop - clippingPlanBottom)));
+            start.push_back((int)quads.size());
+            layoutText(labels[i].c_str(), quads);
+        }
+        start.push_back((int)quads.size());
+        double layout = 0, draw = 0;
+        int frames = 0;
+        while (frames < headlessFrames && layout + draw < 2) {
+            chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+            for (int i = 0; i < count; i++) {
+                placeText(&quads[start[i]], start[i + 1] - start[i], x[i], y[i]);
+            }
+            chrono::steady_clock::time_point placed = chrono::steady_clock::now();
+            flushText();
+            glFinish(); // Wait for the text so the timing is not just the time to queue it
+            layout += chrono::duration<double>(placed - begin).count();
+            draw += chrono::duration<double>(chrono::steady_clock::now() - placed).count();
+            frames++;
+        }
+        double bitmapSeconds = 0;
+        int bitmapFrames = 0;
+        while (bitmapFrames < headlessFrames && bitmapSeconds < 2) {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for (int i = 0; i < count; i++) {
+                drawBitmapText(labels[i].c_str(), x[i], y[i]);
+            }
+            glFinish();
+            bitmapSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            bitmapFrames++;
+        }
+        double atlasMilliseconds = 1000 * (layout + draw) / frames;
+        printf("  %6d labels  atlas %8.3f ms per frame (placing %7.3f ms, %6.1f%% of a scene frame)  glBitmap %9.3f ms per frame\n",
+            count, atlasMilliseconds, 1000 * layout / frames, 100 * atlasMilliseconds / sceneMilliseconds,
+            1000 * bitmapSeconds / bitmapFrames);
+    }
+    closeOffscreenContext();
+    return different == 0 ? 0 : 1;
+}
+
+// What: Function to check and time picking
+//       A pick has to account for every transform the shape was drawn with, and stay fast for a large crowd.
+// Input: None
+// Output: 0 if every check passes, 1 otherwise
+// Action: At 1920x1080, without any OpenGL context, the function first checks the single character at several frames:
+//         points computed by hand from the character's scale, the leg scales and the balloon rotation about
+//         (+-0.45, 0.63) must hit, or just miss, the legs and the balloons, and a frame drawn before the animation
+//         moves on must still be picked as drawn. Then, for 1 and for crowds of 10 to 100,000 characters, it draws a
+//         frame and times a click on it from the click to the hit, which searches the frame's meshes, and building
+//         the index. It prints the index's shapes and cells, checks 100,000 random points against testing every
+//         shape from the top down, both with the index and the click's search, and times 1,000,000 random picks on
+//         the built index.
+// Caller: main()
+int runPickBenchmark() {
+    headlessMode = true;
+    renderBackend = BACKEND_CPU;
+    myReshape(1920, 1080);
+    bool passed = true;
+
+    // 1. The single character, against points worked out without the transform stack
+    crowdSize = 0;
+    const int frames[] = { 0, 13, 60, 130, 401, 1000 };
+    for (int frame : frames) {
+        animation = stateAt(frame);
+        myDisplay();
+        AnimationState drawn = animation;
+        animation = stateAt(frame + 7); // The animation moves on, and a click must still pick the frame on screen
+        float s = drawn.scaleCharacter, angle = drawn.balloonAngle * (float)PI / 180;
+        float axisX = -sin(angle), axisY = cos(angle); // The balloon's long axis, from the pivot to its top
+        struct Probe {
+            float x, y;
+            int part; // Expected part, or -1 for the background
+            const char* name;
+        };
+        vector<Probe> probes;
+        for (int side = -1; side <= 1; side += 2) {
+            float pivotX = 0.45f * side, pivotY = 0.63f; // The balloon is the ellipse of radii 0.1, 0.2 at 0.2 along the axis
+            int part = side < 0 ? PICK_LEFT_BALLOON : PICK_RIGHT_BALLOON;
+            probes.push_back({ s * (pivotX + 0.2f * axisX), s * (pivotY + 0.2f * axisY), part, "balloon center" });
+            probes.push_back({ s * (pivotX + 0.39f * axisX), s * (pivotY + 0.39f * axisY), part, "inside the balloon top" });
+            probes.push_back({ s * (pivotX + 0.41f * axisX), s * (pivotY + 0.41f * axisY), -1, "above the balloon top" });
+            probes.push_back({ s * (pivotX + 0.2f * axisX + 0.098f * axisY), s * (pivotY + 0.2f * axisY - 0.098f * axisX), part, "inside the balloon side" });
+            probes.push_back({ s * (pivotX + 0.2f * axisX + 0.102f * axisY), s * (pivotY + 0.2f * axisY - 0.102f * axisX), -1, "beside the balloon" });
+            float legScale = side < 0 ? drawn.scaleLeftLeg : drawn.scaleRightLeg; // The leg is the ellipse of radii 0.09, 0.05 at (+-0.1, -0.08)
+            probes.push_back({ s * 0.1f * side, s * -0.129f * legScale, PICK_BODY, "inside the leg bottom" });
+            probes.push_back({ s * 0.1f * side, s * -0.131f * legScale, -1, "below the leg" });
+        }
+        for (const Probe& probe : probes) {
+            int hit = pickAt(probe.x, probe.y);
+            int part = hit < 0 ? -1 : pickShapes[hit].part;
+            if (part != probe.part) {
+                printf("Frame %d, %s at (%.4f, %.4f): expected part %d, picked %d\n", frame, probe.name, probe.x, probe.y, probe.part, part);
+                passed = false;
+            }
+        }
+        pickIndexValid = false; // The same probes with the click's search
+        for (const Probe& probe : probes) {
+            int character, hitPart;
+            int part = pickClick(probe.x, probe.y, character, hitPart) ? hitPart : -1;
+            if (part != probe.part) {
+                printf("Frame %d, %s at (%.4f, %.4f): expected part %d, clicked %d\n", frame, probe.name, probe.x, probe.y, probe.part, part);
+                passed = false;
+            }
+        }
+    }
+    printf("Single character: the balloons and legs are picked where their transforms put them at %d frames: %s\n",
+        (int)(sizeof(frames) / sizeof(frames[0])), passed ? "yes" : "no");
+
+    // 2. Crowds: the index against testing every shape, and the time per pick
+    uint32_t seed = 88172645u;
+    auto random = [&seed]() { // Uniform in [0, 1)
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return (seed >> 8) * (1.0f / 16777216.0f);
+    };
+    const int POINTS = 1 << 17;
+    vector<float> pointX(POINTS), pointY(POINTS);
+    for (int i = 0; i < POINTS; i++) {
+        pointX[i] = (float)(clippingPlanLeft + (clippingPlanRight - clippingPlanLeft) * random());
+        pointY[i] = (float)(clippingPlanBottom + (clippingPlanTop - clippingPlanBottom) * random());
+    }
+    animation = stateAt(200);
+    animationTime = 200;
+    printf("Characters    Drawn    Shapes   Cells  Shapes/cell   Click (ms)   Build (ms)  Pick (ns)   Hits\n");
+    for (int count = 1; count <= MAX_CROWD; count *= 10) {
+        crowdSize = count == 1 ? 0 : count;
+        myDisplay();
+        int step = count >= 10000 ? 100 : 1; // Testing every shape is slow; check 1,000 points
+        vector<int> clicked; // Character and part of every point checked, from the click's search
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int i = 0; i < 100000; i += step) {
+            int character, part;
+            clicked.push_back(pickClick(pointX[i], pointY[i], character, part) ? character * 3 + part : -1);
+        }
+        double click = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / clicked.size();
+        start = chrono::steady_clock::now();
+        buildPickIndex();
+        double build = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        int mismatches = 0;
+        for (int i = 0; i < 100000; i += step) {
+            float x = pointX[i], y = pointY[i];
+            int expected = -1;
+            for (int j = (int)pickShapes.size() - 1; j >= 0 && expected < 0; j--) {
+                expected = pickShapeContains(pickShapes[j], x, y) ? j : -1;
+            }
+            mismatches += pickAt(x, y) != expected;
+            mismatches += clicked[i / step] != (expected < 0 ? -1 : pickShapes[expected].character * 3 + pickShapes[expected].part);
+        }
+        if (mismatches > 0) {
+            printf("%d characters: %d points picked differently from testing every shape\n", count, mismatches);
+            passed = false;
+        }
+
+        const int PICKS = 1000000;
+        int hits = 0;
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < PICKS; i++) {
+            hits += pickAt(pointX[i & (POINTS - 1)], pointY[i & (POINTS - 1)]) >= 0;
+        }
+        double pick = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / PICKS;
+        printf("%10d %8d %9d %7d %12.1f %12.3f %12.2f %10.1f %5.1f%%\n", count, crowdSize > 0 ? crowdVisible : 1, (int)pickShapes.size(),
+            pickColumns * pickRows, (double)pickCellShapes.size() / (pickColumns * pickRows), click, build, pick, 100.0 * hits / PICKS);
+    }
+    crowdSize = 0;
+    crowd = CrowdActors();
+    return passed ? 0 : 1;
+}
+
+// What: Function to measure the scene file
+//       A scene of 12,000 shapes should start in milliseconds from its cache, whatever the cost of compiling it.
+// Input: None (uses headlessFrames)
+// Output: 0 on success, 1 if the scene cannot be written or loaded
+// Action: The function writes a generated scene of 100 nodes of 120 shapes (a third of them swinging or stretching
+//         with a channel) to hw05_bench.scene in the working directory, and times loading it without a cache
+//         (compiling it and writing the cache) and then from the cache, the fastest of 20 loads. It then renders up
+//         to headlessFrames frames at 1920x1080 with the CPU backend and prints the time of the first frame, which
+//         tessellates every node, and of the following ones. The files are removed at the end.
+// Caller: main()
+int runSceneBenchmark() {
+    const char* path = "hw05_bench.scene";
+    string cachePath = string(path) + ".bin";
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        cerr << "Cannot write \"" << path << "\"." << endl;
+        return 1;
+    }
+    uint32_t seed = 2463534242u;
+    auto random = [&seed]() { // Uniform in [0, 1)
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return (seed >> 8) * (1.0f / 16777216.0f);
+    };
+    const int NODES = 100, SHAPES_PER_NODE = 120;
+    fprintf(file, "# Generated by --bench-scene\n");
+    for (int n = 0; n < NODES; n++) {
+        float pivotX = -0.8f + 1.6f * random(), pivotY = 1.0f * random();
+        if (n % 3 == 0) {
+            fprintf(file, "node n%d translate %.4f %.4f rotate @balloonAngle translate %.4f %.4f\n", n, pivotX, pivotY, -pivotX, -pivotY);
+        }
+        else if (n % 3 == 1) {
+            fprintf(file, "node n%d scale 1 @scaleLeftLeg\n", n);
+        }
+        else {
+            fprintf(file, "node n%d\n", n);
+        }
+        for (int s = 0; s < SHAPES_PER_NODE; s++) {
+            float x = pivotX + 0.3f * (random() - 0.5f), y = pivotY + 0.3f * (random() - 0.5f);
+            float rx = 0.005f + 0.02f * random(), ry = 0.005f + 0.02f * random();
+            float r = random(), g = random(), b = random();
+            switch (s % 6) {
+            case 0: fprintf(file, "ellipse %.4f %.4f %.4f %.4f %.3f %.3f %.3f\n", x, y, rx, ry, r, g, b); break;
+            case 1: fprintf(file, "ellipse %.4f %.4f %.4f %.4f %.3f %.3f %.3f nooutline\n", x, y, rx, ry, r, g, b); break;
+            case 2: fprintf(file, "rect %.4f %.4f %.4f %.4f %.3f %.3f %.3f\n", x - rx, y - ry, x + rx, y + ry, r, g, b); break;
+            case 3: fprintf(file, "filledArc %.4f %.4f %.4f %.4f 0 -180 %.3f %.3f %.3f\n", x, y, rx, ry, r, g, b); break;
+            case 4: fprintf(file, "arc %.4f %.4f %.4f %.4f 40 180 0 0 0\n", x, y, rx, ry); break;
+            case 5: fprintf(file, "line %.4f %.4f %.4f %.4f 0 0 0\n", x - rx, y, x + rx, y + ry); break;
+            }
+        }
+        fprintf(file, "spoke %.4f %.4f 0.05 0.02 %d @angle 0 0 0\n", pivotX, pivotY, n);
+    }
+    bool written = fclose(file) == 0;
+    remove(cachePath.c_str());
+
+    // 1. Without the cache, then from it
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    bool loaded = written && loadScene(path);
+    double compile = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    double fastest = 1e30;
+    for (int i = 0; i < 20 && loaded; i++) {
+        start = chrono::steady_clock::now();
+        loaded = loadScene(path);
+        fastest = min(fastest, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
+    if (!loaded) {
+        remove(path);
+        remove(cachePath.c_str());
+        return 1;
+    }
+    struct stat text, cache;
+    stat(path, &text);
+    stat(cachePath.c_str(), &cache);
+    printf("Scene of %u nodes and %u shapes: %.0f KB of text, %.0f KB compiled\n", scene->nodeCount, scene->shapeCount,
+        text.st_size / 1024.0, cache.st_size / 1024.0);
+    printf("  Compiling and caching it  %8.3f ms\n", compile);
+    printf("  Loading it from the cache %8.3f ms (fastest of 20)\n", fastest);
+
+    // 2. Drawing it
+    headlessMode = true;
+    renderBackend = BACKEND_CPU;
+    Init();
+    myReshape(1920, 1080);
+    double first = renderFrames(0, 1, nullptr), rest = 0;
+    int frames = 1;
+    while (frames < headlessFrames && rest < 2 && first >= 0) {
+        rest += renderFrames(frames++, 1, nullptr);
+    }
+    printf("  First frame at 1920x1080  %8.3f ms (tessellates every node)\n", 1000 * first);
+    printf("  Following frames          %8.3f ms\n", frames > 1 ? 1000 * rest / (frames - 1) : 0.0);
+
+    closeScene();
+    remove(path);
+    remove(cachePath.c_str());
+    return first >= 0 ? 0 : 1;
+}
+
+// What: Function to create an OpenGL context without a window
+// Input: width, height - size of the offscreen framebuffer
+// Output: true if the context and the framebuffer were created, false otherwise
+// Action: The function opens Mesa's surfaceless EGL display, makes a desktop OpenGL context current and
+//         binds a framebuffer object with a color and a depth buffer of the given size.
+// Caller: runHeadless() and runBenchmark()
+bool openOffscreenContext(int width, int height) {
+#ifdef __linux__
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    offscreenDisplay = getPlatformDisplay ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr) : EGL_NO_DISPLAY;
+    if (offscreenDisplay == EGL_NO_DISPLAY || !eglInitialize(offscreenDisplay, nullptr, nullptr)) {
+        cerr << "Could not open the surfaceless EGL display." << endl;
+        offscreenDisplay = EGL_NO_DISPLAY;
+        return false;
+    }
+    const EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config;
+    EGLint configCount = 0;
+    eglChooseConfig(offscreenDisplay, configAttributes, &config, 1, &configCount);
+    eglBindAPI(EGL_OPENGL_API);
+    offscreenContext = eglCreateContext(offscreenDisplay, configCount > 0 ? config : nullptr, EGL_NO_CONTEXT, nullptr);
+    if (offscreenContext == EGL_NO_CONTEXT || !eglMakeCurrent(offscreenDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, offscreenContext)) {
+        cerr << "Could not create an OpenGL context." << endl;
+        closeOffscreenContext();
+        return false;
+    }
+    openGLContext = true;
+
+    glGenFramebuffers(1, &offscreenFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreenFramebuffer);
+    glGenRenderbuffers(2, offscreenRenderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreenRenderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenRenderbuffers[0]);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreenRenderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, offscreenRenderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        cerr << "Could not create a " << width << "x" << height << " offscreen framebuffer." << endl;
+        closeOffscreenContext();
+        return false;
+    }
+    return true;
+#else
+    cerr << "The headless OpenGL backend needs EGL and is only available on Linux, use --backend cpu." << endl;
+    return false;
+#endif
+}
+
+// What: Function to release the offscreen OpenGL context
+// Input: None
+// Output: None
+// Action: The function deletes the framebuffer object and destroys the EGL context and display, if they exist.
+// Caller: runHeadless(), runBenchmark() and openOffscreenContext()
+void closeOffscreenContext() {
+#ifdef __linux__
+    if (offscreenFramebuffer) {
+        glDeleteRenderbuffers(2, offscreenRenderbuffers);
+        glDeleteFramebuffers(1, &offscreenFramebuffer);
+        offscreenFramebuffer = 0;
+    }
+    if (offscreenDisplay != EGL_NO_DISPLAY) {
+        eglMakeCurrent(offscreenDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (offscreenContext != EGL_NO_CONTEXT) {
+            eglDestroyContext(offscreenDisplay, offscreenContext);
+        }
+        eglTerminate(offscreenDisplay);
+    }
+    offscreenDisplay = EGL_NO_DISPLAY;
+    offscreenContext = EGL_NO_CONTEXT;
+#endif
+    openGLContext = false;
+}
+
+// What: Function to render a sequence of frames offscreen
+// Input: firstFrame - the index of the first frame
+//        frames - the number of frames
+//        output - the directory the frames are written to, or nullptr to only render them
+// Output: The elapsed time in seconds, or -1 if a frame could not be written
+// Action: The function seeks the animation to firstFrame, then draws every frame with myDisplay(), saves it as
+//         output/frame_NNNNN.ppm, NNNNN being the frame index, hands it to the video export if one is open, and steps
+//         the animation.
+//         At a headlessFrameRate other than SIMULATION_RATE, frame N shows the animation N / headlessFrameRate seconds in,
+//         interpolated between the steps around that time like the window does; frames that fall on a step are
+//         identical to the frames of the 12.5 Hz timeline.
+// Caller: runHeadless(), runBenchmark() and runScalingBenchmark()
+double renderFrames(int firstFrame, int frames, const char* output) {
+    if (output) {
+#ifdef _WIN32
+        _mkdir(output);
+#else
+        mkdir(output, 0755);
+#endif
+    }
+
+    if (output) {
+        framePixels.resize((size_t)windowWidth * windowHeight * 3);
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    double frameRate = headlessFrameRate > 0 ? headlessFrameRate : SIMULATION_RATE;
+    int step = (int)(firstFrame * SIMULATION_RATE / frameRate);
+    AnimationState stepState = stateAt(step), nextState = stepAnimation(stepState);
+    for (int frame = firstFrame; frame < firstFrame + frames; frame++) {
+        // Find the steps around the frame's time. Multiplying first keeps whole steps exact
+        double position = frame * SIMULATION_RATE / frameRate;
+        {
+            PROFILE_SCOPE(ZONE_UPDATE); // The work update() does in the window
+            while (step < (int)position) {
+                stepState = nextState;
+                nextState = stepAnimation(nextState);
+                step++;
+            }
+            animation = interpolateAnimation(stepState, nextState, (float)(position - step));
+            animationTime = position;
+        }
+        myDisplay();
+        if (output) {
+            readFramePixels(framePixels.data());
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/frame_%05d.ppm", output, frame);
+            if (!writePPM(path, windowWidth, windowHeight, framePixels.data())) {
+                cerr << "Could not write " << path << "." << endl;
+                return -1;
+            }
+        }
+        if (videoExportOpen) {
+            if (!queueVideoFrame()) {
+                return -1;
+            }
+        }
+        else if (!output && openGLContext) {
+            glFinish(); // Wait for the frame so the timing is not just the time to queue it
+        }
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// What: Function to read back the finished frame
+// Input: pixels - room for windowWidth * windowHeight RGB pixels, or for the region set by setRenderRegion()
+// Output: None
+// Action: The function reads the OpenGL framebuffer, or converts the CPU framebuffer, into RGB bytes, bottom row first.
+// Caller: renderFrames()
+void readFramePixels(unsigned char* pixels) {
+    if (renderBackend == BACKEND_OPENGL) {
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, regionWidth > 0 ? regionWidth : windowWidth, regionHeight > 0 ? regionHeight : windowHeight, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+        return;
+    }
+    const unsigned char* rgba = (const unsigned char*)cpuFramebuffer.data();
+    for (size_t i = 0; i < cpuFramebuffer.size(); i++) {
+        pixels[3 * i] = rgba[4 * i];
+        pixels[3 * i + 1] = rgba[4 * i + 1];
+        pixels[3 * i + 2] = rgba[4 * i + 2];
+    }
+}
+
+// What: Function to save an image as a binary PPM (P6) file
+// Input: path - the file name
+//        width, height - the size of the image
+//        pixels - RGB bytes, bottom row first as returned by glReadPixels()
+// Output: true if the file was written, false otherwise
+// Action: The function writes the PPM header and then the rows from top to bottom.
+// Caller: runHeadless()
+bool writePPM(const char* path, int width, int height, const unsigned char* pixels) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    bool ok = true;
+    for (int y = height - 1; y >= 0 && ok; y--) {
+        ok = fwrite(pixels + (size_t)y * width * 3, 1, (size_t)width * 3, file) == (size_t)width * 3;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+// Video export: the render thread only copies each finished frame into a ring of slots, a writer thread converts
+// the slots to YUV and writes them, so rendering never waits for the disk or the encoder unless the ring is full.
+const int VIDEO_RING_SLOTS = 8; // Frames the render thread may be ahead of the writer thread
+const int VIDEO_READBACKS = 3; // Pixel buffer objects the OpenGL frames are read into, the oldest one is mapped
+FILE* videoFile = nullptr; // Y4M file, or pipe to the encoder
+bool videoPiped = false; // Whether videoFile was opened with popen()
+vector<vector<unsigned char>> videoRing; // RGBA slots, bottom row first
+atomic<unsigned> videoRingHead(0), videoRingTail(0); // Slots filled by the render thread and emptied by the writer thread
+atomic<bool> videoClosing(false), videoWriteFailed(false); // Set by closeVideoExport() and by the writer thread
+thread videoWriter; // Converts and writes the slots
+GLuint videoReadbacks[VIDEO_READBACKS]; // Pixel buffer objects of the OpenGL backend
+int videoFramesRead = 0, videoFramesQueued = 0; // Readbacks started and frames handed to the ring
+double videoWaitSeconds = 0; // Time the render thread waited for a free slot
+chrono::steady_clock::time_point videoStart; // When openVideoExport() ran
+
+// What: Function to run the video writer thread
+// Input: width, height - the size of the frames
+// Output: None
+// Action: The function waits for filled slots, converts each one to a 4:2:0 frame and writes it after a "FRAME" line,
+//         until closeVideoExport() asks it to stop and the ring is empty. After a failed write, it keeps emptying the
+//         ring so the render thread never waits forever.
+// Caller: openVideoExport()
+void writeVideoFrames(int width, int height) {
+    vector<unsigned char> planes((size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2));
+    for (;;) {
+        unsigned tail = videoRingTail.load(memory_order_relaxed);
+        if (tail == videoRingHead.load(memory_order_acquire)) {
+            // The last frame is queued before videoClosing is set, so check the ring again after seeing it
+            if (videoClosing.load(memory_order_acquire) && tail == videoRingHead.load(memory_order_acquire)) {
+                return;
+            }
+            this_thread::sleep_for(chrono::microseconds(200));
+            continue;
+        }
+        if (!videoWriteFailed.load(memory_order_relaxed)) {
+            convertToYUV420(videoRing[tail % VIDEO_RING_SLOTS].data(), width, height, planes.data());
+            if (fwrite("FRAME\n", 1, 6, videoFile) != 6 || fwrite(planes.data(), 1, planes.size(), videoFile) != planes.size()) {
+                videoWriteFailed = true;
+            }
+        }
+        videoRingTail.store(tail + 1, memory_order_release);
+    }
+}
+
+// What: Function to start a video export
+//       Y4M is the raw video format read by ffmpeg, x264 and most players: a header line, then every frame as its
+//       Y, U and V planes. The frame rate is written as a fraction, 12.5 frames per second as 25:2.
+// Input: target - the Y4M file, or "|command" to start the command and write to its standard input
+//        width, height - the size of the frames
+//        frameRate - the number of frames per second
+// Output: true if the export could be started, false otherwise
+// Action: The function opens the target, writes the Y4M header, allocates the ring and, with the OpenGL backend,
+//         the pixel buffer objects, and starts the writer thread.
+// Caller: runHeadless()
+bool openVideoExport(const char* target, int width, int height, double frameRate) {
+    // 1. Open the file or start the encoder
+    videoPiped = target[0] == '|';
+    if (videoPiped) {
+#ifdef _WIN32
+        videoFile = _popen(target + 1, "wb");
+#else
+        signal(SIGPIPE, SIG_IGN); // An encoder that exits early makes fwrite() fail instead of ending the process
+        videoFile = popen(target + 1, "w");
+#endif
+    }
+    else {
+        videoFile = fopen(target, "wb");
+    }
+    if (!videoFile) {
+        cerr << "Could not open " << target << "." << endl;
+        return false;
+    }
+
+    // 2. Write the header, with the smallest denominator that makes the frame rate whole
+    int denominator = 1;
+    while (denominator < 1000 && fabs(frameRate * denominator - floor(frameRate * denominator + 0.5)) > 1e-6) {
+        denominator++;
+    }
+    fprintf(videoFile, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg\n", width, height,
+        (int)floor(frameRate * denominator + 0.5), denominator);
+
+    // 3. Allocate the ring and the readback buffers, then start the writer thread
+    videoRing.assign(VIDEO_RING_SLOTS, vector<unsigned char>((size_t)width * height * 4));
+    videoRingHead = 0;
+    videoRingTail = 0;
+    videoClosing = false;
+    videoWriteFailed = false;
+    videoFramesRead = videoFramesQueued = 0;
+    videoWaitSeconds = 0;
+#ifdef __linux__
+    if (renderBackend == BACKEND_OPENGL) {
+        glGenBuffers(VIDEO_READBACKS, videoReadbacks);
+        for (GLuint buffer : videoReadbacks) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+#endif
+    videoStart = chrono::steady_clock::now();
+    videoWriter = thread(writeVideoFrames, width, height);
+    videoExportOpen = true;
+    cout << "Streaming the frames to " << target << "." << endl;
+    return true;
+}
+
+// What: Function to copy pixels into the next free slot of the ring
+// Input: pixels - windowWidth * windowHeight RGBA pixels, bottom row first
+// Output: false if the writer thread has failed, true otherwise
+// Action: The function waits, timing the wait, while every slot is still waiting to be written, then copies the pixels
+//         and publishes the slot to the writer thread.
+// Caller: queueVideoFrame() and closeVideoExport()
+bool pushVideoFrame(const void* pixels) {
+    unsigned head = videoRingHead.load(memory_order_relaxed);
+    if (head - videoRingTail.load(memory_order_acquire) == (unsigned)VIDEO_RING_SLOTS) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        while (head - videoRingTail.load(memory_order_acquire) == (unsigned)VIDEO_RING_SLOTS) {
+            this_thread::yield();
+        }
+        videoWaitSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    vector<unsigned char>& slot = videoRing[head % VIDEO_RING_SLOTS];
+    memcpy(slot.data(), pixels, slot.size());
+    videoRingHead.store(head + 1, memory_order_release);
+    videoFramesQueued++;
+    return !videoWriteFailed.load(memory_order_relaxed);
+}
+
+#ifdef __linux__
+// What: Function to hand the oldest pending OpenGL readback to the ring
+// Input: None
+// Output: false if the buffer could not be mapped or the writer thread has failed, true otherwise
+// Action: The function maps the pixel buffer object of frame videoFramesQueued, whose transfer has had two frames
+//         to finish, and copies it into the ring. A buffer that cannot be mapped fails the export: the frame is
+//         counted as handled, so the readbacks still drain, and videoWriteFailed is set.
+// Caller: queueVideoFrame() and closeVideoExport()
+bool pushVideoReadback() {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, videoReadbacks[videoFramesQueued % VIDEO_READBACKS]);
+    const void* pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    bool ok;
+    if (pixels) {
+        ok = pushVideoFrame(pixels);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    else {
+        cerr << "Could not map the readback of frame " << videoFramesQueued << "." << endl;
+        videoFramesQueued++;
+        videoWriteFailed = true;
+        ok = false;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return ok;
+}
+#endif
+
+// What: Function to export the finished frame
+//       With OpenGL, glReadPixels() into a pixel buffer object returns at once and the copy finishes while the next
+//       frames are drawn; the buffer is only mapped two frames later. The CPU framebuffer is copied as it is: it cannot
+//       be swapped for a slot since the next frame only redraws what changed on top of it.
+// Input: None
+// Output: false if the writer thread has failed, true otherwise
+// Action: The function starts the readback of the frame and queues the oldest finished one, or copies the CPU
+//         framebuffer into the ring.
+// Caller: renderFrames()
+bool queueVideoFrame() {
+#ifdef __linux__
+    if (renderBackend == BACKEND_OPENGL) {
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, videoReadbacks[videoFramesRead % VIDEO_READBACKS]);
+        glReadPixels(0, 0, windowWidth, windowHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        videoFramesRead++;
+        return videoFramesRead - videoFramesQueued < VIDEO_READBACKS || pushVideoReadback();
+    }
+#endif
+    return pushVideoFrame(cpuFramebuffer.data());
+}
+
+// What: Function to finish a video export
+// Input: None
+// Output: true if every frame was written, false otherwise
+// Action: The function queues the readbacks still in flight, lets the writer thread empty the ring, closes the file
+//         or waits for the encoder, and reports the sustained export rate and how long rendering waited for the writer.
+// Caller: runHeadless()
+bool closeVideoExport() {
+    if (!videoExportOpen) {
+        return true;
+    }
+    videoExportOpen = false;
+#ifdef __linux__
+    if (renderBackend == BACKEND_OPENGL) {
+        while (videoFramesQueued < videoFramesRead) {
+            if (!pushVideoReadback()) {
+                break; // The export has failed, the frames still in flight are dropped with their buffers
+            }
+        }
+        glDeleteBuffers(VIDEO_READBACKS, videoReadbacks);
+    }
+#endif
+    videoClosing.store(true, memory_order_release);
+    videoWriter.join();
+    bool ok = !videoWriteFailed;
+#ifdef _WIN32
+    ok = (videoPiped ? _pclose(videoFile) : fclose(videoFile)) == 0 && ok;
+#else
+    ok = (videoPiped ? pclose(videoFile) : fclose(videoFile)) == 0 && ok;
+#endif
+    videoFile = nullptr;
+    videoRing.clear();
+    if (!ok) {
+        cerr << "Could not write the video." << endl;
+        return false;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - videoStart).count();
+    double frameBytes = (double)windowWidth * windowHeight + 2.0 * ((windowWidth + 1) / 2) * ((windowHeight + 1) / 2) + 6;
+    printf("Exported %d frames in %.3f s (%.1f frames per second, %.1f MB/s), rendering waited %.3f s for the writer.\n",
+        videoFramesQueued, seconds, videoFramesQueued / seconds, videoFramesQueued * frameBytes / seconds / 1e6, videoWaitSeconds);
+    return true;
+}
+
+#ifdef HW05_X86
+// What: Function to add the 32-bit lanes of two vectors in pairs
+// Input: a, b - four 32-bit lanes each
+// Output: a0 + a1, a2 + a3, b0 + b1, b2 + b3
+// Action: The function gathers the even and the odd lanes of both vectors and adds them.
+// Caller: convertRowPairSSE2()
+static inline __m128i addLanePairs(__m128i a, __m128i b) {
+    __m128 even = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm_add_epi32(_mm_castps_si128(even), _mm_castps_si128(odd));
+}
+
+// What: Function to convert two rows of RGBA pixels with SSE2, 16 pixels at a time
+//       Each 8-bit channel is widened to 16 bits and multiplied by its weight with _mm_madd_epi16(), which also adds
+//       red and green, and blue and alpha; addLanePairs() then completes the sums. The chroma weights are applied to
+//       the sums of 2x2 pixels, exactly like the scalar code, so both give the same bytes.
+// Input: top, bottom - the upper and lower row, the same row if there is no lower one
+//        width - the number of pixels in a row
+//        yTop, yBottom - the luma of both rows, yBottom nullptr if there is no lower row
+//        u, v - the chroma of the row pair
+// Output: The number of pixels converted, a multiple of 16
+// Action: The function writes the luma of 16 pixels of each row and the chroma of their 8 blocks per iteration.
+// Caller: convertToYUV420()
+int convertRowPairSSE2(const unsigned char* top, const unsigned char* bottom, int width,
+    unsigned char* yTop, unsigned char* yBottom, unsigned char* u, unsigned char* v) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lumaWeights = _mm_setr_epi16(77, 150, 29, 0, 77, 150, 29, 0);
+    const __m128i uWeights = _mm_setr_epi16(-43, -85, 128, 0, -43, -85, 128, 0);
+    const __m128i vWeights = _mm_setr_epi16(128, -107, -21, 0, 128, -107, -21, 0);
+    const __m128i lumaRound = _mm_set1_epi32(128), chromaRound = _mm_set1_epi32(512), chromaOffset = _mm_set1_epi32(128);
+    auto luma = [&](const unsigned char* row, unsigned char* out) {
+        __m128i sums[4];
+        for (int k = 0; k < 4; k++) {
+            __m128i pixels = _mm_loadu_si128((const __m128i*)(row + 16 * k));
+            sums[k] = addLanePairs(_mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), lumaWeights),
+                _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), lumaWeights));
+            sums[k] = _mm_srai_epi32(_mm_add_epi32(sums[k], lumaRound), 8);
+        }
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(sums[0], sums[1]), _mm_packs_epi32(sums[2], sums[3]));
+        _mm_storeu_si128((__m128i*)out, packed);
+    };
+    auto chroma = [&](const __m128i* blocks, __m128i weights, unsigned char* out) {
+        __m128i sums[2];
+        for (int k = 0; k < 2; k++) {
+            sums[k] = addLanePairs(_mm_madd_epi16(blocks[2 * k], weights), _mm_madd_epi16(blocks[2 * k + 1], weights));
+            sums[k] = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sums[k], chromaRound), 10), chromaOffset);
+        }
+        __m128i packed = _mm_packs_epi32(sums[0], sums[1]);
+        _mm_storel_epi64((__m128i*)out, _mm_packus_epi16(packed, packed));
+    };
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        luma(top + 4 * x, yTop + x);
+        if (yBottom) {
+            luma(bottom + 4 * x, yBottom + x);
+        }
+        // Sum each 2x2 block: the rows are added, then the two pixels of each half of a 128-bit lane
+        __m128i blocks[4];
+        for (int k = 0; k < 4; k++) {
+            __m128i upper = _mm_loadu_si128((const __m128i*)(top + 4 * x + 16 * k));
+            __m128i lower = _mm_loadu_si128((const __m128i*)(bottom + 4 * x + 16 * k));
+            __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(upper, zero), _mm_unpacklo_epi8(lower, zero));
+            __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(upper, zero), _mm_unpackhi_epi8(lower, zero));
+            blocks[k] = _mm_unpacklo_epi64(_mm_add_epi16(low, _mm_srli_si128(low, 8)), _mm_add_epi16(high, _mm_srli_si128(high, 8)));
+        }
+        chroma(blocks, uWeights, u + x / 2);
+        chroma(blocks, vWeights, v + x / 2);
+    }
+    return x;
+}
+#endif
+
+// What: Function to convert a frame to 4:2:0 YUV
+//       The conversion is BT.601 with the full 0-255 range (the "C420jpeg" of the Y4M header), in integers:
+//       Y = (77 R + 150 G + 29 B) / 256, and U and V from the sums of each 2x2 block of pixels, so the chroma is the
+//       average of the block. A last odd column or row is counted twice in its blocks.
+// Input: rgba - width * height RGBA pixels, bottom row first
+//        width, height - the size of the frame
+//        planes - room for the width * height luma bytes followed by both chroma planes of half the size, rounded up
+// Output: None
+// Action: The function converts the rows in pairs, 16 pixels at a time with SSE2 when the processor has it,
+//         and the rest one 2x2 block at a time.
+// Caller: writeVideoFrames()
+void convertToYUV420(const unsigned char* rgba, int width, int height, unsigned char* planes) {
+    int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+    unsigned char* yPlane = planes;
+    unsigned char* uPlane = planes + (size_t)width * height;
+    unsigned char* vPlane = uPlane + (size_t)chromaWidth * chromaHeight;
+    size_t stride = (size_t)width * 4;
+    for (int row = 0; row < height; row += 2) {
+        const unsigned char* top = rgba + (height - 1 - row) * stride;
+        const unsigned char* bottom = row + 1 < height ? top - stride : top;
+        unsigned char* yTop = yPlane + (size_t)row * width;
+        unsigned char* yBottom = row + 1 < height ? yTop + width : nullptr;
+        unsigned char* u = uPlane + (size_t)(row / 2) * chromaWidth;
+        unsigned char* v = vPlane + (size_t)(row / 2) * chromaWidth;
+        int x = 0;
+#ifdef HW05_X86
+        if (simdLevel >= SIMD_SSE2) {
+            x = convertRowPairSSE2(top, bottom, width, yTop, yBottom, u, v);
+        }
+#endif
+        for (; x < width; x += 2) {
+            int right = x + 1 < width ? x + 1 : x;
+            const unsigned char* block[4] = { top + 4 * x, top + 4 * right, bottom + 4 * x, bottom + 4 * right };
+            int r = 0, g = 0, b = 0;
+            for (int k = 0; k < 4; k++) {
+                const unsigned char* p = block[k];
+                unsigned char luma = (unsigned char)((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+                if (k == 0 || (k == 1 && right != x)) {
+                    yTop[x + k] = luma;
+                }
+                else if (yBottom && (k == 2 || (k == 3 && right != x))) {
+                    yBottom[x + k - 2] = luma;
+                }
+                r += p[0];
+                g += p[1];
+                b += p[2];
+            }
+            u[x / 2] = (unsigned char)min(255, ((-43 * r - 85 * g + 128 * b + 512) >> 10) + 128);
+            v[x / 2] = (unsigned char)min(255, ((128 * r - 107 * g - 21 * b + 512) >> 10) + 128);
+        }
+    }
+}
+
+// What: Function to save the audio that plays during the exported frames
+//       Y4M has no audio, so the track is written next to the video, cut to start with its first frame and to last
+//       exactly as long, which lets an encoder mux both by timestamp (ffmpeg -i video.y4m -i video.y4m.wav ...).
+//       Missing samples at the end are filled with silence.
+// Input: input - a PCM WAV file
+//        output - the WAV file to write
+//        start, duration - the time of the first frame and the length of the video, in seconds
+// Output: true if the track was written, false otherwise
+// Action: The function reads the "fmt " and "data" chunks of the input, and writes a WAV file with the same format
+//         and the samples from start to start + duration.
+// Caller: runHeadless()
+bool writeAudioTrack(const char* input, const char* output, double start, double duration) {
+    // 1. Read the chunks of the input
+    FILE* file = fopen(input, "rb");
+    if (!file) {
+        cerr << "Could not open " << input << "." << endl;
+        return false;
+    }
+    vector<unsigned char> format, samples;
+    char header[12];
+    bool ok = fread(header, 1, 12, file) == 12 && memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVE", 4) == 0;
+    unsigned char chunk[8];
+    while (ok && fread(chunk, 1, 8, file) == 8) {
+        uint32_t size = chunk[4] | chunk[5] << 8 | chunk[6] << 16 | (uint32_t)chunk[7] << 24;
+        vector<unsigned char>& data = memcmp(chunk, "fmt ", 4) == 0 ? format : samples;
+        if (memcmp(chunk, "fmt ", 4) == 0 || memcmp(chunk, "data", 4) == 0) {
+            data.resize(size);
+            ok = fread(data.data(), 1, size, file) == size;
+        }
+        else {
+            ok = fseek(file, size, SEEK_CUR) == 0;
+        }
+        if (ok && size % 2) {
+            fseek(file, 1, SEEK_CUR); // Chunks are padded to an even size
+        }
+    }
+    fclose(file);
+    if (!ok || format.size() < 16) {
+        cerr << input << " is not a WAV file." << endl;
+        return false;
+    }
+
+    // 2. Cut the samples: the block alignment is the size of one sample of every channel
+    uint32_t sampleRate = format[4] | format[5] << 8 | format[6] << 16 | (uint32_t)format[7] << 24;
+    uint32_t blockAlign = max(1, format[12] | format[13] << 8);
+    size_t first = (size_t)floor(start * sampleRate + 0.5) * blockAlign;
+    size_t length = (size_t)floor(duration * sampleRate + 0.5) * blockAlign;
+    vector<unsigned char> cut(length, format.size() >= 16 && (format[14] | format[15] << 8) == 8 ? 128 : 0); // 8-bit PCM is unsigned
+    if (first < samples.size()) {
+        memcpy(cut.data(), samples.data() + first, min(length, samples.size() - first));
+    }
+
+    // 3. Write the output
+    auto littleEndian = [](uint32_t value, unsigned char* bytes) {
+        for (int k = 0; k < 4; k++) {
+            bytes[k] = (unsigned char)(value >> (8 * k));
+        }
+    };
+    unsigned char sizes[3][4];
+    littleEndian((uint32_t)(4 + 8 + format.size() + 8 + cut.size()), sizes[0]);
+    littleEndian((uint32_t)format.size(), sizes[1]);
+    littleEndian((uint32_t)cut.size(), sizes[2]);
+    file = fopen(output, "wb");
+    ok = file && fwrite("RIFF", 1, 4, file) == 4 && fwrite(sizes[0], 1, 4, file) == 4 && fwrite("WAVEfmt ", 1, 8, file) == 8
+        && fwrite(sizes[1], 1, 4, file) == 4 && fwrite(format.data(), 1, format.size(), file) == format.size()
+        && fwrite("data", 1, 4, file) == 4 && fwrite(sizes[2], 1, 4, file) == 4 && fwrite(cut.data(), 1, cut.size(), file) == cut.size();
+    if (file) {
+        ok = fclose(file) == 0 && ok;
+    }
+    if (!ok) {
+        cerr << "Could not write " << output << "." << endl;
+        return false;
+    }
+    printf("Saved %.3f s of %s from %.3f s on as %s.\n", duration, input, start, output);
+    return true;
+}
+
+// Below is the poster export
+//   A poster is one frame at print resolution, far larger than a framebuffer or an OpenGL viewport can be. It is
+//   drawn in tiles: each tile narrows the clipping planes to its part of the view, while the scene keeps the size
+//   of the whole poster, so the crowd, the culling and the level of detail do not change from tile to tile. The
+//   tiles of a band are read back next to each other and the band's rows go straight into the PNG file.
+
+// Streams a PNG file row by row: the rows are Sub-filtered and deflated as they arrive, with fixed Huffman codes and
+// runs of the previous byte as the only matches. The flat colors of the scene filter to long runs of zeros.
+struct PngWriter {
+    FILE* file = nullptr;
+    vector<unsigned char> row; // The filtered row being compressed
+    vector<unsigned char> chunk; // Compressed bytes not written yet, sent as an IDAT chunk when it is full
+    uint64_t bits = 0; // Bits not yet making up a whole byte, the first one in the lowest bit
+    int bitCount = 0;
+    int previous = -1; // Last byte of the uncompressed stream, -1 before the first
+    uint32_t adler1 = 1, adler2 = 0; // Adler-32 sums of the uncompressed stream
+};
+const size_t PNG_CHUNK_SIZE = 1 << 20; // Compressed bytes per IDAT chunk
+
+// What: Function to compute the CRC-32 of PNG chunks
+// Input: crc - the CRC of the bytes before, 0 at the start
+//        data, size - the next bytes
+// Output: The CRC of all the bytes
+// Action: The function runs the table-driven CRC-32 (the polynomial of zlib and PNG) over the bytes.
+// Caller: writePngChunk(), replayRecording(), runReplay() and runReplayCheck()
+uint32_t pngCrc32(uint32_t crc, const unsigned char* data, size_t size) {
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 255] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// What: Function to write a PNG chunk
+// Input: png - the file being written
+//        type - the four letters of the chunk type
+//        data, size - the chunk's contents
+// Output: true if it was written, false otherwise
+// Action: The function writes the length, the type, the data and the CRC of the type and data.
+// Caller: openPng(), writePngRow() and closePng()
+bool writePngChunk(PngWriter& png, const char* type, const unsigned char* data, size_t size) {
+    unsigned char header[8] = { (unsigned char)(size >> 24), (unsigned char)(size >> 16), (unsigned char)(size >> 8), (unsigned char)size };
+    memcpy(header + 4, type, 4);
+    uint32_t crc = pngCrc32(pngCrc32(0, header + 4, 4), data, size);
+    unsigned char trailer[4] = { (unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc };
+    return fwrite(header, 1, 8, png.file) == 8 && (size == 0 || fwrite(data, 1, size, png.file) == size) && fwrite(trailer, 1, 4, png.file) == 4;
+}
+
+// What: Function to add bits to the deflate stream
+// Input: png - the writer
+//        value, count - the bits, the first one in the lowest bit of value
+// Output: None
+// Action: The function appends the bits and moves every completed byte to the chunk.
+// Caller: openPng(), writePngRow(), putPngSymbol() and closePng()
+void putPngBits(PngWriter& png, uint32_t value, int count) {
+    png.bits |= (uint64_t)value << png.bitCount;
+    png.bitCount += count;
+    while (png.bitCount >= 8) {
+        png.chunk.push_back((unsigned char)png.bits);
+        png.bits >>= 8;
+        png.bitCount -= 8;
+    }
+}
+
+// What: Function to add a literal or length symbol to the deflate stream
+// Input: png - the writer
+//        symbol - 0 to 255 for a byte, 256 for the end of the block, 257 to 285 for a match length
+// Output: None
+// Action: The function looks up the symbol's fixed Huffman code and appends it from its highest bit down, the
+//         order deflate stores Huffman codes in.
+// Caller: writePngRow() and closePng()
+void putPngSymbol(PngWriter& png, int symbol) {
+    uint32_t code;
+    int length;
+    if (symbol < 144) {
+        code = 0x30 + symbol, length = 8;
+    }
+    else if (symbol < 256) {
+        code = 0x190 + symbol - 144, length = 9;
+    }
+    else if (symbol < 280) {
+        code = symbol - 256, length = 7;
+    }
+    else {
+        code = 0xC0 + symbol - 280, length = 8;
+    }
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++) {
+        reversed |= (code >> i & 1) << (length - 1 - i);
+    }
+    putPngBits(png, reversed, length);
+}
+
+// What: Function to start a PNG file
+// Input: png - the writer
+//        path - the file name
+//        width, height - the size of the RGB image
+// Output: true if the file was created, false otherwise
+// Action: The function writes the signature and the IHDR chunk, then starts the zlib stream with its only deflate
+//         block, a final one with fixed codes.
+// Caller: runPoster()
+bool openPng(PngWriter& png, const char* path, int width, int height) {
+    png.file = fopen(path, "wb");
+    if (!png.file) {
+        return false;
+    }
+    const unsigned char signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    const unsigned char header[13] = { (unsigned char)(width >> 24), (unsigned char)(width >> 16), (unsigned char)(width >> 8), (unsigned char)width,
+        (unsigned char)(height >> 24), (unsigned char)(height >> 16), (unsigned char)(height >> 8), (unsigned char)height,
+        8, 2, 0, 0, 0 }; // 8 bits per sample, RGB, deflate, adaptive filters, not interlaced
+    png.row.resize(1 + (size_t)width * 3);
+    png.chunk.clear();
+    png.chunk.reserve(PNG_CHUNK_SIZE + 1024);
+    png.chunk.push_back(0x78); // zlib header: deflate with a 32 KB window, no dictionary
+    png.chunk.push_back(0x01);
+    putPngBits(png, 1, 1); // Final block
+    putPngBits(png, 1, 2); // Fixed Huffman codes
+    return fwrite(signature, 1, 8, png.file) == 8 && writePngChunk(png, "IHDR", header, 13);
+}
+
+// What: Function to add a row to a PNG file
+// Input: png - the writer
+//        rgb - the row's pixels, from left to right
+// Output: true if the compressed data could be written, false otherwise
+// Action: The function Sub-filters the row, then deflates it: a byte equal to the one before it starts a run that
+//         is coded as matches at distance 1, up to 258 bytes each, and every other byte is a literal. Full chunks of
+//         compressed data are written out.
+// Caller: runPoster()
+bool writePngRow(PngWriter& png, const unsigned char* rgb) {
+    static const int LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const int LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    unsigned char* row = png.row.data();
+    size_t size = png.row.size();
+    row[0] = 1; // Sub: every byte minus the same channel of the pixel to its left
+    for (size_t i = 1; i < size; i++) {
+        row[i] = (unsigned char)(rgb[i - 1] - (i > 3 ? rgb[i - 4] : 0));
+    }
+    for (size_t i = 0; i < size; i++) {
+        png.adler1 = (png.adler1 + row[i]) % 65521;
+        png.adler2 = (png.adler2 + png.adler1) % 65521;
+    }
+
+    for (size_t i = 0; i < size;) {
+        size_t run = 0;
+        while (i + run < size && row[i + run] == png.previous && run < 258) {
+            run++;
+        }
+        if (run < 3) {
+            putPngSymbol(png, row[i]);
+            png.previous = row[i];
+            i++;
+            continue;
+        }
+        int code = 28;
+        while (LENGTH_BASE[code] > (int)run) {
+            code--;
+        }
+        putPngSymbol(png, 257 + code);
+        putPngBits(png, (uint32_t)run - LENGTH_BASE[code], LENGTH_EXTRA[code]);
+        putPngBits(png, 0, 5); // Distance code 0: one byte back
+        i += run;
+    }
+
+    if (png.chunk.size() >= PNG_CHUNK_SIZE) {
+        if (!writePngChunk(png, "IDAT", png.chunk.data(), png.chunk.size())) {
+            return false;
+        }
+        png.chunk.clear();
+    }
+    return true;
+}
+
+// What: Function to finish a PNG file
+// Input: png - the writer
+// Output: true if the whole file was written, false otherwise
+// Action: The function ends the deflate block, adds the Adler-32 of the rows, writes the last IDAT chunk and the
+//         IEND chunk, and closes the file.
+// Caller: runPoster()
+bool closePng(PngWriter& png) {
+    putPngSymbol(png, 256); // End of the block
+    putPngBits(png, 0, (8 - png.bitCount) % 8);
+    uint32_t adler = png.adler2 << 16 | png.adler1;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        png.chunk.push_back((unsigned char)(adler >> shift));
+    }
+    bool ok = writePngChunk(png, "IDAT", png.chunk.data(), png.chunk.size()) && writePngChunk(png, "IEND", nullptr, 0);
+    ok = fclose(png.file) == 0 && ok;
+    png.file = nullptr;
+    return ok;
+}
+
+// What: Function to make the framebuffer hold a part of the window
+// Input: x, y - the window pixel at the bottom left of the part
+//        width, height - the size of the part, or 0 for the whole window
+// Output: None
+// Action: The function sets the region the backends draw. With OpenGL it also sets the viewport to the region's
+//         size and narrows the clipping planes of the projection to the region's part of the view.
+// Caller: renderPosterBands()
+void setRenderRegion(int x, int y, int width, int height) {
+    regionX = x;
+    regionY = y;
+    regionWidth = width;
+    regionHeight = height;
+    if (!openGLContext) {
+        return;
+    }
+    if (width == 0) {
+        myReshape(windowWidth, windowHeight);
+        return;
+    }
+    double unitsX = (clippingPlanRight - clippingPlanLeft) / windowWidth;
+    double unitsY = (clippingPlanTop - clippingPlanBottom) / windowHeight;
+    glViewport(0, 0, width, height);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(clippingPlanLeft + x * unitsX, clippingPlanLeft + (x + width) * unitsX,
+        clippingPlanBottom + y * unitsY, clippingPlanBottom + (y + height) * unitsY);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+}
+
+// What: Function to render a frame tile by tile, one band of tiles at a time
+// Input: frame - the index of the frame, as for renderFrames()
+//        tileWidth, tileHeight - the largest tile; the framebuffer must have room for one with its margins
+//        png - the file the rows are streamed to, top row first, or nullptr
+//        image - room for the whole frame, bottom row first like readFramePixels(), or nullptr
+// Output: true on success, false if a row could not be written
+// Action: From the top band down, the function renders every tile of the band with renderFrames(), with a margin of
+//         POSTER_TILE_MARGIN pixels around it inside the window, copies the tile without its margin into the band and
+//         then hands the band's rows to png or copies them into image. The whole window is the framebuffer's region
+//         again at the end.
+// Caller: runPoster() and runPosterCheck()
+bool renderPosterBands(int frame, int tileWidth, int tileHeight, PngWriter* png, unsigned char* image) {
+    const int margin = POSTER_TILE_MARGIN;
+    size_t rowBytes = (size_t)windowWidth * 3;
+    vector<unsigned char> band(rowBytes * min(tileHeight, windowHeight));
+    vector<unsigned char> tile((size_t)(tileWidth + 2 * margin) * (tileHeight + 2 * margin) * 3);
+    for (int top = windowHeight; top > 0; top -= tileHeight) {
+        int bottom = max(0, top - tileHeight), rows = top - bottom;
+        for (int left = 0; left < windowWidth; left += tileWidth) {
+            int columns = min(tileWidth, windowWidth - left);
+            // The margin stops at the edges of the window, where the whole frame clips too
+            int x0 = max(0, left - margin), y0 = max(0, bottom - margin);
+            int x1 = min(windowWidth, left + columns + margin), y1 = min(windowHeight, top + margin);
+            setRenderRegion(x0, y0, x1 - x0, y1 - y0);
+            if (renderFrames(frame, 1, nullptr) < 0) {
+                setRenderRegion(0, 0, 0, 0);
+                return false;
+            }
+            readFramePixels(tile.data());
+            for (int row = 0; row < rows; row++) {
+                memcpy(&band[row * rowBytes + (size_t)left * 3], &tile[((size_t)(bottom - y0 + row) * (x1 - x0) + left - x0) * 3], (size_t)columns * 3);
+            }
+        }
+        if (image) {
+            memcpy(image + bottom * rowBytes, band.data(), rows * rowBytes);
+        }
+        for (int row = rows - 1; png && row >= 0; row--) {
+            if (!writePngRow(*png, &band[row * rowBytes])) {
+                setRenderRegion(0, 0, 0, 0);
+                return false;
+            }
+        }
+    }
+    setRenderRegion(0, 0, 0, 0);
+    return true;
+}
+
+// What: Function to render a poster
+// Input: None (uses posterOutput, windowWidth and windowHeight as the poster's size, headlessStart as the frame,
+//        and renderBackend)
+// Output: 0 on success, 1 on failure
+// Action: The function renders the frame in tiles of at most POSTER_TILE_WIDTH x POSTER_TILE_HEIGHT pixels, streams
+//         it into posterOutput as a PNG and reports the time taken and the file size. Only one band of the poster
+//         is held in memory at a time.
+// Caller: main()
+int runPoster() {
+    int tileWidth = min(POSTER_TILE_WIDTH, windowWidth), tileHeight = min(POSTER_TILE_HEIGHT, windowHeight);
+    headlessMode = true;
+    if (renderBackend == BACKEND_OPENGL && !openOffscreenContext(tileWidth + 2 * POSTER_TILE_MARGIN, tileHeight + 2 * POSTER_TILE_MARGIN)) {
+        return 1;
+    }
+    Init();
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    PngWriter png;
+    if (!openPng(png, posterOutput, windowWidth, windowHeight)) {
+        cerr << "Could not write " << posterOutput << "." << endl;
+        closeOffscreenContext();
+        return 1;
+    }
+    bool ok = renderPosterBands(headlessStart, tileWidth, tileHeight, &png, nullptr);
+    ok = closePng(png) && ok;
+    closeOffscreenContext();
+    if (!ok) {
+        cerr << "Could not write " << posterOutput << "." << endl;
+        return 1;
+    }
+    struct stat status;
+    stat(posterOutput, &status);
+    int tiles = ((windowWidth + tileWidth - 1) / tileWidth) * ((windowHeight + tileHeight - 1) / tileHeight);
+    printf("Rendered frame %d as a %dx%d poster in %d tiles of up to %dx%d in %.2f s, %s is %.1f MB.\n", headlessStart,
+        windowWidth, windowHeight, tiles, tileWidth, tileHeight, chrono::duration<double>(chrono::steady_clock::now() - start).count(),
+        posterOutput, status.st_size / 1e6);
+    return 0;
+}
+
+// What: Function to check that tiled frames are the same as whole ones
+//       Tiles of an odd size, which do not line up with the CPU rasterizer's own tiles, put many seams through the
+//       character, its outlines, the crowd and the labels.
+// Input: None
+// Output: 0 if the tiled frames match, 1 otherwise
+// Action: For each backend, at 1000x700, the function renders the grown character and a labelled crowd of 300
+//         whole and in 97x61 tiles and prints the number of pixels that differ, and how many of them are on the
+//         edge of a tile. With the CPU backend no pixel may differ. With OpenGL none on an edge and at most one in
+//         10,000 elsewhere may differ: the narrowed projection can round a vertex differently. With analyticShapes it
+//         also rounds the blended edges differently, so OpenGL pixels only count as different by more than 1.
+// Caller: main()
+int runPosterCheck() {
+    const RenderBackend backends[] = { BACKEND_OPENGL, BACKEND_CPU };
+    const int width = 1000, height = 700, tileWidth = 97, tileHeight = 61;
+    const int frame = 150; // The character has finished growing
+    bool ok = true;
+
+    headlessMode = true;
+    windowWidth = width;
+    windowHeight = height;
+    vector<unsigned char> whole((size_t)width * height * 3), tiled(whole.size());
+    printf("Frames rendered whole and in %dx%d tiles at %dx%d:\n", tileWidth, tileHeight, width, height);
+    for (RenderBackend backend : backends) {
+        renderBackend = backend;
+        if (backend == BACKEND_OPENGL && !openOffscreenContext(width + 2 * POSTER_TILE_MARGIN, height + 2 * POSTER_TILE_MARGIN)) {
+            printf("  OpenGL skipped, no OpenGL context\n");
+            continue;
+        }
+        Init();
+        myReshape(width, height);
+        for (int crowd : { 0, 300 }) {
+            crowdSize = crowd;
+            crowdLabels = crowd > 0;
+            if (!renderPosterBands(frame, tileWidth, tileHeight, nullptr, tiled.data()) || renderFrames(frame, 1, nullptr) < 0) {
+                ok = false;
+                continue;
+            }
+            readFramePixels(whole.data());
+            // Pixels on the first or last row or column of a tile are on a seam
+            size_t different = 0, seams = 0;
+            int tolerance = backend == BACKEND_OPENGL && analyticShapes ? 1 : 0;
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    size_t i = ((size_t)y * width + x) * 3;
+                    if (abs(whole[i] - tiled[i]) > tolerance || abs(whole[i + 1] - tiled[i + 1]) > tolerance || abs(whole[i + 2] - tiled[i + 2]) > tolerance) {
+                        int tileX = x % tileWidth, tileY = (height - 1 - y) % tileHeight;
+                        different++;
+                        seams += tileX == 0 || tileX == tileWidth - 1 || tileY == 0 || tileY == tileHeight - 1;
+                    }
+                }
+            }
+            printf("  %-6s %-26s %zu pixels differ, %zu of them on seams\n", backend == BACKEND_OPENGL ? "OpenGL" : "CPU",
+                crowd ? "labelled crowd of 300" : "single character", different, seams);
+            // The CPU rasterizer gives the same pixels; OpenGL may round a vertex differently under the tile's
+            // projection, but only rarely and never more often along the seams
+            ok = ok && seams == 0 && (backend == BACKEND_OPENGL ? different * 10000 <= whole.size() / 3 : different == 0);
+        }
+        closeOffscreenContext();
+    }
+    crowdSize = 0;
+    crowdLabels = false;
+    printf(ok ? "Tiled frames match whole frames.\n" : "Tiled frames differ from whole frames.\n");
+    return ok ? 0 : 1;
+}
+
+// Below is the input recording and replay
+//   The window's animation depends on when the user starts and stops it, clicks and picks from the menu, so no two
+//   sessions draw the same frames. "--record" writes every event to a file together with the simulation step it
+//   happened at, and "--replay" plays the file back headless, one frame per step and as fast as it can. Frame k of a
+//   replay is the state after k steps, the state stateAt(k) of the 12.5 Hz timeline, with the events of steps 0 to k
+//   applied in their order; a paused stretch of the session takes no steps and so no frames.
+
+// What: Function to start recording the window's events
+// Input: path - the file to write
+// Output: true if the file was created, false otherwise
+// Action: The function creates the file, writes the header with the settings that change the frames, and arranges
+//         for the end of the recording to be written when the program exits.
+// Caller: main()
+bool openInputRecording(const char* path) {
+    recordFile = fopen(path, "wb");
+    if (!recordFile || !writeRecordingHeader(recordFile)) {
+        cerr << "Could not write " << path << "." << endl;
+        if (recordFile) {
+            fclose(recordFile);
+            recordFile = nullptr;
+        }
+        return false;
+    }
+    fflush(recordFile);
+    atexit(closeInputRecording); // GLUT calls exit() when the window is closed
+    cout << "Recording the input events to " << path << "." << endl;
+    return true;
+}
+
+// What: Function to record an event of the window
+//       Each event is written and flushed as it happens, so a session that crashes still leaves a recording that
+//       replays up to its last event.
+// Input: type - the kind of event
+//        code, state, x, y - its values, see InputEventType
+// Output: None
+// Action: If a recording is open, the function appends the event, stamped with simulationSteps. If it cannot, or
+//         the session is past RECORDING_MAX_TICK, it reports the error and stops recording.
+// Caller: keyboard(), mouse(), menu(), myReshape() and closeInputRecording()
+void recordInputEvent(int type, int code, int state, int x, int y) {
+    if (!recordFile) {
+        return;
+    }
+    InputEvent event = { (uint32_t)min(simulationSteps, (long long)RECORDING_MAX_TICK), (InputEventType)type, code, state, x, y };
+    if (simulationSteps > RECORDING_MAX_TICK) {
+        cerr << "The session is longer than a recording can be, recording stopped." << endl;
+        fclose(recordFile);
+        recordFile = nullptr;
+    }
+    else if (!writeInputEvent(recordFile, event) || fflush(recordFile) != 0) {
+        cerr << "Could not write the input recording, recording stopped." << endl;
+        fclose(recordFile);
+        recordFile = nullptr;
+    }
+}
+
+// What: Function to finish the recording
+// Input: None
+// Output: None
+// Action: The function appends an EVENT_END at the current simulation step, so the replay also draws the steps
+//         after the last event, and closes the file.
+// Caller: atexit()
+void closeInputRecording() {
+    recordInputEvent(EVENT_END, 0, 0, 0, 0);
+    if (recordFile) {
+        fclose(recordFile);
+        recordFile = nullptr;
+    }
+}
+
+// What: Function to write the header of a recording
+//       The header keeps the options that decide what every frame draws, so the replay runs the same workload
+//       whatever options it is given. The scene file is not kept: replay with the same "--scene".
+// Input: file - the recording
+// Output: true if the header was written
+// Action: The function writes RECORDING_MAGIC, crowdSize, a flag word (1: analyticShapes, 2: crowdLabels) and the
+//         bits of lodPixelError, as little-endian 32-bit words.
+// Caller: openInputRecording() and runReplayCheck()
+bool writeRecordingHeader(FILE* file) {
+    unsigned char header[RECORDING_HEADER_SIZE];
+    uint32_t error;
+    memcpy(&error, &lodPixelError, 4);
+    uint32_t words[3] = { (uint32_t)crowdSize, (analyticShapes ? 1u : 0u) | (crowdLabels ? 2u : 0u), error };
+    memcpy(header, RECORDING_MAGIC, 8);
+    for (int i = 0; i < 12; i++) {
+        header[8 + i] = (unsigned char)(words[i / 4] >> (8 * (i % 4)));
+    }
+    return fwrite(header, 1, RECORDING_HEADER_SIZE, file) == RECORDING_HEADER_SIZE;
+}
+
+// What: Function to write an event to a recording
+// Input: file - the recording
+//        event - the event
+// Output: true if the event was written
+// Action: The function writes the event as RECORDING_EVENT_SIZE bytes: the step as a little-endian 32-bit word, the
+//         type, the code and the state as one byte each, a zero byte, and x and y as little-endian 32-bit words.
+// Caller: recordInputEvent() and runReplayCheck()
+bool writeInputEvent(FILE* file, const InputEvent& event) {
+    unsigned char bytes[RECORDING_EVENT_SIZE] = {};
+    uint32_t words[3] = { event.tick, (uint32_t)event.x, (uint32_t)event.y };
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = (unsigned char)(words[0] >> (8 * i));
+        bytes[8 + i] = (unsigned char)(words[1] >> (8 * i));
+        bytes[12 + i] = (unsigned char)(words[2] >> (8 * i));
+    }
+    bytes[4] = (unsigned char)event.type;
+    bytes[5] = (unsigned char)event.code;
+    bytes[6] = (unsigned char)event.state;
+    return fwrite(bytes, 1, RECORDING_EVENT_SIZE, file) == RECORDING_EVENT_SIZE;
+}
+
+// What: Function to read a recording
+// Input: file - the recording, at its start
+//        name - its name, for the error messages
+//        events - receives the events
+// Output: true if the file is a valid recording, false otherwise
+// Action: The function checks the header and sets crowdSize, analyticShapes, crowdLabels and lodPixelError to the
+//         recorded values, then reads the events, which must have known types, steps that never go back and stay
+//         within RECORDING_MAX_TICK, and window sizes from 1 to POSTER_MAX_SIZE pixels. A recording cut short by a
+//         crash ends after its last whole event.
+// Caller: runReplay() and runReplayCheck()
+bool readRecording(FILE* file, const char* name, vector<InputEvent>& events) {
+    auto word = [](const unsigned char* bytes) {
+        return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+    };
+    unsigned char header[RECORDING_HEADER_SIZE];
+    if (fread(header, 1, RECORDING_HEADER_SIZE, file) != RECORDING_HEADER_SIZE || memcmp(header, RECORDING_MAGIC, 8) != 0) {
+        cerr << name << " is not an input recording." << endl;
+        return false;
+    }
+    uint32_t flags = word(header + 12), error = word(header + 16);
+    if (word(header + 8) > (uint32_t)MAX_CROWD) {
+        cerr << name << " records a crowd larger than " << MAX_CROWD << " characters." << endl;
+        return false;
+    }
+    crowdSize = (int)word(header + 8);
+    analyticShapes = (flags & 1) != 0;
+    crowdLabels = (flags & 2) != 0;
+    memcpy(&lodPixelError, &error, 4);
+
+    events.clear();
+    unsigned char bytes[RECORDING_EVENT_SIZE];
+    while (fread(bytes, 1, RECORDING_EVENT_SIZE, file) == RECORDING_EVENT_SIZE) {
+        InputEvent event = { word(bytes), (InputEventType)bytes[4], bytes[5], bytes[6], (int)word(bytes + 8), (int)word(bytes + 12) };
+        bool valid = event.type <= EVENT_END && event.tick <= RECORDING_MAX_TICK && (events.empty() || event.tick >= events.back().tick)
+            && (event.type != EVENT_RESHAPE || (event.x >= 1 && event.y >= 1 && event.x <= POSTER_MAX_SIZE && event.y <= POSTER_MAX_SIZE));
+        if (!valid) {
+            cerr << name << " has an invalid event at byte " << RECORDING_HEADER_SIZE + events.size() * RECORDING_EVENT_SIZE << "." << endl;
+            return false;
+        }
+        events.push_back(event);
+        if (event.type == EVENT_END) {
+            break;
+        }
+    }
+    return true;
+}
+
+// What: Function to apply a recorded event
+//       The events go through the window's own callbacks. Only 'p' is left out: the profiling HUD shows measured
+//       times, which would make every replay draw different frames.
+// Input: event - the event
+// Output: None
+// Action: The function calls myReshape(), keyboard(), mouse() or menu() with the recorded values.
+// Caller: replayRecording()
+void applyInputEvent(const InputEvent& event) {
+    switch (event.type) {
+    case EVENT_RESHAPE:
+        myReshape(event.x, event.y);
+        break;
+    case EVENT_KEYBOARD:
+        if (event.code != 'p') {
+            keyboard((unsigned char)event.code, event.x, event.y);
+        }
+        break;
+    case EVENT_MOUSE:
+        mouse(event.code, event.state, event.x, event.y);
+        break;
+    case EVENT_MENU:
+        menu(event.code);
+        break;
+    case EVENT_END:
+        break;
+    }
+}
+
+// What: Function to play a recording back
+//       Every replay starts from the state the window starts in and leaves the program as it found it, so replaying
+//       the same events twice draws the same frames.
+// Input: events - the recorded events
+//        hashes - receives the CRC-32 of the RGB pixels of every frame, one per step
+// Output: The elapsed time in seconds
+// Action: The function first draws the initial frame, which the clicks of step 0 pick, without hashing it. Then for
+//         every step from 0 to that of the last event, it sets the animation to the state after that many steps,
+//         applies the events of the step in their order, draws the frame with myDisplay(), reads it back and hashes it.
+//         A click picks the frame drawn for the step before, the one on screen when it happened.
+// Caller: runReplay() and runReplayCheck()
+double replayRecording(const vector<InputEvent>& events, vector<uint32_t>& hashes) {
+    // Keep what the events change, and start with the window's balloon colors, selection and crowd
+    float colors[6];
+    copy(balloonColor, balloonColor + 6, colors);
+    bool running = animationRunning, figureName = displayFigureName;
+    int selected = selectedCharacter;
+    selectedCharacter = -1;
+    if (crowdSize > 0) {
+        buildCrowd(crowdSize);
+    }
+
+    uint32_t lastTick = events.empty() ? 0 : events.back().tick;
+    hashes.clear();
+    hashes.reserve((size_t)lastTick + 1);
+    size_t next = 0;
+    AnimationState state = initialAnimation;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    animation = state;
+    animationTime = 0;
+    myDisplay();
+    for (uint64_t tick = 0; tick <= lastTick; tick++) {
+        state = tick == 0 ? initialAnimation : stepAnimation(state);
+        animation = state;
+        animationTime = (double)tick;
+        while (next < events.size() && events[next].tick == tick) {
+            applyInputEvent(events[next++]);
+        }
+        myDisplay();
+        framePixels.resize((size_t)windowWidth * windowHeight * 3);
+        readFramePixels(framePixels.data());
+        hashes.push_back(pngCrc32(0, framePixels.data(), framePixels.size()));
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    copy(colors, colors + 6, balloonColor);
+    animationRunning = running;
+    displayFigureName = figureName;
+    selectedCharacter = selected;
+    return seconds;
+}
+
+// What: Function to replay a recording headless
+// Input: None (uses replayInput, replayHashOutput and renderBackend)
+// Output: 0 on success, 1 on failure
+// Action: The function reads the recording, opens an OpenGL context as large as the largest window of the session
+//         unless the CPU backend is used, replays the events, prints the frames per second and a CRC-32 of all the
+//         frame hashes, and writes the step and hash of every frame to replayHashOutput if it is set.
+// Caller: main()
+int runReplay() {
+    FILE* file = fopen(replayInput, "rb");
+    if (!file) {
+        cerr << "Could not open " << replayInput << "." << endl;
+        return 1;
+    }
+    vector<InputEvent> events;
+    bool ok = readRecording(file, replayInput, events);
+    fclose(file);
+    if (!ok) {
+        return 1;
+    }
+
+    headlessMode = true;
+    int width = windowWidth, height = windowHeight;
+    for (const InputEvent& event : events) {
+        if (event.type == EVENT_RESHAPE) {
+            width = max(width, event.x);
+            height = max(height, event.y);
+        }
+    }
+    if (renderBackend == BACKEND_OPENGL && !openOffscreenContext(width, height)) {
+        return 1;
+    }
+    Init();
+    myReshape(windowWidth, windowHeight);
+
+    vector<uint32_t> hashes;
+    double seconds = replayRecording(events, hashes);
+    closeOffscreenContext();
+    printf("Replayed %zu events over %zu frames in %.3f s (%.1f frames per second), frame hash digest %08x.\n", events.size(),
+        hashes.size(), seconds, hashes.size() / seconds, pngCrc32(0, (const unsigned char*)hashes.data(), hashes.size() * sizeof(uint32_t)));
+
+    if (replayHashOutput) {
+        file = fopen(replayHashOutput, "w");
+        ok = file != nullptr;
+        for (size_t tick = 0; ok && tick < hashes.size(); tick++) {
+            ok = fprintf(file, "%zu %08x\n", tick, hashes[tick]) > 0;
+        }
+        if (file) {
+            ok = fclose(file) == 0 && ok;
+        }
+        if (!ok) {
+            cerr << "Could not write " << replayHashOutput << "." << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// What: Function to check that replays are deterministic
+//       A scripted session goes through the file format and is replayed twice with each backend. It clicks a balloon,
+//       starts the animation with 's', picks green balloons from the menu, shows the profiling HUD, enlarges the
+//       window and stops the animation with a click on the background. A quiet session, the same window without any
+//       input, is replayed too: it must draw exactly the frames runHeadless() draws for the same steps, and the
+//       scripted session must draw the same frames as the quiet one until its first click.
+// Input: None
+// Output: 0 if every check passes, 1 otherwise
+// Action: The function writes and reads back both sessions, replays them with each backend and prints the result
+//         of every comparison.
+// Caller: main()
+int runReplayCheck() {
+    const int width = 800, height = 600, largeWidth = 1024, largeHeight = 768;
+    const uint32_t clickTick = 20, lastTick = 100;
+    bool ok = true;
+
+    headlessMode = true;
+    crowdSize = 0;
+    crowdLabels = false;
+    windowWidth = width;
+    windowHeight = height;
+
+    // Click the middle of the right balloon as it is on screen at the click: in the frame of the step before
+    renderBackend = BACKEND_CPU;
+    myReshape(width, height);
+    animation = stateAt(clickTick - 1);
+    animationTime = clickTick - 1;
+    myDisplay();
+    buildPickIndex();
+    int balloonX = 0, balloonY = 0;
+    for (const PickShape& shape : pickShapes) {
+        if (shape.part == PICK_RIGHT_BALLOON) {
+            balloonX = (int)(((shape.x0 + shape.x1) / 2 - clippingPlanLeft) / (clippingPlanRight - clippingPlanLeft) * width);
+            balloonY = (int)((clippingPlanTop - (shape.y0 + shape.y1) / 2) / (clippingPlanTop - clippingPlanBottom) * height);
+        }
+    }
+    const vector<InputEvent> session = {
+        { 0, EVENT_RESHAPE, 0, 0, width, height },
+        { clickTick, EVENT_MOUSE, GLUT_LEFT_BUTTON, GLUT_DOWN, balloonX, balloonY },
+        { clickTick, EVENT_MOUSE, GLUT_LEFT_BUTTON, GLUT_UP, balloonX, balloonY },
+        { 30, EVENT_KEYBOARD, 's', 0, 400, 300 },
+        { 40, EVENT_MENU, 2, 0, 0, 0 },
+        { 50, EVENT_KEYBOARD, 'p', 0, 400, 300 },
+        { 60, EVENT_RESHAPE, 0, 0, largeWidth, largeHeight },
+        { 80, EVENT_MOUSE, GLUT_LEFT_BUTTON, GLUT_DOWN, 5, 5 },
+        { lastTick, EVENT_END, 0, 0, 0, 0 },
+    };
+    const vector<InputEvent> quiet = { { 0, EVENT_RESHAPE, 0, 0, width, height }, { lastTick, EVENT_END, 0, 0, 0, 0 } };
+
+    // Both sessions go through the file format
+    vector<InputEvent> recorded[2];
+    const vector<InputEvent>* scripts[2] = { &session, &quiet };
+    for (int s = 0; s < 2; s++) {
+        FILE* file = tmpfile();
+        bool written = file && writeRecordingHeader(file);
+        for (const InputEvent& event : *scripts[s]) {
+            written = written && writeInputEvent(file, event);
+        }
+        written = written && fseek(file, 0, SEEK_SET) == 0 && readRecording(file, "The recording", recorded[s]);
+        if (file) {
+            fclose(file);
+        }
+        bool same = written && recorded[s].size() == scripts[s]->size();
+        for (size_t i = 0; same && i < recorded[s].size(); i++) {
+            const InputEvent& a = recorded[s][i];
+            const InputEvent& b = (*scripts[s])[i];
+            same = a.tick == b.tick && a.type == b.type && a.code == b.code && a.state == b.state && a.x == b.x && a.y == b.y;
+        }
+        if (!same) {
+            printf("  The %s session does not read back as it was written  FAILED\n", s == 0 ? "scripted" : "quiet");
+            ok = false;
+        }
+    }
+
+    printf("Replays of a scripted session of %zu events and a quiet session over %u steps:\n", session.size(), lastTick);
+    const RenderBackend backends[] = { BACKEND_OPENGL, BACKEND_CPU };
+    for (RenderBackend backend : backends) {
+        renderBackend = backend;
+        const char* name = backend == BACKEND_OPENGL ? "OpenGL" : "CPU";
+        if (backend == BACKEND_OPENGL && !openOffscreenContext(largeWidth, largeHeight)) {
+            printf("  OpenGL skipped, no OpenGL context\n");
+            continue;
+        }
+        windowWidth = width;
+        windowHeight = height;
+        Init();
+        myReshape(width, height);
+
+        vector<uint32_t> first, second, silent, headless;
+        double seconds = replayRecording(recorded[0], first);
+        replayRecording(recorded[0], second);
+        replayRecording(recorded[1], silent);
+        myReshape(width, height);
+        for (uint32_t tick = 0; tick <= lastTick; tick++) {
+            renderFrames(tick, 1, nullptr);
+            framePixels.resize((size_t)width * height * 3);
+            readFramePixels(framePixels.data());
+            headless.push_back(pngCrc32(0, framePixels.data(), framePixels.size()));
+        }
+        closeOffscreenContext();
+
+        uint32_t diverges = 0;
+        while (diverges < first.size() && diverges < silent.size() && first[diverges] == silent[diverges]) {
+            diverges++;
+        }
+        bool repeatable = first == second, matches = silent == headless, clicked = diverges == clickTick;
+        ok = ok && repeatable && matches && clicked;
+        printf("  %-6s %zu frames in %.3f s, the second replay %s, the quiet one %s the headless frames,"
+            " the session first differs at step %u  %s\n", name, first.size(), seconds, repeatable ? "is identical" : "DIFFERS",
+            matches ? "matches" : "DIFFERS from", diverges, repeatable && matches && clicked ? "ok" : "FAILED");
+    }
+    printf(ok ? "Replays are deterministic.\n" : "Replays are not deterministic.\n");
+    return ok ? 0 : 1;
+}
+
+
+// What: Function to check the adaptive tessellation against the fixed one
+//       Every curve of the scene is drawn twice, once with adaptive tessellation and once with the fixed 300 segments
+//       per ellipse and one segment per degree of arc. Both frames contain the same primitives in the same order,
+//       so each adaptive primitive is compared, in pixels, with its reference:
+//         - deviation: the largest distance from a reference vertex to the adaptive outline,
+//         - coverage: the area the adaptive fill loses or gains, divided by the reference perimeter, i.e. the
+//           average width of the strip of pixels whose coverage differs.
+// Input: None (uses lodPixelError as the bound, 0.25 pixels if it is 0)
+// Output: 0 if both measures stay within the bound everywhere, 1 otherwise
+// Action: The function checks 800x600, 1920x1080 and 3840x2160 at the smallest, a middle and the largest character
+//         scale, printing the vertex counts and the largest deviation and coverage difference of each case.
+// Caller: main()
+int runLodCheck() {
+    const int sizes[][2] = { { 800, 600 }, { 1920, 1080 }, { 3840, 2160 } };
+    const int frames[] = { 0, 65, 130 }; // Character scale 0.5, 1.15 and 1.8
+    float bound = lodPixelError > 0 ? lodPixelError : 0.25f;
+    bool ok = true;
+
+    headlessMode = true;
+    analyticShapes = false; // Only tessellated curves have vertices to compare
+    printf("Adaptive tessellation against the fixed one, bound %.3f pixels:\n", bound);
+    for (const int* size : sizes) {
+        windowWidth = size[0];
+        windowHeight = size[1];
+        double pixelsX = windowWidth / (clippingPlanRight - clippingPlanLeft);
+        double pixelsY = windowHeight / (clippingPlanTop - clippingPlanBottom);
+        for (int frame : frames) {
+            // Draw the frame with adaptive (pass 0) and fixed (pass 1) tessellation
+            vector<BatchVertex> triangles[2], lines[2];
+            vector<MeshPrimitive> primitives[2];
+            animation = stateAt(frame);
+            for (int pass = 0; pass < 2; pass++) {
+                lodPixelError = pass == 0 ? bound : 0.0f;
+                invalidateMeshCache();
+                drawScene();
+                triangles[pass].swap(frameTriangles);
+                lines[pass].swap(frameLines);
+                primitives[pass].swap(framePrimitives);
+                frameTriangles.clear();
+                frameLines.clear();
+                framePrimitives.clear();
+                frameLayer = 0;
+            }
+            if (primitives[0].size() != primitives[1].size()) {
+                printf("  %4dx%-4d frame %3d: %d primitives instead of %d\n", size[0], size[1], frame, (int)primitives[0].size(), (int)primitives[1].size());
+                ok = false;
+                continue;
+            }
+
+            // Compare every primitive with its reference
+            double deviation = 0, coverage = 0;
+            int fewestSegments = 300, mostSegments = 0;
+            for (size_t p = 0; p < primitives[0].size(); p++) {
+                // Outline of each version, in pixels, as a list of segments
+                vector<float> outline[2]; // x0, y0, x1, y1 of every segment
+                double area[2] = { 0, 0 }, perimeter = 0;
+                for (int pass = 0; pass < 2; pass++) {
+                    const MeshPrimitive& primitive = primitives[pass][p];
+                    const BatchVertex* v = (primitive.mode == GL_TRIANGLES ? triangles[pass] : lines[pass]).data() + primitive.first;
+                    vector<float> x, y; // Points of the outline; polygons are closed, line lists come in pairs
+                    if (primitive.mode == GL_TRIANGLES) {
+                        // Undo the fan: v0, v1, v2, then the third vertex of every following triangle
+                        for (int i = 0; i < primitive.count; i++) {
+                            if (i < 3 || i % 3 == 2) {
+                                x.push_back((float)((v[i].x - clippingPlanLeft) * pixelsX));
+                                y.push_back((float)((v[i].y - clippingPlanBottom) * pixelsY));
+                            }
+                        }
+                        for (size_t i = 0; i < x.size(); i++) {
+                            size_t j = (i + 1) % x.size();
+                            outline[pass].insert(outline[pass].end(), { x[i], y[i], x[j], y[j] });
+                            area[pass] += 0.5 * ((double)x[i] * y[j] - (double)x[j] * y[i]);
+                            perimeter += pass == 1 ? hypot(x[j] - x[i], y[j] - y[i]) : 0;
+                        }
+                        if (pass == 0 && primitive.count > 6) {
+                            fewestSegments = min(fewestSegments, (int)x.size() - 1);
+                            mostSegments = max(mostSegments, (int)x.size() - 1);
+                        }
+                    }
+                    else {
+                        for (int i = 0; i < primitive.count; i++) {
+                            outline[pass].push_back((float)((v[i].x - clippingPlanLeft) * pixelsX));
+                            outline[pass].push_back((float)((v[i].y - clippingPlanBottom) * pixelsY));
+                        }
+                    }
+                }
+
+                // Largest distance from a reference vertex to the adaptive outline
+                for (size_t r = 0; r < outline[1].size(); r += 2) {
+                    double px = outline[1][r], py = outline[1][r + 1], nearest = 1e30;
+                    for (size_t s = 0; s < outline[0].size(); s += 4) {
+                        double x0 = outline[0][s], y0 = outline[0][s + 1], dx = outline[0][s + 2] - x0, dy = outline[0][s + 3] - y0;
+                        double length = dx * dx + dy * dy;
+                        double t = length > 0 ? max(0.0, min(1.0, ((px - x0) * dx + (py - y0) * dy) / length)) : 0;
+                        nearest = min(nearest, hypot(px - x0 - t * dx, py - y0 - t * dy));
+                    }
+                    deviation = max(deviation, nearest);
+                }
+                if (perimeter > 0) {
+                    coverage = max(coverage, fabs(fabs(area[0]) - fabs(area[1])) / perimeter);
+                }
+            }
+
+            // Vertices are stored as floats, allow for their rounding at 4K
+            bool passed = deviation <= bound + 0.01 && coverage <= bound + 0.01;
+            ok = ok && passed;
+            printf("  %4dx%-4d frame %3d: %6d vertices instead of %6d, curves with %d to %d segments, deviation %.3f px, coverage %.3f px  %s\n",
+                size[0], size[1], frame, (int)(triangles[0].size() + lines[0].size()), (int)(triangles[1].size() + lines[1].size()),
+                fewestSegments, mostSegments, deviation, coverage, passed ? "ok" : "FAILED");
+        }
+    }
+
+    lodPixelError = bound;
+    invalidateMeshCache();
+    cout << (ok ? "The adaptive tessellation stays within the bound." : "The adaptive tessellation exceeds the bound.") << endl;
+    return ok ? 0 : 1;
+}
+
+// What: Function to check the analytic shapes against the tessellated ones
+//       The tessellated shapes are not antialiased, so their pixels are either the shape's color or the background's,
+//       while the analytic shapes blend along their edges. The frames are therefore compared by how far the colors
+//       are apart on average, and by the pixels that are more than half the way to the other color, which are those
+//       the two paths put on different sides of an edge. The analytic frames of both backends are compared the same way.
+// Input: None
+// Output: 0 if the frames stay within the bounds below, 1 otherwise
+// Action: For each backend, at 800x600 and 1920x1080, the function renders the growing and the grown character, alone
+//         and with a crowd of 300, with tessellated and with analytic shapes, and prints the vertices submitted, the
+//         time per frame, the mean difference of the color channels and the share of pixels on different sides of an edge.
+// Caller: main()
+int runShapeCheck() {
+    const RenderBackend backends[] = { BACKEND_OPENGL, BACKEND_CPU };
+    const int sizes[][2] = { { 800, 600 }, { 1920, 1080 } };
+    const int frames[] = { 0, 150 }; // Growing, and grown
+    const int crowds[] = { 0, 300 };
+    const int timedFrames = 10;
+    // Bounds on the mean channel difference and the share of flipped pixels. Most of the difference is the
+    // antialiasing, which darkens the outlines of the small characters of the crowd the most; the two backends
+    // shade the same shapes and must agree far more closely
+    const double meanBound = 3.0, flippedBound = 0.01, backendMeanBound = 0.25, backendFlippedBound = 0.001;
+    bool ok = true;
+
+    headlessMode = true;
+    layerCacheEnabled = false; // Time the whole frame every time
+    // Compares two frames, returns the mean channel difference and sets the share of pixels more than half the way apart
+    auto compare = [](const vector<unsigned char>& a, const vector<unsigned char>& b, double& flipped) {
+        double sum = 0;
+        size_t far = 0;
+        for (size_t i = 0; i < a.size(); i += 3) {
+            int largest = 0;
+            for (int c = 0; c < 3; c++) {
+                int difference = abs((int)a[i + c] - (int)b[i + c]);
+                sum += difference;
+                largest = max(largest, difference);
+            }
+            far += largest > 128;
+        }
+        flipped = (double)far / (a.size() / 3);
+        return sum / a.size();
+    };
+
+    vector<vector<unsigned char>> analyticFrames[2]; // Per backend, the analytic frame of every case
+    double largestMean = 0, mostFlipped = 0; // Largest differences between the analytic frames of both backends
+    printf("Analytic shapes against tessellated ones, bounds: mean difference %.1f, %.1f%% of the pixels flipped:\n", meanBound, flippedBound * 100);
+    for (int b = 0; b < 2; b++) {
+        renderBackend = backends[b];
+        if (renderBackend == BACKEND_OPENGL && !openOffscreenContext(sizes[1][0], sizes[1][1])) {
+            printf("  OpenGL skipped, no OpenGL context\n");
+            continue;
+        }
+        analyticShapes = true; // Init() only builds the program for them
+        Init();
+        if (renderBackend == BACKEND_OPENGL && !shapeProgram) {
+            printf("  OpenGL skipped, the analytic shapes need GLSL\n");
+            closeOffscreenContext();
+            continue;
+        }
+        for (const int* size : sizes) {
+            windowWidth = size[0];
+            windowHeight = size[1];
+            myReshape(windowWidth, windowHeight);
+            for (int crowd : crowds) {
+                crowdSize = crowd;
+                for (int frame : frames) {
+                    vector<unsigned char> pixels[2]; // Tessellated, analytic
+                    size_t vertices[2];
+                    double milliseconds[2];
+                    for (int pass = 0; pass < 2; pass++) {
+                        analyticShapes = pass == 1;
+                        invalidateMeshCache();
+                        // Count what a frame submits, without drawing it
+                        animation = stateAt(frame);
+                        animationTime = frame;
+                        drawScene();
+                        vertices[pass] = frameTriangles.size() + frameLines.size() + frameQuads.size();
+                        frameTriangles.clear();
+                        frameLines.clear();
+                        frameQuads.clear();
+                        framePrimitives.clear();
+                        frameLayer = 0;
+
+                        milliseconds[pass] = renderFrames(frame, timedFrames, nullptr) * 1000 / timedFrames;
+                        renderFrames(frame, 1, nullptr);
+                        pixels[pass].resize((size_t)windowWidth * windowHeight * 3);
+                        readFramePixels(pixels[pass].data());
+                    }
+                    double flipped, mean = compare(pixels[0], pixels[1], flipped);
+                    bool passed = mean <= meanBound && flipped <= flippedBound;
+                    ok = ok && passed;
+                    printf("  %-6s %4dx%-4d frame %3d crowd %3d: %7zu vertices instead of %7zu, %7.2f ms instead of %7.2f ms,"
+                        " mean difference %.2f, %.3f%% flipped  %s\n", renderBackend == BACKEND_OPENGL ? "OpenGL" : "CPU",
+                        size[0], size[1], frame, crowd, vertices[1], vertices[0], milliseconds[1], milliseconds[0], mean, flipped * 100,
+                        passed ? "ok" : "FAILED");
+                    // Both backends shade the same distances
+                    if (b == 1 && !analyticFrames[0].empty()) {
+                        double backendFlipped, backendMean = compare(analyticFrames[0][analyticFrames[1].size()], pixels[1], backendFlipped);
+                        largestMean = max(largestMean, backendMean);
+                        mostFlipped = max(mostFlipped, backendFlipped);
+                    }
+                    analyticFrames[b].push_back(pixels[1]);
+                }
+            }
+        }
+        closeOffscreenContext();
+    }
+
+    if (!analyticFrames[0].empty() && !analyticFrames[1].empty()) {
+        bool passed = largestMean <= backendMeanBound && mostFlipped <= backendFlippedBound;
+        ok = ok && passed;
+        printf("  OpenGL against CPU, analytic shapes: mean difference up to %.2f, up to %.3f%% flipped  %s\n",
+            largestMean, mostFlipped * 100, passed ? "ok" : "FAILED");
+    }
+
+    analyticShapes = false;
+    crowdSize = 0;
+    layerCacheEnabled = true;
+    invalidateMeshCache();
+    printf(ok ? "The analytic shapes match the tessellated ones.\n" : "The analytic shapes differ from the tessellated ones.\n");
+    return ok ? 0 : 1;
+}
+
+// What: Function to time the table-driven tessellation against per-vertex cos/sin
+// Input: None
+// Output: 0 on success, 1 if the two paths give different vertices
+// Action: For ellipses of 16, 64 and 300 segments and a 180-degree arc, the function generates the same vertices
+//         about 20 million times with the cos/sin loop drawEllipse() and drawArc() used before the tables, and with
+//         emitEllipse()/emitArc(). It prints the time per vertex of each path, the speed-up and the largest
+//         difference between their vertices.
+// Caller: main()
+int runTessellationBenchmark() {
+    const int ellipseSegments[] = { 16, 64, 300 };
+    const int targetVertices = 20000000;
+    const float xRadius = 0.25f, yRadius = 0.2f;
+    bool ok = true;
+
+    shapeColor[0] = shapeColor[1] = shapeColor[2] = 0.0f;
+    printf("Tessellation, per-vertex cos/sin against compile-time tables:\n");
+    for (int shape = 0; shape < 4; shape++) {
+        bool arc = shape == 3;
+        int segments = arc ? 180 : ellipseSegments[shape];
+        int repetitions = targetVertices / (segments + 1);
+        vector<BatchVertex> reference;
+        double nanoseconds[2];
+        for (int path = 0; path < 2; path++) {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for (int r = 0; r < repetitions; r++) {
+                float xCenter = r * 1e-7f, yCenter = 0.5f; // Changes every time so nothing can be hoisted out of the loop
+                shapeVertices.clear();
+                if (path == 1) {
+                    if (arc) {
+                        emitArc(xCenter, yCenter, xRadius, yRadius, 0, 180, 1);
+                    }
+                    else {
+                        emitEllipse(segments, xCenter, yCenter, xRadius, yRadius);
+                    }
+                }
+                else {
+                    for (int i = 0; i <= segments; i++) {
+                        double angle = arc ? 2 * PI * i / 360 : 2 * PI * i / segments;
+                        shapeVertex(xRadius * cos(angle) + xCenter, yRadius * sin(angle) + yCenter);
+                    }
+                }
+            }
+            nanoseconds[path] = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / ((double)repetitions * (segments + 1));
+            if (path == 0) {
+                reference = shapeVertices;
+            }
+        }
+
+        double difference = shapeVertices.size() == reference.size() ? 0 : 1;
+        for (size_t i = 0; i < reference.size() && i < shapeVertices.size(); i++) {
+            difference = max(difference, (double)max(fabs(reference[i].x - shapeVertices[i].x), fabs(reference[i].y - shapeVertices[i].y)));
+        }
+        ok = ok && difference < 1e-6;
+        char name[32];
+        snprintf(name, sizeof(name), arc ? "arc, %d degrees" : "ellipse, %d segments", segments);
+        printf("  %-22s cos/sin %6.2f ns, table %6.2f ns per vertex  (%.1fx), largest difference %.1e\n",
+            name, nanoseconds[0], nanoseconds[1], nanoseconds[0] / nanoseconds[1], difference);
+    }
+    shapeVertices.clear();
+    return ok ? 0 : 1;
+}
+
+
+// Below are implementations of creating shapes
+
+// What: Function to start a primitive
+//       The draw functions describe their shapes with the classic OpenGL modes (GL_POLYGON, GL_LINE_LOOP, ...);
+//       endShape() converts them to the triangle and line lists used by the frame command buffer.
+// Input: GL primitive mode, color (red, green, blue)
+// Output: None
+// Action: The function starts collecting the vertices of a new primitive with the given mode and color.
+// Caller: drawEllipse(), drawArc(), drawFilledArc(), drawLine() and drawRectangle()
+void beginShape(GLenum mode, float red, float green, float blue) {
+    shapeMode = mode;
+    shapeColor[0] = red;
+    shapeColor[1] = green;
+    shapeColor[2] = blue;
+    shapeVertices.clear();
+}
+
+// What: Function to add a vertex to the current primitive
+// Input: vertex coordinates (x, y)
+// Output: None
+// Action: The function stores the vertex with the color of the primitive.
+// Caller: drawEllipse(), drawArc(), drawFilledArc(), drawLine() and drawRectangle()
+void shapeVertex(double x, double y) {
+    shapeVertices.push_back({ (GLfloat)x, (GLfloat)y, 0.0f, shapeColor[0], shapeColor[1], shapeColor[2] });
+}
+
+// What: Function to finish the current primitive
+// Input: None
+// Output: None
+// Action: The function converts the primitive to a list topology and appends it to the mesh being recorded.
+//         Polygons, triangle fans and quads become GL_TRIANGLES, line strips and loops become GL_LINES.
+//         If no mesh is being recorded, the primitive is submitted to the frame right away.
+// Caller: drawEllipse(), drawArc(), drawFilledArc(), drawLine() and drawRectangle()
+void endShape() {
+    Mesh& mesh = recordingMesh ? *recordingMesh : dynamicMesh;
+    const vector<BatchVertex>& v = shapeVertices;
+    int n = (int)v.size();
+    int first = (int)mesh.vertices.size();
+
+    switch (shapeMode) {
+    case GL_POLYGON:
+    case GL_TRIANGLE_FAN:
+        for (int i = 1; i + 1 < n; i++) {
+            mesh.vertices.push_back(v[0]);
+            mesh.vertices.push_back(v[i]);
+            mesh.vertices.push_back(v[i + 1]);
+        }
+        mesh.primitives.push_back({ GL_TRIANGLES, first, (GLsizei)(mesh.vertices.size() - first) });
+        break;
+    case GL_QUADS:
+        for (int i = 0; i + 3 < n; i += 4) {
+            mesh.vertices.insert(mesh.vertices.end(), { v[i], v[i + 1], v[i + 2], v[i], v[i + 2], v[i + 3] });
+            mesh.primitives.push_back({ GL_TRIANGLES, first + 6 * (i / 4), 6 });
+        }
+        break;
+    case GL_LINES:
+        mesh.vertices.insert(mesh.vertices.end(), v.begin(), v.begin() + (n & ~1));
+        mesh.primitives.push_back({ GL_LINES, first, (GLsizei)(mesh.vertices.size() - first) });
+        break;
+    case GL_LINE_STRIP:
+    case GL_LINE_LOOP:
+        for (int i = 0; i + 1 < n; i++) {
+            mesh.vertices.push_back(v[i]);
+            mesh.vertices.push_back(v[i + 1]);
+        }
+        if (shapeMode == GL_LINE_LOOP && n > 2) {
+            mesh.vertices.push_back(v[n - 1]);
+            mesh.vertices.push_back(v[0]);
+        }
+        mesh.primitives.push_back({ GL_LINES, first, (GLsizei)(mesh.vertices.size() - first) });
+        break;
+    }
+    submitDynamicMesh();
+}
+
+// What: Function to submit a shape drawn outside of any cached mesh
+// Input: None
+// Output: None
+// Action: Unless a mesh is being recorded, the function submits dynamicMesh to the frame and empties it.
+// Caller: endShape() and addAnalyticShape()
+void submitDynamicMesh() {
+    if (recordingMesh) {
+        return;
+    }
+    submitMesh(dynamicMesh);
+    dynamicMesh.vertices.clear();
+    dynamicMesh.quads.clear();
+    dynamicMesh.primitives.clear();
+    dynamicMesh.pickShapes.clear();
+}
+
+// What: Function to add an analytic shape
+//       The quad is the box around the ellipse, with u and v going from -1 to 1 across it; submitMesh() widens it
+//       by the outline and the antialiased edge once it knows how large the shape is on screen.
+// Input: kind - what is drawn of the ellipse
+//        center coordinates (xCenter, yCenter), radii (xRadius, yRadius)
+//        start and end angles of an arc or a sector, in degrees, 0 and 360 for a whole ellipse
+//        color (red, green, blue)
+// Output: None
+// Action: The function appends the quad, with the edges of the sweep, to the mesh being recorded, or submits it to
+//         the frame right away. A shape without area or sweep is left out, as its tessellation would draw nothing.
+// Caller: drawEllipse(), drawArc() and drawFilledArc()
+void addAnalyticShape(int kind, float xCenter, float yCenter, float xRadius, float yRadius, int startAngle, int endAngle, float red, float green, float blue) {
+    // The sweep runs counterclockwise from the smaller angle to the larger one, whichever way it was drawn
+    int first = min(startAngle, endAngle), last = max(startAngle, endAngle);
+    if (xRadius != 0 && yRadius != 0 && first != last) {
+        const UnitCircle<360>& circle = unitCircle<360>;
+        int firstIndex = (first % 360 + 360) % 360, lastIndex = (last % 360 + 360) % 360;
+        ShapeSweep sweep = last - first >= 360 ? SWEEP_FULL : last - first > 180 ? SWEEP_REFLEX : SWEEP_CONVEX;
+        Mesh& mesh = recordingMesh ? *recordingMesh : dynamicMesh;
+        mesh.primitives.push_back({ GL_QUADS, (GLint)mesh.quads.size(), 4 });
+        const float corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+        for (const float* corner : corners) {
+            mesh.quads.push_back({ xCenter + xRadius * corner[0], yCenter + yRadius * corner[1], 0.0f, red, green, blue,
+                corner[0], corner[1], (GLfloat)kind, (GLfloat)sweep, (GLfloat)circle.cosine[firstIndex], (GLfloat)circle.sine[firstIndex],
+                (GLfloat)circle.cosine[lastIndex], (GLfloat)circle.sine[lastIndex] });
+        }
+    }
+    submitDynamicMesh();
+}
+
+// What: Function to find the level of detail of the current transform
+//       Shapes are tessellated for the largest stretch, in pixels per unit, of the current transform and the viewport.
+//       It is rounded up to a ladder of LOD_LEVELS_PER_OCTAVE levels per doubling, so a cached mesh is only
+//       tessellated again when the character has grown by about a fifth, not every frame.
+// Input: None (uses currentTransform, the window size and the clipping planes)
+// Output: The level n, meaning a stretch of at most 2^(n / LOD_LEVELS_PER_OCTAVE) pixels per unit
+// Action: The function computes the largest singular value of the transform followed by the viewport mapping,
+//         unless lodLevelOverride fixes the level for the whole crowd.
+// Caller: drawCachedMesh() and arcSegments()
+int currentLodLevel() {
+    if (lodLevelOverride != INT_MIN) {
+        return lodLevelOverride;
+    }
+    const Transform2D& t = currentTransform;
+    double pixelsX = windowWidth / (clippingPlanRight - clippingPlanLeft);
+    double pixelsY = windowHeight / (clippingPlanTop - clippingPlanBottom);
+    double a = pixelsX * t.a, c = pixelsX * t.c, b = pixelsY * t.b, d = pixelsY * t.d;
+    double sum = a * a + b * b + c * c + d * d, determinant = a * d - b * c;
+    double stretch = sqrt((sum + sqrt(max(0.0, sum * sum - 4 * determinant * determinant))) / 2);
+    return (int)ceil(LOD_LEVELS_PER_OCTAVE * log2(max(stretch, 1e-6)));
+}
+
+// What: Function to choose the number of segments of an elliptic arc
+//       A chord spanning an angle step of a circle of radius r leaves the circle by at most r * (1 - cos(step / 2)).
+//       An ellipse is a stretched circle, so using its larger radius, times the stretch of the transform, bounds the
+//       distance on screen. Small features get a handful of segments, large ones at 4K keep the reference count.
+// Input: xRadius, yRadius - the radii of the ellipse
+//        sweep - the angle covered by the arc, in radians
+//        referenceSegments - the fixed number of segments used without adaptive tessellation
+// Output: The number of segments, between 1 and referenceSegments
+// Action: The function solves the chord error for the step that keeps it within lodPixelError.
+// Caller: drawEllipse(), drawArc() and drawFilledArc()
+int arcSegments(float xRadius, float yRadius, double sweep, int referenceSegments) {
+    if (lodPixelError <= 0) {
+        return referenceSegments;
+    }
+    int level = recordingMesh ? recordingMesh->lodLevel : currentLodLevel();
+    double radius = max(fabs(xRadius), fabs(yRadius)) * pow(2.0, (double)level / LOD_LEVELS_PER_OCTAVE);
+    double step = radius > lodPixelError ? 2 * acos(1 - lodPixelError / radius) : PI;
+    step = min(step, PI / 4); // Never coarser than 45 degrees, so a tiny ellipse still looks round
+    int segments = (int)ceil(sweep / step - 1e-9);
+    return max(1, min(segments, referenceSegments));
+}
+
+// What: Function to add the vertices of an ellipse with N segments to the current primitive
+//       The cos/sin values come from unitCircle<N>, built by the compiler, so each vertex is just a multiply-add
+//       of the table with the radii and the center. The loop has a constant trip count and no calls, which lets
+//       the compiler unroll and vectorize it.
+// Input: center coordinates (xCenter, yCenter), radii (xRadius, yRadius)
+// Output: None
+// Action: The function appends the N + 1 vertices (the last one repeats the first) with the color of the primitive.
+// Caller: emitEllipse()
+template <int N>
+void emitEllipseVertices(float xCenter, float yCenter, float xRadius, float yRadius) {
+    const UnitCircle<N>& circle = unitCircle<N>;
+    size_t first = shapeVertices.size();
+    shapeVertices.resize(first + N + 1);
+    BatchVertex* v = shapeVertices.data() + first;
+    for (int i = 0; i <= N; i++) {
+        v[i].x = (GLfloat)(xRadius * circle.cosine[i] + xCenter);
+        v[i].y = (GLfloat)(yRadius * circle.sine[i] + yCenter);
+        v[i].z = 0.0f;
+        v[i].r = shapeColor[0];
+        v[i].g = shapeColor[1];
+        v[i].b = shapeColor[2];
+    }
+}
+
+// One emitter per entry of ELLIPSE_SEGMENT_LADDER
+void (*const ellipseEmitters[])(float, float, float, float) = {
+    emitEllipseVertices<8>, emitEllipseVertices<10>, emitEllipseVertices<12>, emitEllipseVertices<14>,
+    emitEllipseVertices<16>, emitEllipseVertices<20>, emitEllipseVertices<24>, emitEllipseVertices<28>,
+    emitEllipseVertices<32>, emitEllipseVertices<40>, emitEllipseVertices<48>, emitEllipseVertices<56>,
+    emitEllipseVertices<64>, emitEllipseVertices<80>, emitEllipseVertices<96>, emitEllipseVertices<112>,
+    emitEllipseVertices<128>, emitEllipseVertices<160>, emitEllipseVertices<192>, emitEllipseVertices<224>,
+    emitEllipseVertices<256>, emitEllipseVertices<300>
+};
+static_assert(sizeof(ellipseEmitters) / sizeof(ellipseEmitters[0]) == sizeof(ELLIPSE_SEGMENT_LADDER) / sizeof(ELLIPSE_SEGMENT_LADDER[0]),
+    "Every segment count of the ladder needs an emitter");
+
+// What: Function to add the vertices of an ellipse to the current primitive
+// Input: segments - the number of segments wanted, rounded up to ELLIPSE_SEGMENT_LADDER
+//        center coordinates (xCenter, yCenter), radii (xRadius, yRadius)
+// Output: None
+// Action: The function picks the first ladder entry with at least that many segments and calls its emitter.
+// Caller: drawEllipse() and runTessellationBenchmark()
+void emitEllipse(int segments, float xCenter, float yCenter, float xRadius, float yRadius) {
+    const int count = sizeof(ELLIPSE_SEGMENT_LADDER) / sizeof(ELLIPSE_SEGMENT_LADDER[0]);
+    int rung = (int)(lower_bound(ELLIPSE_SEGMENT_LADDER, ELLIPSE_SEGMENT_LADDER + count, segments) - ELLIPSE_SEGMENT_LADDER);
+    ellipseEmitters[min(rung, count - 1)](xCenter, yCenter, xRadius, yRadius);
+}
+
+// What: Function to add the vertices of an arc to the current primitive
+//       Arcs run through whole degrees, so they all index sub-ranges of the same 360-entry table.
+// Input: center coordinates (xCenter, yCenter), radii (xRadius, yRadius), start and end angles in degrees,
+//        step - degrees between two vertices
+// Output: None
+// Action: The function appends a vertex every step degrees from the start angle, and one at the end angle.
+// Caller: drawArc(), drawFilledArc() and runTessellationBenchmark()
+void emitArc(float xCenter, float yCenter, float xRadius, float yRadius, int startAngle, int endAngle, int step) {
+    const UnitCircle<360>& circle = unitCircle<360>;
+    int sweep = abs(endAngle - startAngle), direction = endAngle >= startAngle ? 1 : -1;
+    int start = (startAngle % 360 + 360) % 360;
+    int count = (sweep + step - 1) / step + 1;
+    size_t first = shapeVertices.size();
+    shapeVertices.resize(first + count);
+    BatchVertex* v = shapeVertices.data() + first;
+    for (int j = 0; j < count; j++) {
+        int i = (start + direction * min(j * step, sweep)) % 360;
+        i += i < 0 ? 360 : 0;
+        v[j].x = (GLfloat)(xRadius * circle.cosine[i] + xCenter);
+        v[j].y = (GLfloat)(yRadius * circle.sine[i] + yCenter);
+        v[j].z = 0.0f;
+        v[j].r = shapeColor[0];
+        v[j].g = shapeColor[1];
+        v[j].b = shapeColor[2];
+    }
+}
+
+// What: Function to draw an ellipse
+// Input: center coordinates (xCenter, yCenter), radii (xRadius, yRadius), color (red, green, blue)
+// Output: None
+// Action: The function first draws a filled ellipse with the specified color, then, unless outline is false, outlines it in black.
+//         The number of segments depends on the size of the ellipse on screen, see arcSegments(). With analyticShapes,
+//         the filled and outlined ellipse is one analytic shape instead.
+// Caller: drawDoraemon(), drawBambooCopter(), drawBalloons() and tessellateSceneNode()
+void drawEllipse(float xCenter, float yCenter, float xRadius, float yRadius, float red, float green, float blue, bool outline) {
+    if (analyticShapes) {
+        addPickShape(PICK_ELLIPSE, xCenter, yCenter, xRadius, yRadius);
+        addAnalyticShape(outline ? SHAPE_FILL_OUTLINE : SHAPE_FILL, xCenter, yCenter, xRadius, yRadius, 0, 360, red, green, blue);
+        return;
+    }
+    int segments = arcSegments(xRadius, yRadius, 2 * PI, 300);
+    beginShape(GL_POLYGON, red, green, blue);
+    emitEllipse(segments, xCenter, yCenter, xRadius, yRadius);
+    addPickShape(PICK_ELLIPSE, xCenter, yCenter, xRadius, yRadius);
+    endShape();
+    if (!outline) {
+        return;
+    }
+
+    beginShape(GL_LINE_LOOP, 0.0, 0.0, 0.0);
+    emitEllipse(segments, xCenter, yCenter, xRadius, yRadius);
+    endShape();
+}
+
+// What: Function to draw an arc
+//       An arc is a portion of the circumference of an ellipse, which is defined by the start and end angles
+// Input: center coordinates (xCenter, yCenter), radii (xRadius, yRadius), start and end angles (startAngle, endAngle), color (red, green, blue)
+// Output: None
+// Action: The function draws an arc from the start angle to the end angle with the specified color.
+//         The arc runs through whole degrees, at least one degree per segment and at most as many as arcSegments() allows,
+//         or is one analytic shape with analyticShapes.
+// Caller: drawDoraemon()
+void drawArc(float xCenter, float yCenter, float xRadius, float yRadius, float startAngle, float endAngle, float red, float green, float blue) {
+    int start = (int)startAngle, end = (int)endAngle, sweep = abs(end - start);
+    if (analyticShapes) {
+        addAnalyticShape(SHAPE_ARC, xCenter, yCenter, xRadius, yRadius, start, end, red, green, blue);
+        return;
+    }
+    int segments = arcSegments(xRadius, yRadius, sweep * PI / 180, sweep);
+    beginShape(GL_LINE_STRIP, red, green, blue);
+    emitArc(xCenter, yCenter, xRadius, yRadius, start, end, max(1, sweep / segments));
+    endShape();
+}
+
+// What: Function to draw a filled arc
+//       An arc is a portion of the circumference of an ellipse, which is defined by the start and end angles
+// Input: center coordinates (xCenter, yCenter), radii (radiusX, radiusY), start and end angles (startAngle, endAngle), color (red, green, blue)
+// Output: None
+// Action: The function draws a filled arc from the start angle to the end angle with the specified color.
+//         The arc runs through whole degrees, at least one degree per segment and at most as many as arcSegments() allows,
+//         or is one analytic shape with analyticShapes.
+// Caller: drawDoraemon()
+void drawFilledArc(float xCenter, float yCenter, float radiusX, float radiusY, float startAngle, float endAngle, float red, float green, float blue) {
+    int start = (int)startAngle, end = (int)endAngle, sweep = abs(end - start);
+    if (analyticShapes) {
+        addPickShape(PICK_SECTOR, xCenter, yCenter, radiusX, radiusY, start, end);
+        addAnalyticShape(SHAPE_SECTOR, xCenter, yCenter, radiusX, radiusY, start, end, red, green, blue);
+        return;
+    }
+    int segments = arcSegments(radiusX, radiusY, sweep * PI / 180, sweep);
+    beginShape(GL_TRIANGLE_FAN, red, green, blue);
+    shapeVertex(xCenter, yCenter);
+    emitArc(xCenter, yCenter, radiusX, radiusY, start, end, max(1, sweep / segments));
+    addPickShape(PICK_SECTOR, xCenter, yCenter, radiusX, radiusY, start, end);
+    endShape();
+}
+
+// What: Function to draw a line
+// Input: start and end coordinates (x1, y1, x2, y2), color (red, green, blue)
+// Output: None
+// Action: The function draws a line from the start coordinates to the end coordinates with the specified color.
+// Caller: drawDoraemon(), drawBambooCopter() and drawBalloons()
+void drawLine(float x1, float y1, float x2, float y2, float red, float green, float blue) {
+    beginShape(GL_LINES, red, green, blue);
+    shapeVertex(x1, y1);
+    shapeVertex(x2, y2);
+    endShape();
+}
+
+// What: Function to draw a rectangle
+// Input: corner coordinates (x1, y1, x2, y2), color (r, g, b)
+// Output: None
+// Action: The function first draws a filled rectangle with the specified color, then, unless outline is false, outlines it in black.
+//         The corner coordinates (x1, y1) and (x2, y2) represent the bottom-left and top-right OR 
+//         bottom-right and top-left corners of the rectangle, respectively
+// Caller: drawDoraemon() and tessellateSceneNode()
+void drawRectangle(float x1, float y1, float x2, float y2, float r, float g, float b, bool outline) {
+    beginShape(GL_QUADS, r, g, b);
+    shapeVertex(x1, y1);
+    shapeVertex(x2, y1);
+    shapeVertex(x2, y2);
+    shapeVertex(x1, y2);
+    addPickShape(PICK_RECTANGLE, (x1 + x2) / 2, (y1 + y2) / 2, fabs(x2 - x1) / 2, fabs(y2 - y1) / 2);
+    endShape();
+    if (!outline) {
+        return;
+    }
+
+    beginShape(GL_LINE_LOOP, 0.0, 0.0, 0.0);
+    shapeVertex(x1, y1);
+    shapeVertex(x2, y1);
+    shapeVertex(x2, y2);
+    shapeVertex(x1, y2);
+    endShape();
+}
+
+
+// Below is the retained geometry cache
+
+// What: Function to draw a cached mesh, tessellating it first if needed
+//       The static parts of the scene never change, so their cos/sin work is done once and the
+//       resulting vertices are replayed every frame under the current transform.
+// Input: mesh - the cache entry
+//        tessellate - a function that draws the shapes of the mesh with the usual draw functions
+//        fillColor - the color of every filled shape, or nullptr for the colors it was tessellated with
+// Output: None
+// Action: If the mesh is not built yet, or was built for another level of detail, the function records the shapes
+//         drawn by tessellate() into it. It then submits the mesh to the frame.
+// Caller: drawDoraemon(), drawBambooCopter() and drawBalloons()
+void drawCachedMesh(Mesh& mesh, void (*tessellate)(), const GLfloat* fillColor) {
+    int lodLevel = currentLodLevel();
+    if (!mesh.built || mesh.lodLevel != lodLevel) {
+        mesh.vertices.clear();
+        mesh.quads.clear();
+        mesh.primitives.clear();
+        mesh.pickShapes.clear();
+
+        mesh.lodLevel = lodLevel;
+        recordingMesh = &mesh;
+        tessellate();
+        recordingMesh = nullptr;
+        mesh.built = true;
+    }
+    submitMesh(mesh, fillColor);
+}
+
+// What: Function to submit a mesh to the frame command buffer
+// Input: mesh - the tessellated triangle and line lists
+//        fillColor - the color given to the triangles, or nullptr to keep the mesh's colors
+// Output: None
+// Action: The function transforms every vertex by the current transform, stamps each primitive with
+//         the next draw-order layer and appends it to the triangle or line batch of the frame, or, for an analytic
+//         shape, to frameQuads. If the mesh has pickable shapes and drawScene() is running, it also keeps the mesh
+//         and the transform for buildPickIndex(); the shapes of dynamicMesh, which is emptied next, are copied.
+// Caller: drawCachedMesh() and submitDynamicMesh()
+void submitMesh(const Mesh& mesh, const GLfloat* fillColor) {
+    if (pickRecording && !mesh.pickShapes.empty()) {
+        PickSubmission submission = { &mesh, 0, 0, currentTransform, pickPart, pickCharacter };
+        if (&mesh == &dynamicMesh) {
+            submission.mesh = nullptr;
+            submission.first = (int)framePickShapes.size();
+            submission.count = (int)mesh.pickShapes.size();
+            framePickShapes.insert(framePickShapes.end(), mesh.pickShapes.begin(), mesh.pickShapes.end());
+        }
+        framePickSubmissions.push_back(submission);
+    }
+    const Transform2D& t = currentTransform;
+    for (const MeshPrimitive& primitive : mesh.primitives) {
+        if (primitive.mode == GL_QUADS) {
+            submitShapeQuad(&mesh.quads[primitive.first], fillColor);
+            continue;
+        }
+        vector<BatchVertex>& batch = primitive.mode == GL_TRIANGLES ? frameTriangles : frameLines;
+        framePrimitives.push_back({ primitive.mode, (GLint)batch.size(), primitive.count });
+        // Later primitives get a larger z, i.e. they are closer to the viewer and win the depth test
+        GLfloat z = -1.0f + (++frameLayer) * (1.0f / FRAME_LAYER_LIMIT);
+        for (GLint i = primitive.first; i < primitive.first + primitive.count; i++) {
+            BatchVertex v = mesh.vertices[i];
+            GLfloat x = v.x, y = v.y;
+            v.x = t.a * x + t.c * y + t.tx;
+            v.y = t.b * x + t.d * y + t.ty;
+            v.z = z;
+            if (fillColor && primitive.mode == GL_TRIANGLES) {
+                v.r = fillColor[0];
+                v.g = fillColor[1];
+                v.b = fillColor[2];
+            }
+            batch.push_back(v);
+        }
+    }
+}
+
+// What: Function to submit the quad of an analytic shape
+//       The quad recorded in the mesh is the box around the ellipse. Its sides are pushed out along u and v until they
+//       are lineWidth / 2 + SHAPE_QUAD_MARGIN pixels from the ellipse, however the transform and the viewport stretch
+//       it, so the quad holds every pixel the outline and the antialiased edge reach.
+// Input: quad - the 4 vertices recorded in the mesh
+//        fillColor - the color given to a fill, or nullptr to keep the color it was recorded with
+// Output: None
+// Action: The function transforms and widens the quad, stamps it with the next draw-order layer and appends it to
+//         frameQuads. A shape squashed flat is left out.
+// Caller: submitMesh()
+void submitShapeQuad(const ShapeVertex* quad, const GLfloat* fillColor) {
+    const Transform2D& t = currentTransform;
+    float x[4], y[4];
+    for (int i = 0; i < 4; i++) {
+        x[i] = t.a * quad[i].x + t.c * quad[i].y + t.tx;
+        y[i] = t.b * quad[i].x + t.d * quad[i].y + t.ty;
+    }
+    // Half the sides along u and along v in world units; the distance, in pixels, from the center to the side
+    // along u is the area of the half box divided by the length of that side
+    float ux = (x[1] - x[0]) / 2, uy = (y[1] - y[0]) / 2, vx = (x[3] - x[0]) / 2, vy = (y[3] - y[0]) / 2;
+    float pixelsX = (float)(windowWidth / (clippingPlanRight - clippingPlanLeft));
+    float pixelsY = (float)(windowHeight / (clippingPlanTop - clippingPlanBottom));
+    float area = fabs(ux * vy - uy * vx) * pixelsX * pixelsY;
+    if (area == 0) {
+        return;
+    }
+    float margin = lineWidth / 2 + SHAPE_QUAD_MARGIN;
+    float scaleU = 1 + margin * hypot(vx * pixelsX, vy * pixelsY) / area;
+    float scaleV = 1 + margin * hypot(ux * pixelsX, uy * pixelsY) / area;
+    float centerX = (x[0] + x[2]) / 2, centerY = (y[0] + y[2]) / 2;
+
+    framePrimitives.push_back({ GL_QUADS, (GLint)frameQuads.size(), 4 });
+    GLfloat z = -1.0f + (++frameLayer) * (1.0f / FRAME_LAYER_LIMIT);
+    for (int i = 0; i < 4; i++) {
+        ShapeVertex v = quad[i];
+        v.u *= scaleU;
+        v.v *= scaleV;
+        v.x = centerX + v.u * ux + v.v * vx;
+        v.y = centerY + v.u * uy + v.v * vy;
+        v.z = z;
+        if (fillColor && v.kind != SHAPE_ARC) {
+            v.r = fillColor[0];
+            v.g = fillColor[1];
+            v.b = fillColor[2];
+        }
+        frameQuads.push_back(v);
+    }
+}
+
+// What: Function to empty the geometry cache
+// Input: None
+// Output: None
+// Action: The function marks every cached mesh as not built, so the next frame tessellates it again.
+// Caller: runLodCheck()
+void invalidateMeshCache() {
+    Mesh* meshes[] = { &doraemonBodyMesh, &leftLegMesh, &rightLegMesh, &legLineMesh, &copterBaseMesh,
+        &balloonThreadsMesh, &leftBalloonMesh, &rightBalloonMesh };
+    for (Mesh* mesh : meshes) {
+        mesh->built = false;
+    }
+    for (Mesh& mesh : sceneMeshes) {
+        mesh.built = false;
+    }
+}
+
+
+// Below is the frame command buffer
+
+// What: Function to save the current transform
+// Input: None
+// Output: None
+// Action: The function pushes the current transform on the transform stack, like glPushMatrix().
+// Caller: drawScene(), drawDoraemon() and drawBalloons()
+void pushTransform() {
+    transformStack.push_back(currentTransform);
+}
+
+// What: Function to restore the last saved transform
+// Input: None
+// Output: None
+// Action: The function pops the transform stack into the current transform, like glPopMatrix().
+// Caller: drawScene(), drawDoraemon() and drawBalloons()
+void popTransform() {
+    currentTransform = transformStack.back();
+    transformStack.pop_back();
+}
+
+// What: Function to multiply the current transform by another one
+// Input: the coefficients (a, b, c, d, tx, ty) of the transform to apply first
+// Output: None
+// Action: The function post-multiplies the current transform, the same way glMultMatrix() does.
+// Caller: translateTransform(), scaleTransform() and rotateTransform()
+void multiplyTransform(float a, float b, float c, float d, float tx, float ty) {
+    Transform2D t = currentTransform;
+    currentTransform.a = t.a * a + t.c * b;
+    currentTransform.b = t.b * a + t.d * b;
+    currentTransform.c = t.a * c + t.c * d;
+    currentTransform.d = t.b * c + t.d * d;
+    currentTransform.tx = t.a * tx + t.c * ty + t.tx;
+    currentTransform.ty = t.b * tx + t.d * ty + t.ty;
+}
+
+// What: Function to translate the current transform
+// Input: translation (x, y)
+// Output: None
+// Action: The function applies a translation, like glTranslatef(x, y, 0).
+// Caller: drawBalloons()
+void translateTransform(float x, float y) {
+    multiplyTransform(1, 0, 0, 1, x, y);
+}
+
+// What: Function to scale the current transform
+// Input: scale factors (x, y)
+// Output: None
+// Action: The function applies a scale, like glScalef(x, y, 1).
+// Caller: drawScene() and drawDoraemon()
+void scaleTransform(float x, float y) {
+    multiplyTransform(x, 0, 0, y, 0, 0);
+}
+
+// What: Function to rotate the current transform
+// Input: degrees - counterclockwise rotation angle
+// Output: None
+// Action: The function applies a rotation around the Z-axis, like glRotatef(degrees, 0, 0, 1).
+// Caller: drawBalloons()
+void rotateTransform(float degrees) {
+    float radians = degrees * (float)PI / 180.0f;
+    float c = cos(radians), s = sin(radians);
+    PROFILE_COUNT(COUNT_TRIG, 2);
+    multiplyTransform(c, s, -s, c, 0, 0);
+}
+
+// What: Function to draw the frame command buffer
+//       Every primitive carries its draw-order layer in z, so with the depth test enabled all triangles
+//       and all lines can be drawn in one glDrawArrays call each and still overlap as if they were
+//       drawn one after another.
+// Input: None
+// Output: None
+// Action: The function draws the triangle batch, the line batch and the analytic shapes of the frame and empties them.
+// Caller: myDisplay()
+void flushFrame() {
+    PROFILE_SCOPE(ZONE_FLUSH_FRAME);
+    PROFILE_COUNT(COUNT_VERTICES, (long long)(frameTriangles.size() + frameLines.size() + frameQuads.size()));
+    PROFILE_COUNT(COUNT_PRIMITIVES, (long long)framePrimitives.size());
+    if (renderBackend == BACKEND_CPU) {
+        rasterizeFrame();
+        if (openGLContext) {
+            // Show the image in the window
+            glRasterPos2d(clippingPlanLeft, clippingPlanBottom);
+            glDrawPixels(cpuFramebufferWidth, cpuFramebufferHeight, GL_RGBA, GL_UNSIGNED_BYTE, cpuFramebuffer.data());
+            PROFILE_COUNT(COUNT_GL_CALLS, 2);
+        }
+        frameTriangles.clear();
+        frameLines.clear();
+        frameQuads.clear();
+        framePrimitives.clear();
+        frameLayer = 0;
+        return;
+    }
+
+    glEnable(GL_DEPTH_TEST);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+
+    const vector<BatchVertex>* batches[] = { &frameTriangles, &frameLines };
+    const GLenum modes[] = { GL_TRIANGLES, GL_LINES };
+    for (int i = 0; i < 2; i++) {
+        const vector<BatchVertex>& batch = *batches[i];
+        if (batch.empty()) {
+            continue;
+        }
+        glVertexPointer(3, GL_FLOAT, sizeof(BatchVertex), &batch[0].x);
+        glColorPointer(3, GL_FLOAT, sizeof(BatchVertex), &batch[0].r);
+        glDrawArrays(modes[i], 0, (GLsizei)batch.size());
+        PROFILE_COUNT(COUNT_GL_CALLS, 3);
+    }
+    PROFILE_COUNT(COUNT_GL_CALLS, 6); // Enabling and disabling the depth test and both arrays
+#ifdef __linux__
+    if (!frameQuads.empty() && shapeProgram) {
+        // The analytic shapes come last, so their antialiased edges blend over whatever lies under them. They are in
+        // draw order among themselves, and the depth test keeps them under the later triangles and lines.
+        glUseProgram(shapeProgram);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA); // The program outputs premultiplied colors
+        glVertexPointer(3, GL_FLOAT, sizeof(ShapeVertex), &frameQuads[0].x);
+        glColorPointer(3, GL_FLOAT, sizeof(ShapeVertex), &frameQuads[0].r);
+        glClientActiveTexture(GL_TEXTURE1);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(4, GL_FLOAT, sizeof(ShapeVertex), &frameQuads[0].startX);
+        glClientActiveTexture(GL_TEXTURE0);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(4, GL_FLOAT, sizeof(ShapeVertex), &frameQuads[0].u);
+        glDrawArrays(GL_QUADS, 0, (GLsizei)frameQuads.size());
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glClientActiveTexture(GL_TEXTURE1);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glClientActiveTexture(GL_TEXTURE0);
+        glDisable(GL_BLEND);
+        glUseProgram(0);
+        PROFILE_COUNT(COUNT_GL_CALLS, 19);
+    }
+#endif
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisable(GL_DEPTH_TEST);
+
+    frameTriangles.clear();
+    frameLines.clear();
+    frameQuads.clear();
+    framePrimitives.clear();
+    frameLayer = 0;
+}
+
+// What: Function to build the shader program of the analytic shapes
+//       The vertex shader hands the quad's position on the plane of the unit circle and the edges of its sweep to the
+//       fragment shader, which finds the pixel's distance to the ellipse and to the edges, and from them the coverage
+//       of the fill and of the outline, the same way rasterizeShape() does on the CPU. The outline is measured along
+//       the x or the y axis, whichever is closer to its normal, which is how OpenGL widens the lines it replaces.
+// Input: None
+// Output: true if the program was built
+// Action: The function compiles and links the program in the current OpenGL context and stores it in shapeProgram.
+//         If the context is older than OpenGL 2.0, or the program cannot be built, it prints why and leaves
+//         shapeProgram 0, and Init() goes back to the tessellated shapes.
+// Caller: Init()
+bool buildShapeProgram() {
+    shapeProgram = 0;
+#ifdef __linux__
+    const char* version = (const char*)glGetString(GL_VERSION);
+    if (!version || atoi(version) < 2) {
+        cerr << "The analytic shapes need OpenGL 2.0, the context has " << (version ? version : "no version") << "." << endl;
+        return false;
+    }
+    const char* sources[2] = {
+        "#version 110\n"
+        "varying vec4 shape;\n" // u, v, kind and sweep
+        "varying vec4 edges;\n" // First and last edge
+        "void main() {\n"
+        "    gl_Position = ftransform();\n"
+        "    gl_FrontColor = gl_Color;\n"
+        "    shape = gl_MultiTexCoord0;\n"
+        "    edges = gl_MultiTexCoord1;\n"
+        "}\n",
+
+        "#version 110\n"
+        "uniform float halfWidth;\n"
+        "varying vec4 shape;\n"
+        "varying vec4 edges;\n"
+        "void main() {\n"
+        "    vec2 p = shape.xy, px = dFdx(p), py = dFdy(p);\n"
+        "    float r = max(length(p), 1e-6);\n"
+        "    vec2 g = vec2(dot(p, px), dot(p, py)) / r;\n" // Change of r per pixel
+        "    float f = r - 1.0;\n"
+        "    float fill = clamp(0.5 - f / max(length(g), 1e-6), 0.0, 1.0);\n"
+        "    float line = clamp(halfWidth + 0.5 - abs(f) / max(max(abs(g.x), abs(g.y)), 1e-6), 0.0, 1.0);\n"
+        "    vec2 sg = edges.x * vec2(px.y, py.y) - edges.y * vec2(px.x, py.x);\n"
+        "    vec2 eg = edges.w * vec2(px.x, py.x) - edges.z * vec2(px.y, py.y);\n"
+        "    float toStart = (edges.x * p.y - edges.y * p.x) / max(length(sg), 1e-6);\n"
+        "    float toEnd = (p.x * edges.w - p.y * edges.z) / max(length(eg), 1e-6);\n"
+        "    float inside = shape.w < 0.5 ? min(toStart, toEnd) : shape.w < 1.5 ? max(toStart, toEnd) : 1.0;\n"
+        "    float sweep = clamp(0.5 + inside, 0.0, 1.0);\n"
+        "    vec3 lineColor = vec3(0.0);\n"
+        "    if (shape.z < 0.5) {\n" // SHAPE_FILL
+        "        line = 0.0;\n"
+        "    }\n"
+        "    else if (shape.z > 2.5) {\n" // SHAPE_SECTOR
+        "        line = 0.0;\n"
+        "        fill = min(fill, sweep);\n"
+        "    }\n"
+        "    else if (shape.z > 1.5) {\n" // SHAPE_ARC
+        "        fill = 0.0;\n"
+        "        line = min(line, sweep);\n"
+        "        lineColor = gl_Color.rgb;\n"
+        "    }\n"
+        "    float alpha = line + (1.0 - line) * fill;\n"
+        "    if (alpha < 1.0 / 512.0) {\n"
+        "        discard;\n" // Leaves the depth buffer alone, for the shapes underneath
+        "    }\n"
+        "    gl_FragColor = vec4(line * lineColor + (1.0 - line) * fill * gl_Color.rgb, alpha);\n" // Premultiplied
+        "}\n"
+    };
+    const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    GLuint program = glCreateProgram();
+    bool ok = program != 0;
+    for (int i = 0; i < 2 && ok; i++) {
+        GLuint shader = glCreateShader(types[i]);
+        glShaderSource(shader, 1, &sources[i], nullptr);
+        glCompileShader(shader);
+        GLint compiled = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            char log[1024] = "";
+            glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+            cerr << "Could not compile the " << (i == 0 ? "vertex" : "fragment") << " shader of the analytic shapes:\n" << log << endl;
+            ok = false;
+        }
+        glAttachShader(program, shader);
+        glDeleteShader(shader); // Deleted with the program
+    }
+    if (ok) {
+        glLinkProgram(program);
+        GLint linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            char log[1024] = "";
+            glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+            cerr << "Could not link the shader program of the analytic shapes:\n" << log << endl;
+            ok = false;
+        }
+    }
+    if (!ok) {
+        glDeleteProgram(program);
+        return false;
+    }
+    glUseProgram(program);
+    glUniform1f(glGetUniformLocation(program, "halfWidth"), lineWidth / 2);
+    glUseProgram(0);
+    shapeProgram = program;
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+// Below is the picking index
+
+// What: Function to combine two transforms
+// Input: outer, inner - the transforms, inner being applied first
+// Output: The transform that applies inner, then outer
+// Action: The function multiplies the two matrices, like multiplyTransform() does with the current transform.
+// Caller: recordPickShapes()
+Transform2D composeTransforms(const Transform2D& outer, const Transform2D& inner) {
+    Transform2D t;
+    t.a = outer.a * inner.a + outer.c * inner.b;
+    t.b = outer.b * inner.a + outer.d * inner.b;
+    t.c = outer.a * inner.c + outer.c * inner.d;
+    t.d = outer.b * inner.c + outer.d * inner.d;
+    t.tx = outer.a * inner.tx + outer.c * inner.ty + outer.tx;
+    t.ty = outer.b * inner.tx + outer.d * inner.ty + outer.ty;
+    return t;
+}
+
+// What: Function to invert a transform
+// Input: t - a transform with a nonzero determinant
+// Output: The transform that undoes t
+// Action: The function inverts the 2x2 matrix and moves the translation back through it.
+// Caller: recordPickShapes()
+Transform2D invertTransform(const Transform2D& t) {
+    float determinant = t.a * t.d - t.b * t.c;
+    Transform2D inverse;
+    inverse.a = t.d / determinant;
+    inverse.b = -t.b / determinant;
+    inverse.c = -t.c / determinant;
+    inverse.d = t.a / determinant;
+    inverse.tx = -(inverse.a * t.tx + inverse.c * t.ty);
+    inverse.ty = -(inverse.b * t.tx + inverse.d * t.ty);
+    return inverse;
+}
+
+// What: Function to record a pickable shape
+//       The shape is kept with the mesh, like its vertices, so a cached mesh brings its shapes along every time it is
+//       submitted. Outlines and lines cannot be picked; a click on them finds the shape underneath or the background.
+// Input: kind - PICK_ELLIPSE, PICK_RECTANGLE or PICK_SECTOR
+//        center coordinates (xCenter, yCenter), radii or half the sides (xRadius, yRadius)
+//        start and end angles of a sector, in degrees
+// Output: None
+// Action: The function stores the transform from mesh coordinates onto the unit circle or square, and for a sector
+//         the directions of its edges, with the mesh being recorded (or the shape being drawn outside any mesh).
+// Caller: drawEllipse(), drawFilledArc() and drawRectangle()
+void addPickShape(int kind, float xCenter, float yCenter, float xRadius, float yRadius, int startAngle, int endAngle) {
+    if (xRadius <= 0 || yRadius <= 0) {
+        return; // Nothing to hit
+    }
+    PickShape shape = {};
+    shape.kind = (PickShapeKind)kind;
+    shape.toUnit = { 1 / xRadius, 0, 0, 1 / yRadius, -xCenter / xRadius, -yCenter / yRadius };
+    if (kind == PICK_SECTOR) {
+        // The sweep runs counterclockwise from the smaller angle to the larger one, whichever way it was drawn
+        int first = min(startAngle, endAngle), last = max(startAngle, endAngle);
+        if (last - first >= 360) {
+            shape.kind = PICK_ELLIPSE;
+        }
+        shape.startX = (float)cos(first * PI / 180);
+        shape.startY = (float)sin(first * PI / 180);
+        shape.endX = (float)cos(last * PI / 180);
+        shape.endY = (float)sin(last * PI / 180);
+        shape.reflex = last - first > 180;
+    }
+    (recordingMesh ? *recordingMesh : dynamicMesh).pickShapes.push_back(shape);
+}
+
+// What: Function to add the shapes of a submitted mesh to the pick index
+// Input: submission - the mesh and the transform, part and character it was drawn with
+// Output: None
+// Action: For every pickable shape of the mesh, the function stores the transform from world coordinates onto the
+//         unit shape, the world bounds of the shape, and the part and the character, in pickShapes.
+// Caller: buildPickIndex()
+void recordPickShapes(const PickSubmission& submission) {
+    const Transform2D& t = submission.transform;
+    if (t.a * t.d - t.b * t.c == 0) {
+        return; // Squashed flat
+    }
+    const PickShape* shapes = submission.mesh ? submission.mesh->pickShapes.data() : &framePickShapes[submission.first];
+    int count = submission.mesh ? (int)submission.mesh->pickShapes.size() : submission.count;
+    Transform2D toMesh = invertTransform(t);
+    for (int i = 0; i < count; i++) {
+        const PickShape& meshShape = shapes[i];
+        PickShape shape = meshShape;
+        shape.toUnit = composeTransforms(meshShape.toUnit, toMesh);
+        shape.part = submission.part;
+        shape.character = submission.character;
+
+        // The unit shape taken to the world: a rectangle's corners or an ellipse's widest points give the bounds
+        Transform2D f = composeTransforms(t, invertTransform(meshShape.toUnit));
+        float halfWidth = shape.kind == PICK_RECTANGLE ? fabs(f.a) + fabs(f.c) : sqrt(f.a * f.a + f.c * f.c);
+        float halfHeight = shape.kind == PICK_RECTANGLE ? fabs(f.b) + fabs(f.d) : sqrt(f.b * f.b + f.d * f.d);
+        shape.x0 = f.tx - halfWidth;
+        shape.x1 = f.tx + halfWidth;
+        shape.y0 = f.ty - halfHeight;
+        shape.y1 = f.ty + halfHeight;
+        pickShapes.push_back(shape);
+    }
+}
+
+// What: Function to test a point against a pickable shape
+// Input: shape - the shape, x, y - the point in world coordinates
+// Output: true if the point is inside the shape or on its border
+// Action: The function maps the point onto the unit shape: a rectangle holds it if both coordinates are within
+//         [-1, 1], an ellipse if it is within the unit circle, and a sector if it also lies between the two edges.
+// Caller: pickAt() and runPickBenchmark()
+bool pickShapeContains(const PickShape& shape, float x, float y) {
+    const Transform2D& t = shape.toUnit;
+    float u = t.a * x + t.c * y + t.tx, v = t.b * x + t.d * y + t.ty;
+    if (shape.kind == PICK_RECTANGLE) {
+        return fabs(u) <= 1 && fabs(v) <= 1;
+    }
+    if (u * u + v * v > 1) {
+        return false;
+    }
+    if (shape.kind == PICK_ELLIPSE) {
+        return true;
+    }
+    bool afterStart = shape.startX * v - shape.startY * u >= 0; // Counterclockwise from the first edge
+    bool beforeEnd = u * shape.endY - v * shape.endX >= 0; // Clockwise from the last edge
+    return shape.reflex ? afterStart || beforeEnd : afterStart && beforeEnd;
+}
+
+// What: Functions to find the column and the row of the pick grid a point falls in
+// Input: x or y in world coordinates
+// Output: The column or row, outside [0, pickColumns) or [0, pickRows) for points outside the viewing volume
+// Caller: buildPickIndex() and pickAt(), which must round the same way
+int pickColumn(float x) {
+    return (int)floor((x - clippingPlanLeft) * pickColumns / (clippingPlanRight - clippingPlanLeft));
+}
+int pickRow(float y) {
+    return (int)floor((y - clippingPlanBottom) * pickRows / (clippingPlanTop - clippingPlanBottom));
+}
+
+// What: Function to build the pick index of the displayed frame
+//       The scene is not rendered to a pick buffer, and not drawn again either: drawScene() kept every mesh with
+//       pickable shapes it submitted, with its transform, so the shapes go through exactly the transforms the frame
+//       on screen was drawn with: the character's scale, the leg scales and the balloon rotations, and in crowd
+//       mode the position of every character and the culling, even if the animation has moved on since. The grid
+//       covers the viewing volume with about one cell per shape, and every cell lists the shapes whose bounds
+//       overlap it in draw order.
+// Input: None (uses framePickSubmissions)
+// Output: None
+// Action: The function fills pickShapes, counts the shapes of every cell, turns the counts into offsets into
+//         pickCellShapes and fills it, and marks the index valid.
+// Caller: pickAt()
+void buildPickIndex() {
+    pickShapes.clear();
+    for (const PickSubmission& submission : framePickSubmissions) {
+        recordPickShapes(submission);
+    }
+
+    int count = (int)pickShapes.size();
+    double aspect = (clippingPlanRight - clippingPlanLeft) / (clippingPlanTop - clippingPlanBottom);
+    pickColumns = max(1, min(PICK_GRID_LIMIT, (int)ceil(sqrt(count * aspect))));
+    pickRows = max(1, min(PICK_GRID_LIMIT, (int)ceil(count / (double)pickColumns)));
+    auto cellRange = [](const PickShape& shape, int& column0, int& row0, int& column1, int& row1) {
+        column0 = max(0, pickColumn(shape.x0));
+        row0 = max(0, pickRow(shape.y0));
+        column1 = min(pickColumns - 1, pickColumn(shape.x1));
+        row1 = min(pickRows - 1, pickRow(shape.y1));
+    };
+
+    // Count the shapes of every cell, then make the counts offsets
+    int column0, row0, column1, row1;
+    pickCellStart.assign((size_t)pickColumns * pickRows + 1, 0);
+    for (const PickShape& shape : pickShapes) {
+        cellRange(shape, column0, row0, column1, row1);
+        for (int row = row0; row <= row1; row++) {
+            for (int column = column0; column <= column1; column++) {
+                pickCellStart[row * pickColumns + column + 1]++;
+            }
+        }
+    }
+    for (size_t i = 1; i < pickCellStart.size(); i++) {
+        pickCellStart[i] += pickCellStart[i - 1];
+    }
+
+    // Fill the cells, in draw order
+    int* next = frameArena.allocate<int>(pickCellStart.size() - 1);
+    copy(pickCellStart.begin(), pickCellStart.end() - 1, next);
+    pickCellShapes.resize(pickCellStart.back());
+    for (int i = 0; i < count; i++) {
+        cellRange(pickShapes[i], column0, row0, column1, row1);
+        for (int row = row0; row <= row1; row++) {
+            for (int column = column0; column <= column1; column++) {
+                pickCellShapes[next[row * pickColumns + column]++] = i;
+            }
+        }
+    }
+    pickIndexValid = true;
+}
+
+// What: Function to find the shape under a point
+//       Only the cell holding the point is searched, from its last shape to its first, so the first shape that holds
+//       the point is the one drawn on top.
+// Input: x, y - the point in world coordinates
+// Output: The index of the shape in pickShapes, or -1 if the point is on the background
+// Action: The function builds the pick index if the frame changed since it was built, then tests the bounds and
+//         the exact outline of the shapes in the point's cell.
+// Caller: pickClick() and runPickBenchmark()
+int pickAt(float x, float y) {
+    if (!pickIndexValid) {
+        buildPickIndex();
+    }
+    int column = pickColumn(x), row = pickRow(y);
+    if (column < 0 || column >= pickColumns || row < 0 || row >= pickRows) {
+        return -1;
+    }
+    int cell = row * pickColumns + column;
+    for (int i = pickCellStart[cell + 1] - 1; i >= pickCellStart[cell]; i--) {
+        const PickShape& shape = pickShapes[pickCellShapes[i]];
+        if (x >= shape.x0 && x <= shape.x1 && y >= shape.y0 && y <= shape.y1 && pickShapeContains(shape, x, y)) {
+            return pickCellShapes[i];
+        }
+    }
+    return -1;
+}
+
+// What: Function to find what a click hit
+//       Every click redraws the window, so a click is usually the only pick of its frame. Building the index for it
+//       would cost more than the pick saves: the meshes of the frame are searched directly instead, from the last
+//       submitted to the first, with the point taken into each mesh once.
+// Input: x, y - the point in world coordinates
+//        character, part - receive the crowd character and the part of the character hit
+// Output: true if a shape was hit, false if the point is on the background
+// Action: If the index of the displayed frame is built, the function asks pickAt(). Otherwise it maps the point into
+//         every mesh of framePickSubmissions and tests the mesh's shapes from the last to the first.
+// Caller: mouse() and runPickBenchmark()
+bool pickClick(float x, float y, int& character, int& part) {
+    if (pickIndexValid) {
+        int hit = pickAt(x, y);
+        if (hit >= 0) {
+            character = pickShapes[hit].character;
+            part = pickShapes[hit].part;
+        }
+        return hit >= 0;
+    }
+    for (size_t i = framePickSubmissions.size(); i-- > 0;) {
+        const PickSubmission& submission = framePickSubmissions[i];
+        const Transform2D& t = submission.transform;
+        if (t.a * t.d - t.b * t.c == 0) {
+            continue; // Squashed flat
+        }
+        Transform2D toMesh = invertTransform(t);
+        float meshX = toMesh.a * x + toMesh.c * y + toMesh.tx, meshY = toMesh.b * x + toMesh.d * y + toMesh.ty;
+        const PickShape* shapes = submission.mesh ? submission.mesh->pickShapes.data() : &framePickShapes[submission.first];
+        int count = submission.mesh ? (int)submission.mesh->pickShapes.size() : submission.count;
+        for (int j = count - 1; j >= 0; j--) {
+            if (pickShapeContains(shapes[j], meshX, meshY)) {
+                character = submission.character;
+                part = submission.part;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+// Below is the scene file
+
+// What: Function to load a scene
+//       A text scene is compiled once into a binary blob saved next to it as "<file>.bin". Later runs map that cache
+//       into memory and draw straight from it: nothing is parsed or copied, and the operating system only reads the
+//       pages that are touched. The cache is compiled again when the text's size or modification time changed.
+//       A compiled blob can also be given directly.
+// Input: path - the text scene or a compiled blob
+// Output: true if a scene was loaded, false otherwise
+// Action: The function maps the file; if it is a blob it is used as is. Otherwise the function maps the cache and
+//         uses it if it matches the text, or else compiles the text, writes the cache and maps it. The cache is
+//         written to "<file>.bin.tmp" and renamed over the old one, so another process that has the old one mapped
+//         keeps its pages, and a crash while writing leaves no short cache behind. If the cache cannot be written,
+//         the compiled blob is used from memory.
+// Caller: main() and runSceneBenchmark()
+bool loadScene(const char* path) {
+    closeScene();
+    struct stat source;
+    size_t size = 0;
+    const unsigned char* data = stat(path, &source) == 0 ? mapSceneFile(path, size) : nullptr;
+    if (!data) {
+        cerr << "Cannot read the scene \"" << path << "\"." << endl;
+        return false;
+    }
+    if (size >= sizeof(SceneHeader) && memcmp(data, SCENE_MAGIC, sizeof(SCENE_MAGIC)) == 0) {
+        if (openSceneBlob(data, size)) {
+            return true;
+        }
+        cerr << "\"" << path << "\" is not a valid compiled scene." << endl;
+        closeScene();
+        return false;
+    }
+    closeScene();
+
+    // 1. The cache, if it was compiled from this text
+    string cachePath = string(path) + ".bin";
+    data = mapSceneFile(cachePath.c_str(), size);
+    if (data && openSceneBlob(data, size) && scene->sourceSize == (uint64_t)source.st_size && scene->sourceTime == fileModificationTime(source)) {
+        return true;
+    }
+    closeScene();
+
+    // 2. Compile the text and cache it
+    vector<uint64_t> blob;
+    if (!compileScene(path, source, blob)) {
+        return false;
+    }
+    size = ((const SceneHeader*)blob.data())->size;
+    string temporaryPath = cachePath + ".tmp";
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    bool cached = file && fwrite(blob.data(), 1, size, file) == size;
+    cached = file && fclose(file) == 0 && cached;
+#ifdef _WIN32
+    if (cached) {
+        remove(cachePath.c_str()); // rename() does not replace a file here
+    }
+#endif
+    cached = cached && rename(temporaryPath.c_str(), cachePath.c_str()) == 0;
+    if (!cached) {
+        remove(temporaryPath.c_str());
+    }
+    if (cached && (data = mapSceneFile(cachePath.c_str(), size)) != nullptr && openSceneBlob(data, size)) {
+        return true;
+    }
+    closeScene();
+    cerr << "Could not write the scene cache \"" << cachePath << "\", the scene is compiled every time." << endl;
+    sceneBlob = move(blob);
+    return openSceneBlob((const unsigned char*)sceneBlob.data(), size);
+}
+
+// What: Function to release the loaded scene
+// Input: None
+// Output: None
+// Action: The function unmaps or frees the blob, forgets its meshes and goes back to the built-in character.
+// Caller: loadScene() and runSceneBenchmark()
+void closeScene() {
+#ifndef _WIN32
+    if (sceneMapping) {
+        munmap(sceneMapping, sceneMappingSize);
+    }
+#endif
+    sceneMapping = nullptr;
+    sceneMappingSize = 0;
+    sceneBlob.clear();
+    scene = nullptr;
+    sceneNodes = nullptr;
+    sceneTransforms = nullptr;
+    sceneShapes = nullptr;
+    sceneMeshes.clear();
+    sceneNodeTransforms.clear();
+    framePickSubmissions.clear(); // They may point into the meshes
+    pickIndexValid = false;
+}
+
+// What: Function to read when a file was last modified
+//       Seconds are not enough to tell a cache from the text it was compiled from: an editor or a script can save a
+//       change of the same length within the second the cache was written.
+// Input: status - what stat() returned for the file
+// Output: The modification time in nanoseconds on Linux, in seconds elsewhere
+// Caller: loadScene() and compileScene()
+int64_t fileModificationTime(const struct stat& status) {
+#ifdef __linux__
+    return (int64_t)status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+#else
+    return (int64_t)status.st_mtime;
+#endif
+}
+
+// What: Function to map a file into memory
+// Input: path - the file, size - set to its size
+// Output: The file's bytes, valid until closeScene(), or nullptr on failure
+// Action: The function maps the file read-only with mmap(). Without mmap() (Windows) it reads it into sceneBlob.
+// Caller: loadScene()
+const unsigned char* mapSceneFile(const char* path, size_t& size) {
+#ifndef _WIN32
+    int file = open(path, O_RDONLY);
+    if (file < 0) {
+        return nullptr;
+    }
+    struct stat status;
+    void* mapping = MAP_FAILED;
+    if (fstat(file, &status) == 0 && status.st_size > 0) {
+        mapping = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    close(file); // The mapping stays valid
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+    sceneMapping = mapping;
+    sceneMappingSize = size = (size_t)status.st_size;
+    return (const unsigned char*)mapping;
+#else
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return nullptr;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    sceneBlob.assign((max(0L, length) + 7) / 8, 0);
+    bool ok = length > 0 && fread(sceneBlob.data(), 1, (size_t)length, file) == (size_t)length;
+    fclose(file);
+    size = (size_t)max(0L, length);
+    return ok ? (const unsigned char*)sceneBlob.data() : nullptr;
+#endif
+}
+
+// What: Function to check the numbers of a scene shape
+//       drawArc() and drawFilledArc() convert the angles to int and sweep them step by step, and a color becomes a
+//       byte, so an infinite, huge or out-of-range number would be undefined behaviour or an endless mesh when drawn.
+// Input: shape - the shape, with a valid kind
+// Output: An empty string if the shape can be drawn, otherwise what is wrong with it
+// Caller: compileScene() and openSceneBlob()
+string sceneShapeProblem(const SceneShape& shape) {
+    for (int i = 0; i < 6; i++) {
+        bool angle = i >= 4; // The start and end of an arc, or the offset of a spoke; a spoke's p[5] is 0
+        if (!(fabs(shape.p[i]) <= (angle ? SCENE_ANGLE_LIMIT : SCENE_COORDINATE_LIMIT))) {
+            return angle ? "an angle must be a number from -3600 to 3600" : "a coordinate or radius must be a number from -1000 to 1000";
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        if (!(shape.color[c] >= 0 && shape.color[c] <= 1)) {
+            return "a color component must be a number from 0 to 1";
+        }
+    }
+    return "";
+}
+
+// What: Function to check the numbers of a scene transform
+// Input: transform - the transform, with a valid kind
+// Output: An empty string if the transform can be applied, otherwise what is wrong with it
+// Caller: compileScene() and openSceneBlob()
+string sceneTransformProblem(const SceneTransform& transform) {
+    double limit = transform.kind == SCENE_ROTATE ? SCENE_ANGLE_LIMIT : SCENE_COORDINATE_LIMIT;
+    if (!(fabs(transform.value[0]) <= limit && fabs(transform.value[1]) <= limit)) {
+        return transform.kind == SCENE_ROTATE ? "a rotation must be a number from -3600 to 3600" : "a translation or scale must be a number from -1000 to 1000";
+    }
+    return "";
+}
+
+// What: Function to check a compiled scene and make it the one drawn
+//       The records are used in place, so every index in them is checked once here rather than on every frame.
+// Input: data, size - the blob, 8-byte aligned
+// Output: true if the blob is a valid scene of this version, false otherwise
+// Action: The function checks the header, that every array lies inside the blob, that every parent comes before its
+//         child, that every range, kind and channel is valid and that every number is in the range the compiler
+//         accepts (a blob need not come from the compiler), then points scene and its arrays into the blob and makes
+//         room for the meshes of its nodes.
+// Caller: loadScene()
+bool openSceneBlob(const unsigned char* data, size_t size) {
+    const SceneHeader* header = (const SceneHeader*)data;
+    if (size < sizeof(SceneHeader) || memcmp(header->magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) != 0
+        || header->version != SCENE_VERSION || header->size != size) {
+        return false;
+    }
+    auto fits = [size](uint32_t offset, uint32_t count, size_t recordSize) {
+        return offset % 8 == 0 && offset <= size && count <= (size - offset) / recordSize;
+    };
+    if (!fits(header->nodeOffset, header->nodeCount, sizeof(SceneNode))
+        || !fits(header->transformOffset, header->transformCount, sizeof(SceneTransform))
+        || !fits(header->shapeOffset, header->shapeCount, sizeof(SceneShape))) {
+        return false;
+    }
+    const SceneNode* nodes = (const SceneNode*)(data + header->nodeOffset);
+    const SceneTransform* transforms = (const SceneTransform*)(data + header->transformOffset);
+    const SceneShape* shapes = (const SceneShape*)(data + header->shapeOffset);
+    for (uint32_t i = 0; i < header->nodeCount; i++) {
+        const SceneNode& node = nodes[i];
+        if (node.parent < -1 || node.parent >= (int32_t)i || node.fill < PICK_BODY || node.fill > PICK_RIGHT_BALLOON
+            || node.firstTransform > header->transformCount || node.transformCount > header->transformCount - node.firstTransform
+            || node.firstShape > header->shapeCount || node.fixedShapes > header->shapeCount - node.firstShape
+            || node.spokes > header->shapeCount - node.firstShape - node.fixedShapes) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->transformCount; i++) {
+        const SceneTransform& transform = transforms[i];
+        if (transform.kind > SCENE_SCALE || transform.channel[0] < -1 || transform.channel[0] >= CHANNEL_COUNT
+            || transform.channel[1] < -1 || transform.channel[1] >= CHANNEL_COUNT || !sceneTransformProblem(transform).empty()) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < header->shapeCount; i++) {
+        if (shapes[i].kind >= SCENE_SHAPE_KINDS || shapes[i].channel < -1 || shapes[i].channel >= CHANNEL_COUNT
+            || (shapes[i].kind == SCENE_SPOKE && shapes[i].channel < 0) || !sceneShapeProblem(shapes[i]).empty()) {
+            return false;
+        }
+    }
+    scene = header;
+    sceneNodes = nodes;
+    sceneTransforms = transforms;
+    sceneShapes = shapes;
+    sceneMeshes.assign(header->nodeCount, Mesh());
+    sceneNodeTransforms.resize(header->nodeCount);
+    return true;
+}
+
+// What: Function to compile a text scene
+//       The text lists nodes, each followed by its shapes; see scenes/doraemon.scene for the format. Numbers are read
+//       as doubles, like the literals in drawDoraemon(), so a scene describing the built-in character draws exactly
+//       the same pixels. Numbers must be finite and within SCENE_COORDINATE_LIMIT, SCENE_ANGLE_LIMIT or 0 to 1 for a
+//       color. A node's fixed shapes are stored first and its spokes last, since the fixed shapes become one cached
+//       mesh.
+// Input: path - the text scene, source - its size and modification time, blob - filled with the compiled scene
+// Output: true on success, false after printing the file, line and problem of the first error
+// Action: The function reads the file, splits every line into words (from a '#' on, a line is a comment), turns node
+//         lines into nodes and transforms and shape lines into shapes, and writes the header and the arrays to blob.
+// Caller: loadScene()
+bool compileScene(const char* path, const struct stat& source, vector<uint64_t>& blob) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        cerr << "Cannot read the scene \"" << path << "\"." << endl;
+        return false;
+    }
+    string text;
+    char buffer[65536];
+    for (size_t count; (count = fread(buffer, 1, sizeof(buffer), file)) > 0;) {
+        text.append(buffer, count);
+    }
+    fclose(file);
+
+    struct NodeShapes {
+        vector<SceneShape> fixed, spokes;
+    };
+    vector<SceneNode> nodes;
+    vector<string> nodeNames;
+    vector<SceneTransform> transforms;
+    vector<NodeShapes> nodeShapes;
+    int lineNumber = 0;
+    string message;
+    auto fail = [&](const string& problem) {
+        cerr << path << ":" << lineNumber << ": " << problem << endl;
+        return false;
+    };
+    // A number, or "@channel" when channel is not nullptr
+    auto parseValue = [](const string& word, double& value, int32_t* channel) {
+        if (channel) {
+            *channel = -1;
+        }
+        if (word[0] == '@') {
+            for (int i = 0; i < CHANNEL_COUNT && channel; i++) {
+                if (word.compare(1, string::npos, SCENE_CHANNEL_NAMES[i]) == 0) {
+                    *channel = i;
+                    value = 0;
+                    return true;
+                }
+            }
+            return false;
+        }
+        char* end = nullptr;
+        value = strtod(word.c_str(), &end);
+        return *end == '\0' && isfinite(value);
+    };
+
+    for (size_t start = 0; start < text.size(); ) {
+        size_t end = text.find('\n', start);
+        end = end == string::npos ? text.size() : end;
+        string line = text.substr(start, min(text.find('#', start), end) - start);
+        start = end + 1;
+        lineNumber++;
+        vector<string> words;
+        for (size_t i = line.find_first_not_of(" \t\r"); i != string::npos; i = line.find_first_not_of(" \t\r", i)) {
+            size_t wordEnd = line.find_first_of(" \t\r", i);
+            words.push_back(line.substr(i, wordEnd - i));
+            i = wordEnd;
+        }
+        if (words.empty()) {
+            continue;
+        }
+
+        // node <name> [parent <name>] [translate x y] [rotate degrees] [scale x y] [fill leftBalloon|rightBalloon]
+        if (words[0] == "node") {
+            if (words.size() < 2) {
+                return fail("a node needs a name");
+            }
+            SceneNode node = {};
+            node.parent = -1;
+            node.firstTransform = (uint32_t)transforms.size();
+            for (size_t i = 2; i < words.size(); ) {
+                const string& keyword = words[i];
+                int values = keyword == "translate" || keyword == "scale" ? 2 : keyword == "rotate" || keyword == "parent" || keyword == "fill" ? 1 : -1;
+                if (values < 0 || i + values >= words.size()) {
+                    return fail(values < 0 ? "unknown node attribute \"" + keyword + "\"" : "\"" + keyword + "\" needs " + to_string(values) + " value(s)");
+                }
+                if (keyword == "parent") {
+                    auto parent = find(nodeNames.begin(), nodeNames.end(), words[i + 1]);
+                    if (parent == nodeNames.end()) {
+                        return fail("the parent \"" + words[i + 1] + "\" must be a node defined earlier");
+                    }
+                    node.parent = (int32_t)(parent - nodeNames.begin());
+                }
+                else if (keyword == "fill") {
+                    if (words[i + 1] != "leftBalloon" && words[i + 1] != "rightBalloon") {
+                        return fail("a node is filled with \"leftBalloon\" or \"rightBalloon\"");
+                    }
+                    node.fill = words[i + 1] == "leftBalloon" ? PICK_LEFT_BALLOON : PICK_RIGHT_BALLOON;
+                }
+                else {
+                    SceneTransform transform = {};
+                    transform.kind = keyword == "translate" ? SCENE_TRANSLATE : keyword == "rotate" ? SCENE_ROTATE : SCENE_SCALE;
+                    transform.channel[1] = -1;
+                    for (int v = 0; v < values; v++) {
+                        if (!parseValue(words[i + 1 + v], transform.value[v], &transform.channel[v])) {
+                            return fail("\"" + words[i + 1 + v] + "\" is neither a finite number nor one of @angle, @scaleLeftLeg, @scaleRightLeg, @balloonAngle");
+                        }
+                    }
+                    string problem = sceneTransformProblem(transform);
+                    if (!problem.empty()) {
+                        return fail(problem);
+                    }
+                    transforms.push_back(transform);
+                }
+                i += 1 + values;
+            }
+            node.transformCount = (uint32_t)transforms.size() - node.firstTransform;
+            nodes.push_back(node);
+            nodeNames.push_back(words[1]);
+            nodeShapes.emplace_back();
+            continue;
+        }
+
+        // ellipse cx cy rx ry r g b [nooutline]    arc / filledArc cx cy rx ry start end r g b
+        // line x1 y1 x2 y2 r g b    rect x1 y1 x2 y2 r g b [nooutline]    spoke cx cy rx ry offset @channel r g b
+        const char* const kinds[SCENE_SHAPE_KINDS] = { "ellipse", "arc", "filledArc", "line", "rect", "spoke" };
+        const int parameters[SCENE_SHAPE_KINDS] = { 4, 6, 6, 4, 4, 6 };
+        int kind = (int)(find(kinds, kinds + SCENE_SHAPE_KINDS, words[0]) - kinds);
+        if (kind == SCENE_SHAPE_KINDS) {
+            return fail("unknown shape \"" + words[0] + "\"");
+        }
+        if (nodes.empty()) {
+            return fail("shapes belong to a node, start one with \"node <name>\" first");
+        }
+        SceneShape shape = {};
+        shape.kind = kind;
+        shape.channel = -1;
+        size_t count = parameters[kind] + 3;
+        bool outlined = kind == SCENE_ELLIPSE || kind == SCENE_RECTANGLE;
+        shape.outline = outlined;
+        if (outlined && words.size() == count + 2 && words.back() == "nooutline") {
+            shape.outline = 0;
+        }
+        else if (words.size() != count + 1) {
+            return fail("\"" + words[0] + "\" takes " + to_string(count) + " numbers" + (outlined ? " and an optional \"nooutline\"" : ""));
+        }
+        for (size_t i = 0; i < count; i++) {
+            double value = 0;
+            bool channelValue = kind == SCENE_SPOKE && i == 5; // A spoke turns with its channel
+            if (!parseValue(words[i + 1], value, channelValue ? &shape.channel : nullptr) || (channelValue && shape.channel < 0)) {
+                return fail("\"" + words[i + 1] + "\" is not " + (channelValue ? "a channel" : "a finite number"));
+            }
+            if (i >= (size_t)parameters[kind] && !(value >= 0 && value <= 1)) {
+                return fail("a color component must be a number from 0 to 1"); // Checked before it is narrowed to float
+            }
+            if (i < (size_t)parameters[kind]) {
+                shape.p[i] = value;
+            }
+            else {
+                shape.color[i - parameters[kind]] = (float)value;
+            }
+        }
+        string problem = sceneShapeProblem(shape);
+        if (!problem.empty()) {
+            return fail(problem);
+        }
+        (kind == SCENE_SPOKE ? nodeShapes.back().spokes : nodeShapes.back().fixed).push_back(shape);
+    }
+
+    // Lay out the blob: the header, then the nodes, the transforms and the shapes
+    vector<SceneShape> shapes;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        nodes[i].firstShape = (uint32_t)shapes.size();
+        nodes[i].fixedShapes = (uint32_t)nodeShapes[i].fixed.size();
+        nodes[i].spokes = (uint32_t)nodeShapes[i].spokes.size();
+        shapes.insert(shapes.end(), nodeShapes[i].fixed.begin(), nodeShapes[i].fixed.end());
+        shapes.insert(shapes.end(), nodeShapes[i].spokes.begin(), nodeShapes[i].spokes.end());
+    }
+    SceneHeader header = {};
+    memcpy(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+    header.version = SCENE_VERSION;
+    header.nodeCount = (uint32_t)nodes.size();
+    header.transformCount = (uint32_t)transforms.size();
+    header.shapeCount = (uint32_t)shapes.size();
+    header.nodeOffset = sizeof(SceneHeader);
+    header.transformOffset = header.nodeOffset + header.nodeCount * sizeof(SceneNode);
+    header.shapeOffset = header.transformOffset + header.transformCount * sizeof(SceneTransform);
+    header.size = header.shapeOffset + header.shapeCount * sizeof(SceneShape);
+    header.sourceSize = (uint64_t)source.st_size;
+    header.sourceTime = fileModificationTime(source);
+    blob.assign(header.size / 8, 0);
+    unsigned char* bytes = (unsigned char*)blob.data();
+    memcpy(bytes, &header, sizeof(header));
+    memcpy(bytes + header.nodeOffset, nodes.data(), nodes.size() * sizeof(SceneNode));
+    memcpy(bytes + header.transformOffset, transforms.data(), transforms.size() * sizeof(SceneTransform));
+    memcpy(bytes + header.shapeOffset, shapes.data(), shapes.size() * sizeof(SceneShape));
+    return true;
+}
+
+// What: Function to draw the character of the loaded scene
+//       It does what drawDoraemon(), drawBambooCopter() and drawBalloons() do, from the records of the blob: every
+//       node starts from its parent's transform, applies its own transforms with the same transform functions, and
+//       submits its fixed shapes from the mesh cache, so the frames are the same as with the built-in character.
+// Input: None (uses the loaded scene, animation and balloonFill)
+// Output: None
+// Action: For every node in order, the function computes its transform, draws its fixed shapes (filled with a
+//         balloon's color if the node says so) and then its spokes, and finally restores the current transform.
+// Caller: drawCharacter()
+void drawSceneCharacter() {
+    const float channels[CHANNEL_COUNT] = { animation.angle, animation.scaleLeftLeg, animation.scaleRightLeg, animation.balloonAngle };
+    auto value = [&channels](int32_t channel, double constant) {
+        return channel < 0 ? (float)constant : channels[channel];
+    };
+    Transform2D character = currentTransform;
+    for (uint32_t i = 0; i < scene->nodeCount; i++) {
+        const SceneNode& node = sceneNodes[i];
+        currentTransform = node.parent < 0 ? character : sceneNodeTransforms[node.parent];
+        for (uint32_t t = node.firstTransform; t < node.firstTransform + node.transformCount; t++) {
+            const SceneTransform& transform = sceneTransforms[t];
+            float x = value(transform.channel[0], transform.value[0]), y = value(transform.channel[1], transform.value[1]);
+            if (transform.kind == SCENE_TRANSLATE) {
+                translateTransform(x, y);
+            }
+            else if (transform.kind == SCENE_ROTATE) {
+                rotateTransform(x);
+            }
+            else {
+                scaleTransform(x, y);
+            }
+        }
+        sceneNodeTransforms[i] = currentTransform;
+
+        pickPart = (PickPart)node.fill;
+        if (node.fixedShapes > 0) {
+            const GLfloat* fill = node.fill == PICK_LEFT_BALLOON ? balloonFill : node.fill == PICK_RIGHT_BALLOON ? balloonFill + 3 : nullptr;
+            tessellatingNode = &node;
+            drawCachedMesh(sceneMeshes[i], tessellateSceneNode, fill);
+            tessellatingNode = nullptr;
+        }
+        // A spoke runs from the center of an ellipse to the point of its outline at the angle offset + channel, in radians
+        for (uint32_t s = node.firstShape + node.fixedShapes; s < node.firstShape + node.fixedShapes + node.spokes; s++) {
+            const SceneShape& spoke = sceneShapes[s];
+            float turn = (float)spoke.p[4] + channels[spoke.channel];
+            drawLine(spoke.p[0], spoke.p[1], spoke.p[0] + spoke.p[2] * cos(turn), spoke.p[1] + spoke.p[3] * sin(turn), spoke.color[0], spoke.color[1], spoke.color[2]);
+            PROFILE_COUNT(COUNT_TRIG, 2);
+        }
+    }
+    currentTransform = character;
+    pickPart = PICK_BODY;
+}
+
+// What: Function to tessellate the fixed shapes of a scene node
+// Input: None (uses tessellatingNode)
+// Output: None
+// Action: The function calls the draw function of every fixed shape of the node with the shape's arguments.
+// Caller: drawCachedMesh(), from drawSceneCharacter()
+void tessellateSceneNode() {
+    const SceneNode& node = *tessellatingNode;
+    for (uint32_t s = node.firstShape; s < node.firstShape + node.fixedShapes; s++) {
+        const SceneShape& shape = sceneShapes[s];
+        const double* p = shape.p;
+        const float* c = shape.color;
+        switch (shape.kind) {
+        case SCENE_ELLIPSE:
+            drawEllipse(p[0], p[1], p[2], p[3], c[0], c[1], c[2], shape.outline != 0);
+            break;
+        case SCENE_ARC:
+            drawArc(p[0], p[1], p[2], p[3], p[4], p[5], c[0], c[1], c[2]);
+            break;
+        case SCENE_FILLED_ARC:
+            // Any sweep: the CPU rasterizer cuts a fan wider than 180 degrees into convex pieces, see binFramePolygons()
+            drawFilledArc(p[0], p[1], p[2], p[3], p[4], p[5], c[0], c[1], c[2]);
+            break;
+        case SCENE_LINE:
+            drawLine(p[0], p[1], p[2], p[3], c[0], c[1], c[2]);
+            break;
+        case SCENE_RECTANGLE:
+            drawRectangle(p[0], p[1], p[2], p[3], c[0], c[1], c[2], shape.outline != 0);
+            break;
+        }
+    }
+}
+
+
+// Below is the text renderer
+//   glutBitmapCharacter() draws one character at a time through the raster path (a glBitmap() each), which cannot
+//   be batched and needs a GLUT window. Instead, the glyphs of GLUT's Helvetica 18 are stored below and packed once
+//   into an atlas texture. drawText() turns strings into quads of that texture, and flushText() draws all the text
+//   of a frame with one glDrawArrays. The quads lie on whole pixels and the atlas is sampled without filtering,
+//   so the text is pixel for pixel what glutBitmapCharacter() draws.
+
+// Glyphs of GLUT's Helvetica 18 (-adobe-helvetica-medium-r-normal--18, from the X11 fonts), as glutBitmapCharacter()
+// stores them: the width, then FONT_HEIGHT rows from the bottom up, 8 pixels per byte, most significant bit first.
+const unsigned char FONT_GLYPHS[] = {
+    5,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // ' '
+    6,0x00,0x00,0x00,0x00,0x00,0x30,0x30,0x00,0x00,0x20,0x20,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x00,0x00,0x00,0x00, // '!'
+    5,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x90,0x90,0xd8,0xd8,0xd8,0x00,0x00,0x00,0x00, // '"'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x24,0x00,0x24,0x00,0x24,0x00,0xff,0x80,0xff,0x80,0x12,0x00,0x12,0x00,0x12,0x00,0x7f,0xc0,0x7f,0xc0,0x09,0x00,0x09,0x00,0x09,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '#'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x04,0x00,0x04,0x00,0x1f,0x00,0x3f,0x80,0x75,0xc0,0x64,0xc0,0x04,0xc0,0x07,0x80,0x1f,0x00,0x3c,0x00,0x74,0x00,0x64,0x00,0x65,0x80,0x3f,0x80,0x1f,0x00,0x04,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '$'
+    16,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x0c,0x3c,0x0c,0x7e,0x06,0x66,0x06,0x66,0x03,0x7e,0x03,0x3c,0x01,0x80,0x3d,0x80,0x7e,0xc0,0x66,0xc0,0x66,0x60,0x7e,0x60,0x3c,0x30,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '%'
+    13,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x1e,0x38,0x3f,0x70,0x73,0xe0,0x61,0xc0,0x61,0xe0,0x63,0x60,0x77,0x60,0x3e,0x00,0x1e,0x00,0x33,0x00,0x33,0x00,0x3f,0x00,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '&'
+    4,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x40,0x20,0x20,0x60,0x60,0x00,0x00,0x00,0x00, // quote
+    6,0x00,0x08,0x18,0x30,0x30,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x30,0x30,0x18,0x08,0x00,0x00,0x00,0x00, // '('
+    6,0x00,0x40,0x60,0x30,0x30,0x18,0x18,0x18,0x18,0x18,0x18,0x18,0x18,0x18,0x18,0x30,0x30,0x60,0x40,0x00,0x00,0x00,0x00, // ')'
+    7,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x44,0x38,0x38,0x7c,0x10,0x10,0x00,0x00,0x00,0x00, // '*'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x0c,0x00,0x0c,0x00,0x0c,0x00,0x0c,0x00,0x7f,0x80,0x7f,0x80,0x0c,0x00,0x0c,0x00,0x0c,0x00,0x0c,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '+'
+    5,0x00,0x00,0x40,0x20,0x20,0x60,0x60,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // ','
+    11,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x7f,0x80,0x7f,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '-'
+    5,0x00,0x00,0x00,0x00,0x00,0x60,0x60,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '.'
+    5,0x00,0x00,0x00,0x00,0x00,0xc0,0xc0,0x40,0x40,0x60,0x60,0x20,0x20,0x30,0x30,0x10,0x10,0x18,0x18,0x00,0x00,0x00,0x00, // '/'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x1e,0x00,0x3f,0x00,0x33,0x00,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x33,0x00,0x3f,0x00,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '0'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x3e,0x00,0x3e,0x00,0x06,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '1'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x7f,0x80,0x7f,0x80,0x60,0x00,0x70,0x00,0x38,0x00,0x1c,0x00,0x0e,0x00,0x07,0x00,0x03,0x80,0x01,0x80,0x61,0x80,0x7f,0x00,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '2'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x1e,0x00,0x3f,0x00,0x63,0x80,0x61,0x80,0x01,0x80,0x03,0x80,0x0f,0x00,0x0e,0x00,0x03,0x00,0x61,0x80,0x61,0x80,0x3f,0x00,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '3'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x01,0x80,0x01,0x80,0x01,0x80,0x7f,0xc0,0x7f,0xc0,0x61,0x80,0x31,0x80,0x19,0x80,0x19,0x80,0x0d,0x80,0x07,0x80,0x03,0x80,0x01,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '4'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x3e,0x00,0x7f,0x00,0x63,0x80,0x61,0x80,0x01,0x80,0x01,0x80,0x63,0x80,0x7f,0x00,0x7e,0x00,0x60,0x00,0x60,0x00,0x7f,0x00,0x7f,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '5'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x1e,0x00,0x3f,0x00,0x71,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x7f,0x00,0x6e,0x00,0x60,0x00,0x60,0x00,0x31,0x80,0x3f,0x80,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '6'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x30,0x00,0x30,0x00,0x18,0x00,0x18,0x00,0x18,0x00,0x0c,0x00,0x0c,0x00,0x06,0x00,0x06,0x00,0x03,0x00,0x01,0x80,0x7f,0x80,0x7f,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '7'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x1e,0x00,0x3f,0x00,0x73,0x80,0x61,0x80,0x61,0x80,0x33,0x00,0x3f,0x00,0x33,0x00,0x61,0x80,0x61,0x80,0x73,0x80,0x3f,0x00,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '8'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x3e,0x00,0x7f,0x00,0x63,0x00,0x01,0x80,0x01,0x80,0x1d,0x80,0x3f,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x63,0x80,0x3f,0x00,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '9'
+    5,0x00,0x00,0x00,0x00,0x00,0x60,0x60,0x00,0x00,0x00,0x00,0x00,0x00,0x60,0x60,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // ':'
+    5,0x00,0x00,0x40,0x20,0x20,0x60,0x60,0x00,0x00,0x00,0x00,0x00,0x00,0x60,0x60,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // ';'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x01,0x80,0x07,0x80,0x1e,0x00,0x38,0x00,0x60,0x00,0x38,0x00,0x1e,0x00,0x07,0x80,0x01,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '<'
+    11,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x3f,0x80,0x3f,0x80,0x00,0x00,0x00,0x00,0x3f,0x80,0x3f,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '='
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x60,0x00,0x78,0x00,0x1e,0x00,0x07,0x00,0x01,0x80,0x07,0x00,0x1e,0x00,0x78,0x00,0x60,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '>'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x18,0x00,0x18,0x00,0x00,0x00,0x00,0x00,0x18,0x00,0x18,0x00,0x18,0x00,0x1c,0x00,0x0e,0x00,0x07,0x00,0x63,0x00,0x63,0x00,0x7f,0x00,0x3e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '?'
+    18,0x00,0x00,0x00,0x00,0x00,0x00,0x03,0xf0,0x00,0x0f,0xf8,0x00,0x1c,0x00,0x00,0x38,0x00,0x00,0x33,0xb8,0x00,0x67,0xfc,0x00,0x66,0x66,0x00,0x66,0x33,0x00,0x66,0x33,0x00,0x66,0x31,0x80,0x63,0x19,0x80,0x33,0xb9,0x80,0x31,0xd9,0x80,0x18,0x03,0x00,0x0e,0x07,0x00,0x07,0xfe,0x00,0x01,0xf8,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '@'
+    12,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xc0,0x30,0xc0,0x30,0x60,0x60,0x60,0x60,0x7f,0xe0,0x3f,0xc0,0x30,0xc0,0x30,0xc0,0x19,0x80,0x19,0x80,0x0f,0x00,0x0f,0x00,0x06,0x00,0x06,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'A'
+    13,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x7f,0xc0,0x7f,0xe0,0x60,0x70,0x60,0x30,0x60,0x30,0x60,0x70,0x7f,0xe0,0x7f,0xc0,0x60,0xc0,0x60,0x60,0x60,0x60,0x60,0xe0,0x7f,0xc0,0x7f,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'B'
+    14,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x07,0xc0,0x1f,0xf0,0x38,0x38,0x30,0x18,0x70,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x70,0x00,0x30,0x18,0x38,0x38,0x1f,0xf0,0x07,0xc0,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'C'
+    13,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x7f,0x80,0x7f,0xc0,0x60,0xe0,0x60,0x60,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x60,0x60,0xe0,0x7f,0xc0,0x7f,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'D'
+    11,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x7f,0xc0,0x7f,0xc0,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x7f,0x80,0x7f,0x80,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x7f,0xc0,0x7f,0xc0,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'E'
+    11,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x7f,0x80,0x7f,0x80,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x7f,0xc0,0x7f,0xc0,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'F'
+    14,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x07,0xd8,0x1f,0xf8,0x38,0x38,0x30,0x18,0x70,0x18,0x60,0xf8,0x60,0xf8,0x60,0x00,0x60,0x00,0x70,0x18,0x30,0x18,0x38,0x38,0x1f,0xf0,0x07,0xc0,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'G'
+    13,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x7f,0xf0,0x7f,0xf0,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'H'
+    6,0x00,0x00,0x00,0x00,0x00,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x00,0x00,0x00,0x00, // 'I'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x1e,0x00,0x3f,0x00,0x73,0x80,0x61,0x80,0x61,0x80,0x01,0x80,0x01,0x80,0x01,0x80,0x01,0x80,0x01,0x80,0x01,0x80,0x01,0x80,0x01,0x80,0x01,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'J'
+    13,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x60,0x38,0x60,0x70,0x60,0xe0,0x61,0xc0,0x63,0x80,0x67,0x00,0x7e,0x00,0x7c,0x00,0x6e,0x00,0x67,0x00,0x63,0x80,0x61,0xc0,0x60,0xe0,0x60,0x70,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'K'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x7f,0x80,0x7f,0x80,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'L'
+    16,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x61,0x86,0x61,0x86,0x63,0xc6,0x62,0x46,0x66,0x66,0x66,0x66,0x6c,0x36,0x6c,0x36,0x78,0x1e,0x78,0x1e,0x70,0x0e,0x70,0x0e,0x60,0x06,0x60,0x06,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'M'
+    13,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x60,0x30,0x60,0x70,0x60,0xf0,0x60,0xf0,0x61,0xb0,0x63,0x30,0x63,0x30,0x66,0x30,0x66,0x30,0x6c,0x30,0x78,0x30,0x78,0x30,0x70,0x30,0x60,0x30,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'N'
+    15,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x07,0xc0,0x1f,0xf0,0x38,0x38,0x30,0x18,0x70,0x1c,0x60,0x0c,0x60,0x0c,0x60,0x0c,0x60,0x0c,0x70,0x1c,0x30,0x18,0x38,0x38,0x1f,0xf0,0x07,0xc0,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'O'
+    12,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x7f,0x80,0x7f,0xc0,0x60,0xe0,0x60,0x60,0x60,0x60,0x60,0xe0,0x7f,0xc0,0x7f,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'P'
+    15,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x18,0x07,0xd8,0x1f,0xf0,0x38,0x78,0x30,0xd8,0x70,0xdc,0x60,0x0c,0x60,0x0c,0x60,0x0c,0x60,0x0c,0x70,0x1c,0x30,0x18,0x38,0x38,0x1f,0xf0,0x07,0xc0,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'Q'
+    12,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0xc0,0x60,0xc0,0x7f,0x80,0x7f,0xc0,0x60,0xe0,0x60,0x60,0x60,0x60,0x60,0xe0,0x7f,0xc0,0x7f,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'R'
+    13,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x1f,0x80,0x3f,0xe0,0x70,0x70,0x60,0x30,0x00,0x30,0x00,0x70,0x01,0xe0,0x0f,0x80,0x3e,0x00,0x70,0x00,0x60,0x30,0x70,0x70,0x3f,0xe0,0x0f,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'S'
+    12,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x06,0x00,0x7f,0xe0,0x7f,0xe0,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'T'
+    13,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x0f,0x80,0x3f,0xe0,0x30,0x60,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x60,0x30,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'U'
+    14,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x03,0x00,0x07,0x80,0x07,0x80,0x0c,0xc0,0x0c,0xc0,0x0c,0xc0,0x18,0x60,0x18,0x60,0x18,0x60,0x30,0x30,0x30,0x30,0x30,0x30,0x60,0x18,0x60,0x18,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'V'
+    18,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x0c,0x0c,0x00,0x0c,0x0c,0x00,0x0e,0x1c,0x00,0x1a,0x16,0x00,0x1b,0x36,0x00,0x1b,0x36,0x00,0x33,0x33,0x00,0x33,0x33,0x00,0x31,0x23,0x00,0x31,0xe3,0x00,0x61,0xe1,0x80,0x60,0xc1,0x80,0x60,0xc1,0x80,0x60,0xc1,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'W'
+    13,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x60,0x30,0x70,0x70,0x30,0x60,0x38,0xe0,0x18,0xc0,0x0d,0x80,0x07,0x00,0x07,0x00,0x0d,0x80,0x18,0xc0,0x38,0xe0,0x30,0x60,0x70,0x70,0x60,0x30,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'X'
+    14,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x03,0x00,0x03,0x00,0x03,0x00,0x03,0x00,0x03,0x00,0x03,0x00,0x07,0x80,0x0c,0xc0,0x18,0x60,0x18,0x60,0x30,0x30,0x30,0x30,0x60,0x18,0x60,0x18,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'Y'
+    12,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x7f,0xe0,0x7f,0xe0,0x60,0x00,0x30,0x00,0x18,0x00,0x0c,0x00,0x0e,0x00,0x06,0x00,0x03,0x00,0x01,0x80,0x00,0xc0,0x00,0x60,0x7f,0xe0,0x7f,0xe0,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'Z'
+    5,0x00,0x78,0x78,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x78,0x78,0x00,0x00,0x00,0x00, // '['
+    5,0x00,0x00,0x00,0x00,0x00,0x18,0x18,0x10,0x10,0x30,0x30,0x20,0x20,0x60,0x60,0x40,0x40,0xc0,0xc0,0x00,0x00,0x00,0x00, // backslash
+    5,0x00,0xf0,0xf0,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0xf0,0xf0,0x00,0x00,0x00,0x00, // ']'
+    9,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x41,0x00,0x63,0x00,0x36,0x00,0x1c,0x00,0x08,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '^'
+    10,0x00,0x00,0xff,0xc0,0xff,0xc0,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '_'
+    4,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x60,0x60,0x40,0x40,0x20,0x00,0x00,0x00,0x00, // '`'
+    9,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x3b,0x00,0x77,0x00,0x63,0x00,0x63,0x00,0x73,0x00,0x3f,0x00,0x07,0x00,0x63,0x00,0x77,0x00,0x3e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'a'
+    11,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x6f,0x00,0x7f,0x80,0x71,0x80,0x60,0xc0,0x60,0xc0,0x60,0xc0,0x60,0xc0,0x71,0x80,0x7f,0x80,0x6f,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'b'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x1f,0x00,0x3f,0x80,0x31,0x80,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x31,0x80,0x3f,0x80,0x1f,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'c'
+    11,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x1e,0xc0,0x3f,0xc0,0x31,0xc0,0x60,0xc0,0x60,0xc0,0x60,0xc0,0x60,0xc0,0x31,0xc0,0x3f,0xc0,0x1e,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'd'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x1e,0x00,0x3f,0x80,0x71,0x80,0x60,0x00,0x60,0x00,0x7f,0x80,0x61,0x80,0x61,0x80,0x3f,0x00,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'e'
+    6,0x00,0x00,0x00,0x00,0x00,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0x30,0xfc,0xfc,0x30,0x30,0x3c,0x1c,0x00,0x00,0x00,0x00, // 'f'
+    11,0x00,0x00,0x0e,0x00,0x3f,0x80,0x31,0x80,0x00,0xc0,0x1e,0xc0,0x3f,0xc0,0x31,0xc0,0x60,0xc0,0x60,0xc0,0x60,0xc0,0x60,0xc0,0x30,0xc0,0x3f,0xc0,0x1e,0xc0,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'g'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x71,0x80,0x6f,0x80,0x67,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'h'
+    4,0x00,0x00,0x00,0x00,0x00,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x00,0x00,0x60,0x60,0x00,0x00,0x00,0x00, // 'i'
+    4,0x00,0xc0,0xe0,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x00,0x00,0x60,0x60,0x00,0x00,0x00,0x00, // 'j'
+    9,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x63,0x80,0x63,0x00,0x67,0x00,0x66,0x00,0x6c,0x00,0x7c,0x00,0x78,0x00,0x6c,0x00,0x66,0x00,0x63,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'k'
+    4,0x00,0x00,0x00,0x00,0x00,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x00,0x00,0x00,0x00, // 'l'
+    14,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x63,0x18,0x63,0x18,0x63,0x18,0x63,0x18,0x63,0x18,0x63,0x18,0x63,0x18,0x73,0x98,0x6f,0x78,0x66,0x30,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'm'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x71,0x80,0x6f,0x80,0x67,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'n'
+    11,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x1f,0x00,0x3f,0x80,0x31,0x80,0x60,0xc0,0x60,0xc0,0x60,0xc0,0x60,0xc0,0x31,0x80,0x3f,0x80,0x1f,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'o'
+    11,0x00,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x60,0x00,0x6f,0x00,0x7f,0x80,0x71,0x80,0x60,0xc0,0x60,0xc0,0x60,0xc0,0x60,0xc0,0x71,0x80,0x7f,0x80,0x6f,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'p'
+    11,0x00,0x00,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x00,0xc0,0x1e,0xc0,0x3f,0xc0,0x31,0xc0,0x60,0xc0,0x60,0xc0,0x60,0xc0,0x60,0xc0,0x31,0xc0,0x3f,0xc0,0x1e,0xc0,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'q'
+    6,0x00,0x00,0x00,0x00,0x00,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x70,0x6c,0x6c,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'r'
+    9,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x3c,0x00,0x7e,0x00,0x63,0x00,0x03,0x00,0x1f,0x00,0x7e,0x00,0x60,0x00,0x63,0x00,0x3f,0x00,0x1e,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 's'
+    6,0x00,0x00,0x00,0x00,0x00,0x18,0x38,0x30,0x30,0x30,0x30,0x30,0x30,0xfc,0xfc,0x30,0x30,0x30,0x00,0x00,0x00,0x00,0x00, // 't'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x39,0x80,0x7d,0x80,0x63,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x61,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'u'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x0c,0x00,0x0c,0x00,0x1e,0x00,0x12,0x00,0x33,0x00,0x33,0x00,0x33,0x00,0x61,0x80,0x61,0x80,0x61,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'v'
+    14,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x0c,0xc0,0x0c,0xc0,0x1c,0xe0,0x14,0xa0,0x34,0xb0,0x33,0x30,0x33,0x30,0x63,0x18,0x63,0x18,0x63,0x18,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'w'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x61,0x80,0x73,0x80,0x33,0x00,0x1e,0x00,0x0c,0x00,0x0c,0x00,0x1e,0x00,0x33,0x00,0x73,0x80,0x61,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'x'
+    10,0x00,0x00,0x38,0x00,0x38,0x00,0x0c,0x00,0x0c,0x00,0x0c,0x00,0x0c,0x00,0x1e,0x00,0x12,0x00,0x33,0x00,0x33,0x00,0x33,0x00,0x61,0x80,0x61,0x80,0x61,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'y'
+    9,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x7f,0x00,0x7f,0x00,0x60,0x00,0x30,0x00,0x18,0x00,0x0c,0x00,0x06,0x00,0x03,0x00,0x7f,0x00,0x7f,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // 'z'
+    6,0x00,0x0c,0x18,0x30,0x30,0x30,0x30,0x30,0x30,0x60,0xc0,0x60,0x30,0x30,0x30,0x30,0x30,0x18,0x0c,0x00,0x00,0x00,0x00, // '{'
+    4,0x00,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x60,0x00,0x00,0x00,0x00, // '|'
+    6,0x00,0xc0,0x60,0x30,0x30,0x30,0x30,0x30,0x30,0x18,0x0c,0x18,0x30,0x30,0x30,0x30,0x30,0x60,0xc0,0x00,0x00,0x00,0x00, // '}'
+    10,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x66,0x00,0x3f,0x00,0x19,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00, // '~'
+};
+
+// What: Function to build the text atlas
+// Input: None
+// Output: None
+// Action: The first time, the function finds the box around the pixels of each glyph, packs the boxes into rows of
+//         the atlas, one pixel apart, and keeps where each one is. With an OpenGL context, it uploads the atlas as an
+//         alpha texture.
+// Caller: Init()
+void buildTextAtlas() {
+    if (textAtlas.empty()) {
+        textAtlas.assign((size_t)TEXT_ATLAS_SIZE * TEXT_ATLAS_SIZE, 0);
+        const unsigned char* data = FONT_GLYPHS;
+        int atlasX = 0, atlasY = 0;
+        for (int i = 0; i < GLYPH_COUNT; i++) {
+            int advance = *data++, stride = (advance + 7) / 8;
+            auto pixel = [&](int column, int row) { return (data[row * stride + column / 8] & (0x80 >> (column % 8))) != 0; };
+
+            // 1. Find the box around the glyph's pixels
+            int left = advance, right = 0, bottom = FONT_HEIGHT, top = 0;
+            for (int row = 0; row < FONT_HEIGHT; row++) {
+                for (int column = 0; column < advance; column++) {
+                    if (pixel(column, row)) {
+                        left = min(left, column);
+                        right = max(right, column + 1);
+                        bottom = min(bottom, row);
+                        top = max(top, row + 1);
+                    }
+                }
+            }
+            int width = max(0, right - left), height = max(0, top - bottom);
+
+            // 2. Copy it into the atlas
+            if (atlasX + width > TEXT_ATLAS_SIZE) {
+                atlasX = 0; // Start a new row
+                atlasY += FONT_HEIGHT + 1;
+            }
+            for (int row = 0; row < height; row++) {
+                for (int column = 0; column < width; column++) {
+                    if (pixel(left + column, bottom + row)) {
+                        textAtlas[(size_t)(atlasY + row) * TEXT_ATLAS_SIZE + atlasX + column] = 255;
+                    }
+                }
+            }
+            glyphs[i] = { advance, left, bottom, width, height, (GLfloat)atlasX / TEXT_ATLAS_SIZE, (GLfloat)atlasY / TEXT_ATLAS_SIZE,
+                (GLfloat)(atlasX + width) / TEXT_ATLAS_SIZE, (GLfloat)(atlasY + height) / TEXT_ATLAS_SIZE };
+            data += stride * FONT_HEIGHT;
+            atlasX += width + 1;
+        }
+    }
+    if (!openGLContext) {
+        return;
+    }
+    glGenTextures(1, &textAtlasTexture); // A new context each time Init() runs, so a new texture too
+    glBindTexture(GL_TEXTURE_2D, textAtlasTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, TEXT_ATLAS_SIZE, TEXT_ATLAS_SIZE, 0, GL_ALPHA, GL_UNSIGNED_BYTE, textAtlas.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// What: Function to draw the text of the frame
+// Input: None
+// Output: None
+// Action: The function switches to a projection in window pixels, draws the quads of frameText with the atlas,
+//         keeping the texels whose coverage is above one half like glBitmap() does, restores the state and empties
+//         the batch.
+// Caller: myDisplay() and runTextBenchmark()
+void flushText() {
+    if (frameText.empty()) {
+        return;
+    }
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(regionX, regionX + (regionWidth > 0 ? regionWidth : windowWidth), regionY, regionY + (regionHeight > 0 ? regionHeight : windowHeight), -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    PROFILE_COUNT(COUNT_GL_CALLS, 7); // Both matrices
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, textAtlasTexture);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE); // Color from the vertices, alpha from the atlas
+    glEnable(GL_ALPHA_TEST);
+    glAlphaFunc(GL_GREATER, 0.5f);
+    PROFILE_COUNT(COUNT_GL_CALLS, 5); // The texture and the alpha test
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(TextVertex), &frameText[0].x);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(TextVertex), &frameText[0].u);
+    glColorPointer(3, GL_FLOAT, sizeof(TextVertex), &frameText[0].r);
+    glDrawArrays(GL_QUADS, 0, (GLsizei)frameText.size());
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    PROFILE_COUNT(COUNT_GL_CALLS, 10); // Three arrays on, three pointers, the draw and three arrays off
+
+    glDisable(GL_ALPHA_TEST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    PROFILE_COUNT(COUNT_GL_CALLS, 7); // Restoring the texture, the alpha test and both matrices
+    PROFILE_COUNT(COUNT_VERTICES, (long long)frameText.size());
+    frameText.clear();
+}
+
+
+// Below is the frame memory
+//   A steady-state frame allocates nothing: the frame buffers, meshes and pools keep their capacity from frame to
+//   frame, and the scratch memory of a frame comes from frameArena. With HW05_COUNT_ALLOCATIONS the global operator
+//   new is replaced by one that counts its calls, so "--check-allocations" and the HUD can show which frames allocate.
+//   The count is one atomic shared by every thread, so it is a debugging aid and left out of release builds.
+
+#if HW05_COUNT_ALLOCATIONS
+// The replaceable global allocation functions; the nothrow and array forms of the standard library call these
+// GCC cannot tell that the free() inlined into operator delete matches this operator new.
+#if defined(__GNUC__) && __GNUC__ >= 11
+#  pragma GCC diagnostic push
+#  pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    for (;;) {
+        if (void* memory = malloc(size ? size : 1)) {
+            return memory;
+        }
+        new_handler handler = get_new_handler(); // Like the standard one: let the handler free memory, then retry
+        if (!handler) {
+            throw bad_alloc();
+        }
+        handler();
+    }
+}
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+void operator delete[](void* memory) noexcept {
+    free(memory);
+}
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+void operator delete[](void* memory, size_t) noexcept {
+    free(memory);
+}
+#if defined(__GNUC__) && __GNUC__ >= 11
+#  pragma GCC diagnostic pop
+#endif
+#endif
+
+// What: Function to size the pools the frames draw into
+//       The buffers keep their capacity from frame to frame, so sizing them once for the largest frame of the
+//       character means the frames that follow allocate nothing, even while the character grows and its meshes are
+//       tessellated again for larger levels of detail.
+// Input: None (uses animation and the loaded scene)
+// Output: None
+// Action: The function gives the frame arena FRAME_ARENA_SIZE bytes, draws the single character at the fixed,
+//         finest tessellation, which is the most vertices any of its meshes and frames hold, and then empties the
+//         meshes and the frame again, keeping their memory.
+// Caller: Init()
+void reserveFramePools() {
+    frameArena.reserve(FRAME_ARENA_SIZE);
+#if HW05_PROFILE
+    bool profiling = profilingActive;
+    profilingActive = false; // Not part of any frame
+#endif
+    float savedError = lodPixelError;
+    int savedCrowd = crowdSize;
+    lodPixelError = 0;
+    crowdSize = 0;
+    invalidateMeshCache();
+    drawScene();
+    frameTriangles.clear();
+    frameLines.clear();
+    frameQuads.clear();
+    framePrimitives.clear();
+    frameLayer = 0;
+    lodPixelError = savedError;
+    crowdSize = savedCrowd;
+    invalidateMeshCache();
+#if HW05_PROFILE
+    profilingActive = profiling;
+#endif
+}
+
+// What: Function to check that the frame loop allocates nothing once it is warmed up
+//       The first frames size the buffers: the meshes at each level of detail, the frame and bin arrays, the
+//       crowd and the text batch. Rendering the same frames again must then reuse all of it, so every allocation
+//       of the second pass is one the frame makes and frees again.
+// Input: None (uses windowWidth and windowHeight)
+// Output: 0 if no frame of the second pass allocates, 1 otherwise
+// Action: For the single character and a labelled crowd of 1,000 with each backend, with the profiling HUD and with
+//         several rasterizer threads, the function renders ALLOCATION_CHECK_FRAMES frames twice (the character
+//         grows during the first 130) and prints the allocations of the first pass and the frames of the second
+//         pass that allocated.
+// Caller: main()
+int runAllocationCheck() {
+#if HW05_COUNT_ALLOCATIONS
+    struct AllocationCase { const char* name; RenderBackend backend; int crowd; bool labels; bool hud; int threads; };
+    const AllocationCase cases[] = {
+        { "OpenGL", BACKEND_OPENGL, 0, false, false, 1 },
+        { "OpenGL, profiling HUD", BACKEND_OPENGL, 0, false, true, 1 },
+        { "OpenGL, labelled crowd of 1,000", BACKEND_OPENGL, 1000, true, false, 1 },
+        { "CPU", BACKEND_CPU, 0, false, false, 1 },
+        { "CPU, 4 threads, profiling HUD", BACKEND_CPU, 0, false, true, 4 },
+        { "CPU, 4 threads, labelled crowd of 1,000", BACKEND_CPU, 1000, true, false, 4 },
+    };
+    int savedThreads = renderThreads;
+    bool ok = true;
+
+    headlessMode = true;
+    printf("Allocations of %d frames at %dx%d, warming up and then in the steady state:\n", ALLOCATION_CHECK_FRAMES, windowWidth, windowHeight);
+    for (const AllocationCase& test : cases) {
+        renderBackend = test.backend;
+        if (test.backend == BACKEND_OPENGL && !openOffscreenContext(windowWidth, windowHeight)) {
+            printf("  %-40s skipped, no OpenGL context\n", test.name);
+            continue;
+        }
+        crowdSize = test.crowd;
+        crowdLabels = test.labels;
+        renderThreads = test.threads;
+#if HW05_PROFILE
+        hudVisible = test.hud;
+        profilingActive = hudVisible || traceOutput;
+#else
+        if (test.hud) {
+            printf("  %-40s skipped, profiling compiled out\n", test.name);
+            continue;
+        }
+#endif
+        Init();
+        myReshape(windowWidth, windowHeight);
+
+        long long warmup = allocationCount.load(memory_order_relaxed);
+        if (renderFrames(0, ALLOCATION_CHECK_FRAMES, nullptr) < 0) {
+            ok = false;
+            break;
+        }
+        warmup = allocationCount.load(memory_order_relaxed) - warmup;
+        long long steady = 0;
+        int allocatingFrames = 0, firstFrame = -1;
+        for (int frame = 0; frame < ALLOCATION_CHECK_FRAMES; frame++) {
+            long long before = allocationCount.load(memory_order_relaxed);
+            renderFrames(frame, 1, nullptr);
+            long long allocations = allocationCount.load(memory_order_relaxed) - before;
+            if (allocations > 0) {
+                steady += allocations;
+                allocatingFrames++;
+                firstFrame = firstFrame < 0 ? frame : firstFrame;
+            }
+        }
+        printf("  %-40s %8lld warming up  %6lld steady", test.name, warmup, steady);
+        if (allocatingFrames > 0) {
+            printf("  FAILED: %d frames allocate, the first is frame %d", allocatingFrames, firstFrame);
+            ok = false;
+        }
+        printf("\n");
+        closeOffscreenContext();
+    }
+    renderThreads = savedThreads;
+    crowdSize = 0;
+    crowdLabels = false;
+#if HW05_PROFILE
+    hudVisible = false;
+    profilingActive = traceOutput != nullptr;
+#endif
+    printf(ok ? "No steady-state frame allocates.\n" : "Some steady-state frames allocate.\n");
+    return ok ? 0 : 1;
+#else
+    cerr << "Allocation counting is not compiled in, so \"--check-allocations\" is not available. Build with CMake's Debug"
+        << " configuration or -DHW05_COUNT_ALLOCATIONS=ON, or compile with -DHW05_COUNT_ALLOCATIONS=1." << endl;
+    return 1;
+#endif
+}
+
+#if HW05_PROFILE
+// Below is the profiling instrumentation
+//   ProfileScope times the zones of a frame (PROFILE_SCOPE at the top of update(), myDisplay(), drawDoraemon(),
+//   drawBambooCopter(), drawBalloons() and flushFrame(), and around glFlush()/glutSwapBuffers()) and PROFILE_COUNT
+//   counts vertices, primitives, OpenGL calls, cos/sin evaluations and allocations. Both do nothing but test profilingActive
+//   unless the HUD is shown or a trace is recorded, and nothing at all when compiled with HW05_PROFILE=0.
+
+#ifdef __linux__
+GLuint gpuTimerQueries[2]; // Timer queries of the even and odd frames
+int gpuTimerSupport = 0; // 1 if the OpenGL implementation has timer queries, -1 if not, 0 before the first check
+int gpuTimerFrames = 0; // Frames timed on the GPU so far
+bool gpuTimerRunning = false; // Whether a query was begun by beginGpuTimer()
+#endif
+
+// What: Function to close a profiled frame
+// Input: start, duration - the time the frame started, since profileOrigin, and its length, in microseconds
+// Output: None
+// Action: The function adds the frame time to the rolling history, keeps the zone times and counters for the HUD,
+//         records the counters for the trace and resets them for the next frame.
+// Caller: ProfileScope
+void finishProfileFrame(double start, double duration) {
+    frameHistory[frameHistoryCount++ % PROFILE_HISTORY] = duration;
+    if (traceOutput && traceFrames.size() < PROFILE_TRACE_LIMIT) {
+        TraceFrame frame;
+        frame.end = start + duration;
+        copy(profileCounters, profileCounters + COUNTER_COUNT, frame.counters);
+        frame.gpuTime = lastGpuTime;
+        traceFrames.push_back(frame);
+    }
+    copy(zoneTime, zoneTime + ZONE_COUNT, lastZoneTime);
+    copy(profileCounters, profileCounters + COUNTER_COUNT, lastCounters);
+    fill(zoneTime, zoneTime + ZONE_COUNT, 0.0);
+    fill(profileCounters, profileCounters + COUNTER_COUNT, 0LL);
+}
+
+// What: Function to get a percentile of the recent frame times
+// Input: p - the fraction of frames, 0.5 for the median
+// Output: The time in microseconds, 0 if no frame was profiled yet
+// Action: The function selects the element of rank p in a copy of the last PROFILE_HISTORY frame times.
+// Caller: drawProfileHud() and writeProfileTrace()
+double frameTimePercentile(double p) {
+    int count = min(frameHistoryCount, PROFILE_HISTORY);
+    if (count == 0) {
+        return 0;
+    }
+    double* times = frameArena.allocate<double>(count);
+    copy(frameHistory, frameHistory + count, times);
+    double* rank = times + min(count - 1, (int)(p * count));
+    nth_element(times, rank, times + count);
+    return *rank;
+}
+
+// What: Function to start timing the frame on the GPU
+//       The CPU times above only cover issuing the commands; the GPU runs them later. A GL_TIME_ELAPSED query
+//       measures that, and its result is read two frames later, when it is ready, so it never stalls the frame.
+// Input: None
+// Output: None
+// Action: The function checks once for timer queries (OpenGL 3.3 or GL_ARB_timer_query), reads the query of two
+//         frames ago into lastGpuTime and begins the query of this frame.
+// Caller: myDisplay()
+void beginGpuTimer() {
+#ifdef __linux__
+    if (!profilingActive || renderBackend != BACKEND_OPENGL || !openGLContext) {
+        return;
+    }
+    if (gpuTimerSupport == 0) {
+        const char* version = (const char*)glGetString(GL_VERSION);
+        const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+        int major = 0, minor = 0;
+        if (version) {
+            sscanf(version, "%d.%d", &major, &minor);
+        }
+        gpuTimerSupport = major * 10 + minor >= 33 || (extensions && strstr(extensions, "GL_ARB_timer_query")) ? 1 : -1;
+        if (gpuTimerSupport > 0) {
+            glGenQueries(2, gpuTimerQueries);
+        }
+    }
+    if (gpuTimerSupport < 0) {
+        return;
+    }
+    GLuint query = gpuTimerQueries[gpuTimerFrames % 2];
+    if (gpuTimerFrames >= 2) {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        lastGpuTime = nanoseconds / 1000.0;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    gpuTimerRunning = true;
+#endif
+}
+
+// What: Function to stop timing the frame on the GPU
+// Input: None
+// Output: None
+// Action: The function ends the query begun by beginGpuTimer(), if any.
+// Caller: myDisplay()
+void endGpuTimer() {
+#ifdef __linux__
+    if (gpuTimerRunning) {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuTimerRunning = false;
+        gpuTimerFrames++;
+    }
+#endif
+}
+
+// What: Function to draw the profiling HUD
+// Input: None
+// Output: None
+// Action: The function writes four lines in the top left corner with drawText(): the median and 99th percentile of
+//         the last PROFILE_HISTORY frame times, the CPU time of each zone and the GPU time, and the counters,
+//         all of the last finished frame.
+// Caller: myDisplay()
+void drawProfileHud() {
+    char lines[4][200];
+    snprintf(lines[0], sizeof(lines[0]), "Frame p50 %.2f ms  p99 %.2f ms  (last %d frames)",
+        frameTimePercentile(0.5) / 1000, frameTimePercentile(0.99) / 1000, min(frameHistoryCount, PROFILE_HISTORY));
+    snprintf(lines[1], sizeof(lines[1]), "update %.3f  drawDoraemon %.3f  drawBambooCopter %.3f  drawBalloons %.3f ms",
+        lastZoneTime[ZONE_UPDATE] / 1000, lastZoneTime[ZONE_DRAW_DORAEMON] / 1000, lastZoneTime[ZONE_DRAW_COPTER] / 1000,
+        lastZoneTime[ZONE_DRAW_BALLOONS] / 1000);
+    char gpu[32] = "n/a";
+    if (lastGpuTime >= 0) {
+        snprintf(gpu, sizeof(gpu), "%.3f", lastGpuTime / 1000);
+    }
+    snprintf(lines[2], sizeof(lines[2]), "flushFrame %.3f  glFlush %.3f  GPU %s ms",
+        lastZoneTime[ZONE_FLUSH_FRAME] / 1000, lastZoneTime[ZONE_PRESENT] / 1000, gpu);
+    snprintf(lines[3], sizeof(lines[3]), "%lld vertices  %lld primitives  %lld GL calls  %lld cos/sin  %lld allocations",
+        lastCounters[COUNT_VERTICES], lastCounters[COUNT_PRIMITIVES], lastCounters[COUNT_GL_CALLS], lastCounters[COUNT_TRIG],
+        lastCounters[COUNT_ALLOCATIONS]);
+
+    // 22 pixels per line, from 10 pixels inside the top left corner
+    float pixelX = (float)((clippingPlanRight - clippingPlanLeft) / windowWidth);
+    float pixelY = (float)((clippingPlanTop - clippingPlanBottom) / windowHeight);
+    for (int i = 0; i < 4; i++) {
+        drawText(lines[i], (float)clippingPlanLeft + 10 * pixelX, (float)clippingPlanTop - (10 + 22 * (i + 1)) * pixelY);
+    }
+}
+
+// What: Function to save the trace
+//       The file uses the Chrome trace event format, opened by chrome://tracing or https://ui.perfetto.dev:
+//       every zone is a complete ("X") event and the counters of every frame a counter ("C") event.
+// Input: None (uses traceOutput, traceZones and traceFrames)
+// Output: None
+// Action: The function writes the events, reports how many there are and the frame time percentiles.
+// Caller: exit(), registered by main()
+void writeProfileTrace() {
+    FILE* file = fopen(traceOutput, "w");
+    if (!file) {
+        cerr << "Could not write " << traceOutput << "." << endl;
+        return;
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"main\"}}");
+    for (const TraceZone& zone : traceZones) {
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+            PROFILE_ZONE_NAMES[zone.zone], zone.start, zone.duration);
+    }
+    for (const TraceFrame& frame : traceFrames) {
+        fprintf(file, ",\n{\"name\":\"frame\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":1,\"args\":{", frame.end);
+        for (int i = 0; i < COUNTER_COUNT; i++) {
+            fprintf(file, "%s\"%s\":%lld", i ? "," : "", PROFILE_COUNTER_NAMES[i], frame.counters[i]);
+        }
+        fprintf(file, "}}");
+        if (frame.gpuTime >= 0) {
+            fprintf(file, ",\n{\"name\":\"GPU time (us)\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":1,\"args\":{\"GPU\":%.3f}}", frame.end, frame.gpuTime);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    if (fclose(file) != 0) {
+        cerr << "Could not write " << traceOutput << "." << endl;
+        return;
+    }
+    printf("Wrote %zu zones and %zu frames to %s%s.\n", traceZones.size(), traceFrames.size(), traceOutput,
+        traceZones.size() >= PROFILE_TRACE_LIMIT || traceFrames.size() >= PROFILE_TRACE_LIMIT ? " (truncated)" : "");
+    printf("Frame time p50 %.3f ms, p99 %.3f ms over the last %d frames.\n",
+        frameTimePercentile(0.5) / 1000, frameTimePercentile(0.99) / 1000, min(frameHistoryCount, PROFILE_HISTORY));
+}
+#endif
+
+
+// Below is the CPU rasterizer backend
+//   The frame command buffer is rasterized in draw order straight into an RGBA buffer. Fills are convex
+//   polygons and are filled one row at a time: the two edges crossing the row give the exact span of
+//   covered pixel centers, and the span is written with SIMD stores of 4 (SSE2), 8 (AVX2) or 16 (AVX-512)
+//   pixels per instruction. Lines are widened to lineWidth the way OpenGL does it (vertically for x-major
+//   lines, horizontally for y-major lines) and filled as parallelograms.
+
+// What: Function to choose the span fill
+// Input: None (simdLevel holds the widest level allowed by the command line)
+// Output: None
+// Action: The function lowers simdLevel to the widest instruction set the processor and the operating system support.
+// Caller: main()
+void detectSimdLevel() {
+    SimdLevel supported = SIMD_SCALAR;
+#if defined(HW05_X86) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    supported = __builtin_cpu_supports("avx512f") ? SIMD_AVX512 : __builtin_cpu_supports("avx2") ? SIMD_AVX2 : SIMD_SSE2;
+#elif defined(HW05_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool osSavesAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28));
+    unsigned long long xcr0 = osSavesAvx ? _xgetbv(0) : 0;
+    supported = SIMD_SSE2;
+    if (maxLeaf >= 7 && (xcr0 & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5)) {
+            supported = SIMD_AVX2;
+        }
+        if ((info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6) {
+            supported = SIMD_AVX512;
+        }
+    }
+#endif
+    simdLevel = min(simdLevel, supported);
+}
+
+#ifdef HW05_X86
+// What: SSE2 span fill, 4 pixels per store
+void fillSpanSSE2(uint32_t* pixels, int count, uint32_t color) {
+    __m128i value = _mm_set1_epi32((int)color);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i*)(pixels + i), value);
+    }
+    for (; i < count; i++) {
+        pixels[i] = color;
+    }
+}
+
+// What: AVX2 span fill, 8 pixels per store
+HW05_TARGET("avx2") void fillSpanAVX2(uint32_t* pixels, int count, uint32_t color) {
+    __m256i value = _mm256_set1_epi32((int)color);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256((__m256i*)(pixels + i), value);
+    }
+    if (i < count) {
+        // Masked store of the remaining 1 to 7 pixels
+        __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - i), lanes);
+        _mm256_maskstore_epi32((int*)(pixels + i), mask, value);
+    }
+}
+
+// What: AVX-512 span fill, 16 pixels per store
+HW05_TARGET("avx512f") void fillSpanAVX512(uint32_t* pixels, int count, uint32_t color) {
+    __m512i value = _mm512_set1_epi32((int)color);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        _mm512_storeu_si512((void*)(pixels + i), value);
+    }
+    if (i < count) {
+        // Masked store of the remaining 1 to 15 pixels
+        _mm512_mask_storeu_epi32(pixels + i, (__mmask16)((1u << (count - i)) - 1), value);
+    }
+}
+#endif
+
+// What: Function to fill a run of pixels with one color
+// Input: pixels - first pixel of the run
+//        count - number of pixels
+//        color - packed RGBA color
+// Output: None
+// Action: The function writes the color with the widest span fill selected by detectSimdLevel(), or with a scalar loop.
+// Caller: clearCPUFramebuffer() and rasterizeConvexPolygon()
+void fillSpan(uint32_t* pixels, int count, uint32_t color) {
+#ifdef HW05_X86
+    switch (simdLevel) {
+    case SIMD_AVX512:
+        fillSpanAVX512(pixels, count, color);
+        return;
+    case SIMD_AVX2:
+        fillSpanAVX2(pixels, count, color);
+        return;
+    case SIMD_SSE2:
+        fillSpanSSE2(pixels, count, color);
+        return;
+    default:
+        break;
+    }
+#endif
+    for (int i = 0; i < count; i++) {
+        pixels[i] = color;
+    }
+}
+
+// What: Function to pack a color into an RGBA pixel
+// Input: color (red, green, blue) in [0, 1]
+// Output: The pixel, with red in the lowest byte so the buffer can be read as GL_RGBA/GL_UNSIGNED_BYTE
+// Action: The function rounds every channel to 8 bits the way OpenGL does.
+// Caller: clearCPUFramebuffer() and rasterizeFrame()
+uint32_t packColor(float red, float green, float blue) {
+    uint32_t r = (uint32_t)(red * 255.0f + 0.5f);
+    uint32_t g = (uint32_t)(green * 255.0f + 0.5f);
+    uint32_t b = (uint32_t)(blue * 255.0f + 0.5f);
+    return r | (g << 8) | (b << 16) | (255u << 24);
+}
+
+// What: Function to prepare the CPU framebuffer for a new frame
+// Input: None
+// Output: None
+// Action: The function resizes the CPU framebuffer to the current window size, or to the region of it set by
+//         setRenderRegion(), and requests it to be cleared with the background color. The clearing itself is done
+//         tile by tile by the threads rasterizing the frame.
+// Caller: myDisplay()
+void clearCPUFramebuffer() {
+    int width = regionWidth > 0 ? regionWidth : windowWidth, height = regionHeight > 0 ? regionHeight : windowHeight;
+    if (cpuFramebufferWidth != width || cpuFramebufferHeight != height) {
+        cpuFramebufferWidth = width;
+        cpuFramebufferHeight = height;
+        cpuFramebuffer.assign((size_t)width * height, 0);
+        tileColumns = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+        tileRows = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+        tileBins.resize((size_t)tileColumns * tileRows);
+        cpuFrameValid = false; // Neither the previous frame nor the static layer fit the new size
+        staticLayerPolygons = 0;
+    }
+    if (cpuFramebufferX != regionX || cpuFramebufferY != regionY) {
+        cpuFramebufferX = regionX;
+        cpuFramebufferY = regionY;
+        cpuFrameValid = false; // The previous frame and the static layer show another part of the window
+        staticLayerPolygons = 0;
+    }
+    cpuClearColor = packColor(backgroundColor[0], backgroundColor[1], backgroundColor[2]);
+}
+
+// What: Function to fill a convex polygon
+//       A pixel is covered when its center is inside the polygon. Every edge is walked once to record,
+//       for each row it crosses, where it meets the row's center line; the leftmost and rightmost
+//       crossings of a row give its span. Clipping only limits the rows and columns that are written,
+//       so a polygon split over several tiles covers exactly the same pixels as when it is drawn whole.
+// Input: x, y - the vertices, in pixel coordinates with (0, 0) at the bottom left of the window
+//        n - the number of vertices
+//        color - packed RGBA color
+//        clipX0, clipY0, clipX1, clipY1 - only pixels in [clipX0, clipX1) x [clipY0, clipY1) are written
+// Output: The number of pixels filled
+// Action: The function fills the covered pixels of the polygon inside the clipping rectangle with the color.
+// Caller: rasterizeTile()
+int rasterizeConvexPolygon(const float* x, const float* y, int n, uint32_t color, int clipX0, int clipY0, int clipX1, int clipY1) {
+    thread_local vector<float> spanLeft, spanRight; // Span ends of the rows, indexed from rowBegin
+
+    float yMin = y[0], yMax = y[0];
+    for (int i = 1; i < n; i++) {
+        yMin = min(yMin, y[i]);
+        yMax = max(yMax, y[i]);
+    }
+    // Rows whose center (row + 0.5) is in [yMin, yMax)
+    int rowBegin = max(clipY0, (int)ceil(yMin - 0.5f));
+    int rowEnd = min(clipY1, (int)ceil(yMax - 0.5f));
+    if (rowBegin >= rowEnd) {
+        return 0;
+    }
+    if ((int)spanLeft.size() < rowEnd - rowBegin) {
+        spanLeft.resize(rowEnd - rowBegin);
+        spanRight.resize(rowEnd - rowBegin);
+    }
+    for (int row = rowBegin; row < rowEnd; row++) {
+        spanLeft[row - rowBegin] = 1e30f;
+        spanRight[row - rowBegin] = -1e30f;
+    }
+
+    for (int i = 0; i < n; i++) {
+        float x0 = x[i], y0 = y[i];
+        float x1 = x[(i + 1) % n], y1 = y[(i + 1) % n];
+        if (y0 == y1) {
+            continue; // Horizontal edges do not bound any row
+        }
+        if (y0 > y1) {
+            swap(x0, x1);
+            swap(y0, y1);
+        }
+        float slope = (x1 - x0) / (y1 - y0);
+        int first = max(rowBegin, (int)ceil(y0 - 0.5f));
+        int last = min(rowEnd, (int)ceil(y1 - 0.5f));
+        for (int row = first; row < last; row++) {
+            float crossing = x0 + (row + 0.5f - y0) * slope;
+            spanLeft[row - rowBegin] = min(spanLeft[row - rowBegin], crossing);
+            spanRight[row - rowBegin] = max(spanRight[row - rowBegin], crossing);
+        }
+    }
+
+    int filled = 0;
+    for (int row = rowBegin; row < rowEnd; row++) {
+        // Pixels whose center (column + 0.5) is in [spanLeft, spanRight)
+        int begin = max(clipX0, (int)ceil(spanLeft[row - rowBegin] - 0.5f));
+        int end = min(clipX1, (int)ceil(spanRight[row - rowBegin] - 0.5f));
+        if (begin < end) {
+            fillSpan(&cpuFramebuffer[(size_t)(row - cpuFramebufferY) * cpuFramebufferWidth + begin - cpuFramebufferX], end - begin, color);
+            filled += end - begin;
+        }
+    }
+    return filled;
+}
+
+// What: Function to shade a run of pixels of an analytic shape
+//       Each pixel's center is placed on the plane of the unit circle at (u, v), r = |(u, v)| away from its center.
+//       r - 1 divided by the change of r per pixel is the distance, in pixels, to the ellipse, measured across it
+//       for the fill and along the x or y axis for the outline, like the wide lines OpenGL draws. The distances give
+//       the coverage of the fill and of the outline, which fade out over half a pixel either side of their edges,
+//       and the lines along the edges of a sweep cut both the same way. The pixel is blended with the shape's
+//       premultiplied color.
+// Input: shape - the shape
+//        pixels - the framebuffer row, which starts at window column cpuFramebufferX
+//        begin, end - the window columns of the run
+//        row - the window row
+// Output: None
+// Action: The function blends the shape into pixels [begin, end) of the row.
+// Caller: rasterizeShape()
+void shadeShapeRunScalar(const RasterShape& shape, uint32_t* pixels, int begin, int end, int row) {
+    float halfWidth = lineWidth / 2;
+    float fillWeight = shape.kind == SHAPE_ARC ? 0.0f : 1.0f;
+    float lineWeight = shape.kind == SHAPE_FILL_OUTLINE || shape.kind == SHAPE_ARC ? 1.0f : 0.0f;
+    float lineColor = shape.kind == SHAPE_ARC ? 1.0f : 0.0f; // Black outlines, arcs in their color
+    float y = (float)row + 0.5f - shape.y;
+    float rowU = shape.u + shape.uy * y, rowV = shape.v + shape.vy * y;
+    float rowStart = shape.start[0] + shape.start[2] * y, rowEnd = shape.end[0] + shape.end[2] * y;
+    for (int column = begin; column < end; column++) {
+        float x = (float)column + 0.5f - shape.x;
+        float u = rowU + shape.ux * x, v = rowV + shape.vx * x;
+        float r = max(sqrt(u * u + v * v), 1e-6f);
+        float gx = (u * shape.ux + v * shape.vx) / r, gy = (u * shape.uy + v * shape.vy) / r;
+        float f = r - 1;
+        float fill = min(max(0.5f - f / max(sqrt(gx * gx + gy * gy), 1e-6f), 0.0f), 1.0f) * fillWeight;
+        float line = min(max(halfWidth + 0.5f - fabs(f) / max(max(fabs(gx), fabs(gy)), 1e-6f), 0.0f), 1.0f) * lineWeight;
+        float toStart = rowStart + shape.start[1] * x, toEnd = rowEnd + shape.end[1] * x;
+        float inside = shape.sweep == SWEEP_CONVEX ? min(toStart, toEnd) : max(toStart, toEnd);
+        float sweep = min(max(0.5f + inside, 0.0f), 1.0f);
+        fill = min(fill, sweep);
+        line = min(line, sweep);
+
+        float alpha = line + (1 - line) * fill, keep = 1 - alpha;
+        float lineShare = line * lineColor, fillShare = (1 - line) * fill;
+        uint32_t destination = pixels[column - cpuFramebufferX];
+        uint32_t red = (uint32_t)((lineShare + fillShare) * shape.red + (float)(destination & 0xff) * keep + 0.5f);
+        uint32_t green = (uint32_t)((lineShare + fillShare) * shape.green + (float)((destination >> 8) & 0xff) * keep + 0.5f);
+        uint32_t blue = (uint32_t)((lineShare + fillShare) * shape.blue + (float)((destination >> 16) & 0xff) * keep + 0.5f);
+        pixels[column - cpuFramebufferX] = red | (green << 8) | (blue << 16) | (255u << 24);
+    }
+}
+
+#ifdef HW05_X86
+// What: SSE2 version of shadeShapeRunScalar(), 4 pixels per iteration with the same operations in the same order
+void shadeShapeRunSSE2(const RasterShape& shape, uint32_t* pixels, int begin, int end, int row) {
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f), tiny = _mm_set1_ps(1e-6f);
+    const __m128 absolute = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3), channel = _mm_set1_epi32(0xff), opaque = _mm_set1_epi32((int)(255u << 24));
+    __m128 edge = _mm_set1_ps(lineWidth / 2 + 0.5f);
+    __m128 fillWeight = _mm_set1_ps(shape.kind == SHAPE_ARC ? 0.0f : 1.0f);
+    __m128 lineWeight = _mm_set1_ps(shape.kind == SHAPE_FILL_OUTLINE || shape.kind == SHAPE_ARC ? 1.0f : 0.0f);
+    __m128 lineColor = _mm_set1_ps(shape.kind == SHAPE_ARC ? 1.0f : 0.0f);
+    __m128 ux = _mm_set1_ps(shape.ux), vx = _mm_set1_ps(shape.vx), uy = _mm_set1_ps(shape.uy), vy = _mm_set1_ps(shape.vy);
+    __m128 originX = _mm_set1_ps(shape.x), startX = _mm_set1_ps(shape.start[1]), endX = _mm_set1_ps(shape.end[1]);
+    __m128 red = _mm_set1_ps(shape.red), green = _mm_set1_ps(shape.green), blue = _mm_set1_ps(shape.blue);
+    float y = (float)row + 0.5f - shape.y;
+    __m128 rowU = _mm_set1_ps(shape.u + shape.uy * y), rowV = _mm_set1_ps(shape.v + shape.vy * y);
+    __m128 rowStart = _mm_set1_ps(shape.start[0] + shape.start[2] * y), rowEnd = _mm_set1_ps(shape.end[0] + shape.end[2] * y);
+    for (int column = begin; column < end; column += 4) {
+        // The last 1 to 3 pixels of the run go through a copy, so no store reaches past it
+        uint32_t tail[4];
+        int count = min(4, end - column);
+        uint32_t* target = count == 4 ? pixels + (column - cpuFramebufferX) : tail;
+        if (count < 4) {
+            memcpy(tail, pixels + (column - cpuFramebufferX), count * sizeof(uint32_t));
+        }
+        __m128 x = _mm_sub_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(column), lanes)), half), originX);
+        __m128 u = _mm_add_ps(rowU, _mm_mul_ps(ux, x)), v = _mm_add_ps(rowV, _mm_mul_ps(vx, x));
+        __m128 r = _mm_max_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(u, u), _mm_mul_ps(v, v))), tiny);
+        __m128 gx = _mm_div_ps(_mm_add_ps(_mm_mul_ps(u, ux), _mm_mul_ps(v, vx)), r);
+        __m128 gy = _mm_div_ps(_mm_add_ps(_mm_mul_ps(u, uy), _mm_mul_ps(v, vy)), r);
+        __m128 f = _mm_sub_ps(r, one);
+        __m128 gradient = _mm_max_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gy, gy))), tiny);
+        __m128 fill = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_sub_ps(half, _mm_div_ps(f, gradient)), zero), one), fillWeight);
+        __m128 axis = _mm_max_ps(_mm_max_ps(_mm_and_ps(gx, absolute), _mm_and_ps(gy, absolute)), tiny);
+        __m128 line = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_sub_ps(edge, _mm_div_ps(_mm_and_ps(f, absolute), axis)), zero), one), lineWeight);
+        __m128 toStart = _mm_add_ps(rowStart, _mm_mul_ps(startX, x)), toEnd = _mm_add_ps(rowEnd, _mm_mul_ps(endX, x));
+        __m128 inside = shape.sweep == SWEEP_CONVEX ? _mm_min_ps(toStart, toEnd) : _mm_max_ps(toStart, toEnd);
+        __m128 sweep = _mm_min_ps(_mm_max_ps(_mm_add_ps(half, inside), zero), one);
+        fill = _mm_min_ps(fill, sweep);
+        line = _mm_min_ps(line, sweep);
+
+        __m128 alpha = _mm_add_ps(line, _mm_mul_ps(_mm_sub_ps(one, line), fill)), keep = _mm_sub_ps(one, alpha);
+        __m128 share = _mm_add_ps(_mm_mul_ps(line, lineColor), _mm_mul_ps(_mm_sub_ps(one, line), fill));
+        __m128i destination = _mm_loadu_si128((const __m128i*)target);
+        __m128 channels[3] = { red, green, blue };
+        __m128i result = opaque;
+        for (int c = 0; c < 3; c++) {
+            __m128 below = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(destination, 8 * c), channel));
+            __m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(share, channels[c]), _mm_mul_ps(below, keep)), half);
+            result = _mm_or_si128(result, _mm_slli_epi32(_mm_cvttps_epi32(value), 8 * c));
+        }
+        _mm_storeu_si128((__m128i*)target, result);
+        if (count < 4) {
+            memcpy(pixels + (column - cpuFramebufferX), tail, count * sizeof(uint32_t));
+        }
+    }
+}
+#endif
+
+// What: Function to draw an analytic shape on the CPU
+//       Only the pixels near the edge need the distance. In every row, the columns within reach of the ellipse and
+//       those well inside it are found by intersecting the row with two circles on the plane of the unit circle;
+//       a pixel more than stretch times (lineWidth / 2 + 1) from the unit circle is at least lineWidth / 2 + 1 pixels
+//       from the ellipse. Pixels beyond the outer circle are left alone and those inside the inner circle are filled
+//       with one span, exactly as shading them would, so only the band around the edge is shaded pixel by pixel.
+// Input: shape - the shape
+//        color - its packed fill color
+//        clipX0, clipY0, clipX1, clipY1 - only pixels in [clipX0, clipX1) x [clipY0, clipY1) are written
+// Output: The number of pixels written
+// Action: The function shades the band around the edge of the shape and fills its inside, within the clipping rectangle.
+// Caller: rasterizeTile()
+int rasterizeShape(const RasterShape& shape, uint32_t color, int clipX0, int clipY0, int clipX1, int clipY1) {
+    float reach = shape.kind == SHAPE_FILL || shape.kind == SHAPE_SECTOR ? shape.stretch : (lineWidth / 2 + 1) * shape.stretch;
+    float outer = 1 + reach;
+    // Sectors are cut by their edges, and arcs have nothing inside
+    float inner = shape.kind == SHAPE_FILL || shape.kind == SHAPE_FILL_OUTLINE ? 1 - reach : 0;
+    float a = shape.ux * shape.ux + shape.vx * shape.vx;
+
+    // Columns whose centers are within a circle of the given radius, from the roots of |(u, v)|^2 = radius^2 along the row
+    auto columns = [&](float rowU, float rowV, float radius, int& begin, int& end) {
+        float b = rowU * shape.ux + rowV * shape.vx, c = rowU * rowU + rowV * rowV - radius * radius;
+        float discriminant = b * b - a * c;
+        if (radius <= 0 || discriminant < 0) {
+            return false;
+        }
+        float root = sqrt(discriminant);
+        begin = (int)ceil((-b - root) / a + shape.x - 0.5f);
+        end = (int)floor((-b + root) / a + shape.x - 0.5f) + 1;
+        return true;
+    };
+
+    int written = 0;
+    for (int row = clipY0; row < clipY1; row++) {
+        // u and v at the column whose center is at shape.x
+        float y = (float)row + 0.5f - shape.y;
+        float rowU = shape.u + shape.uy * y, rowV = shape.v + shape.vy * y;
+        int begin, end, innerBegin, innerEnd;
+        if (!columns(rowU, rowV, outer, begin, end)) {
+            continue;
+        }
+        begin = max(clipX0, begin - 1); // One more on both sides for the rounding of the roots
+        end = min(clipX1, end + 1);
+        if (begin >= end) {
+            continue;
+        }
+        if (columns(rowU, rowV, inner, innerBegin, innerEnd)) {
+            innerBegin = min(max(innerBegin + 1, begin), end);
+            innerEnd = max(min(innerEnd - 1, end), innerBegin);
+        }
+        else {
+            innerBegin = innerEnd = end;
+        }
+
+        uint32_t* pixels = &cpuFramebuffer[(size_t)(row - cpuFramebufferY) * cpuFramebufferWidth];
+#ifdef HW05_X86
+        void (*shade)(const RasterShape&, uint32_t*, int, int, int) = simdLevel >= SIMD_SSE2 ? shadeShapeRunSSE2 : shadeShapeRunScalar;
+#else
+        void (*shade)(const RasterShape&, uint32_t*, int, int, int) = shadeShapeRunScalar;
+#endif
+        shade(shape, pixels, begin, innerBegin, row);
+        if (shape.kind != SHAPE_ARC) {
+            fillSpan(pixels + (innerBegin - cpuFramebufferX), innerEnd - innerBegin, color);
+        }
+        shade(shape, pixels, innerEnd, end, row);
+        written += shape.kind == SHAPE_ARC ? (innerBegin - begin) + (end - innerEnd) : end - begin;
+    }
+    return written;
+}
+
+// What: Function to rasterize the frame on the CPU
+//       Most of a frame is usually the same as in the previous one: once the character stops growing, only the legs,
+//       the copter blades and the balloons move. The polygons at the start of the frame that did not change form the
+//       static layer, which is rasterized once and kept. Each frame then only redraws the dirty rectangles around the
+//       polygons that changed, by copying them from the layer and drawing the later polygons over them; every other
+//       pixel still holds the same color from the previous frame. The result is the same image as a full redraw.
+// Input: None (reads framePrimitives, frameTriangles and frameLines)
+// Output: None
+// Action: The function bins the frame's polygons into tiles, compares them with the previous frame and either
+//         redraws everything, rebuilds the static layer, or redraws only the dirty rectangles.
+// Caller: flushFrame()
+void rasterizeFrame() {
+    binFramePolygons();
+    framePixelsWritten = 0;
+
+    // Count the polygons at the start of the frame that are the same as in the previous frame
+    int polygonCount = (int)rasterPolygons.size();
+    int unchanged = 0;
+    if (layerCacheEnabled && cpuFrameValid && previousClearColor == cpuClearColor) {
+        int common = min(polygonCount, (int)previousRasterPolygons.size());
+        while (unchanged < common) {
+            if (!samePolygon(rasterPolygons[unchanged], previousRasterPolygons[unchanged])) {
+                break;
+            }
+            unchanged++;
+        }
+    }
+
+    dirtyRects.assign(1, { cpuFramebufferX, cpuFramebufferY, cpuFramebufferX + cpuFramebufferWidth, cpuFramebufferY + cpuFramebufferHeight });
+    if (unchanged == 0) {
+        // Everything moved (or there is no previous frame): redraw the whole frame
+        staticLayerPolygons = 0;
+        passBase = TILE_CLEAR;
+        passFirstPolygon = 0;
+        passEndPolygon = polygonCount;
+        rasterizePass();
+    }
+    else if (unchanged != staticLayerPolygons) {
+        // The unchanged part is new: draw it and keep it as the static layer, then draw the rest over it
+        passBase = TILE_CLEAR;
+        passFirstPolygon = 0;
+        passEndPolygon = unchanged;
+        rasterizePass();
+        cpuStaticLayer = cpuFramebuffer;
+        staticLayerPolygons = unchanged;
+        framePixelsWritten += (long long)cpuStaticLayer.size();
+
+        passBase = TILE_KEEP;
+        passFirstPolygon = unchanged;
+        passEndPolygon = polygonCount;
+        rasterizePass();
+    }
+    else {
+        // Only redraw around what changed
+        findDirtyRects(staticLayerPolygons);
+        passBase = TILE_RESTORE;
+        passFirstPolygon = staticLayerPolygons;
+        passEndPolygon = polygonCount;
+        rasterizePass();
+    }
+    cpuFrameValid = true;
+    previousClearColor = cpuClearColor;
+    totalPixelsWritten += framePixelsWritten;
+
+    // Keep this frame's polygons to compare the next frame with
+    swap(rasterX, previousRasterX);
+    swap(rasterY, previousRasterY);
+    swap(rasterPolygons, previousRasterPolygons);
+    swap(rasterShapes, previousRasterShapes);
+}
+
+// What: Function to compare a polygon of this frame with one of the previous frame
+// Input: polygon - a polygon in rasterPolygons
+//        previous - a polygon in previousRasterPolygons
+// Output: true if both draw the same pixels
+// Action: The function compares the colors, the vertices and, for analytic shapes, the shapes.
+// Caller: rasterizeFrame() and findDirtyRects()
+bool samePolygon(const RasterPolygon& polygon, const RasterPolygon& previous) {
+    if (polygon.count != previous.count || polygon.color != previous.color || (polygon.shape >= 0) != (previous.shape >= 0)) {
+        return false;
+    }
+    if (polygon.shape >= 0 && memcmp(&rasterShapes[polygon.shape], &previousRasterShapes[previous.shape], sizeof(RasterShape)) != 0) {
+        return false;
+    }
+    return memcmp(&rasterX[polygon.first], &previousRasterX[previous.first], polygon.count * sizeof(float)) == 0
+        && memcmp(&rasterY[polygon.first], &previousRasterY[previous.first], polygon.count * sizeof(float)) == 0;
+}
+
+// What: Function to rasterize the tiles for one pass over the frame
+//       The frame is split into TILE_WIDTH x TILE_HEIGHT tiles. Every tile is written by exactly one thread, which
+//       redraws the dirty rectangles inside it, so threads never touch the same pixels.
+//       The tiles are spread over one queue per thread; a thread that runs out of tiles steals from the others.
+// Input: None (uses dirtyRects, passBase, passFirstPolygon and passEndPolygon)
+// Output: None
+// Action: The function rasterizes all tiles on renderThreads threads.
+// Caller: rasterizeFrame()
+void rasterizePass() {
+    // Give every thread an equal, contiguous range of tiles
+    int tileCount = tileColumns * tileRows;
+    if (!tileQueues) {
+        tileQueues.reset(new TileQueue[renderThreads]);
+    }
+    for (int worker = 0; worker < renderThreads; worker++) {
+        uint64_t begin = (uint64_t)tileCount * worker / renderThreads;
+        uint64_t end = (uint64_t)tileCount * (worker + 1) / renderThreads;
+        tileQueues[worker].range.store(begin | (end << 32));
+    }
+
+    if (renderThreads == 1) {
+        runTileQueue(0);
+    }
+    else {
+        // Start the workers (the first time, create them), rasterize with them and wait until they are done
+        if (rasterWorkers.empty()) {
+            rasterShutdown = false;
+            for (int worker = 1; worker < renderThreads; worker++) {
+                rasterWorkers.push_back(thread(rasterWorker, worker));
+            }
+            static bool stopAtExit = (atexit(stopRasterWorkers), true);
+            (void)stopAtExit;
+        }
+        {
+            lock_guard<mutex> lock(rasterMutex);
+            rasterWorkersBusy = renderThreads - 1;
+            rasterGeneration++;
+        }
+        rasterStart.notify_all();
+        runTileQueue(0);
+        unique_lock<mutex> lock(rasterMutex);
+        rasterDone.wait(lock, [] { return rasterWorkersBusy == 0; });
+    }
+}
+
+// What: Function to find the parts of the frame that changed
+//       A polygon that moved leaves its old place and covers a new one, so both its old and its new bounds are dirty.
+//       Consecutive changed polygons that touch (the segments of an outline, the fill and outline of a balloon)
+//       are merged into one rectangle as they are found, and the rectangles that overlap are merged at the end.
+// Input: firstPolygon - the first polygon not in the static layer
+// Output: None
+// Action: The function compares every later polygon with the one at the same place in the previous frame and
+//         fills dirtyRects with the merged bounds of those that differ.
+// Caller: rasterizeFrame()
+void findDirtyRects(int firstPolygon) {
+    auto touches = [](const PixelRect& a, const PixelRect& b) {
+        return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1;
+    };
+    auto merge = [](PixelRect& a, const PixelRect& b) {
+        a = { min(a.x0, b.x0), min(a.y0, b.y0), max(a.x1, b.x1), max(a.y1, b.y1) };
+    };
+    auto add = [&](const RasterPolygon& polygon) {
+        PixelRect bounds = { polygon.x0, polygon.y0, polygon.x1, polygon.y1 };
+        if (!dirtyRects.empty() && touches(dirtyRects.back(), bounds)) {
+            merge(dirtyRects.back(), bounds);
+        }
+        else {
+            dirtyRects.push_back(bounds);
+        }
+    };
+
+    dirtyRects.clear();
+    int polygonCount = (int)rasterPolygons.size(), previousCount = (int)previousRasterPolygons.size();
+    for (int i = firstPolygon; i < max(polygonCount, previousCount); i++) {
+        if (i < polygonCount && i < previousCount && samePolygon(rasterPolygons[i], previousRasterPolygons[i])) {
+            continue;
+        }
+        if (i < previousCount) {
+            add(previousRasterPolygons[i]);
+        }
+        if (i < polygonCount) {
+            add(rasterPolygons[i]);
+        }
+    }
+
+    // Merge overlapping rectangles so no pixel is redrawn twice
+    for (size_t i = 0; i < dirtyRects.size(); i++) {
+        for (size_t j = i + 1; j < dirtyRects.size(); j++) {
+            if (touches(dirtyRects[i], dirtyRects[j])) {
+                merge(dirtyRects[i], dirtyRects[j]);
+                dirtyRects.erase(dirtyRects.begin() + j);
+                j = i; // The grown rectangle may now touch earlier ones
+            }
+        }
+    }
+}
+
+// What: Function to prepare the frame's polygons for the tiles
+// Input: None (reads framePrimitives, frameTriangles, frameLines and frameQuads)
+// Output: None
+// Action: The function maps every primitive from the clipping planes to pixels: a triangle fan becomes its outline,
+//         cut into convex pieces if it is a sector of more than 180 degrees, every line segment a lineWidth-wide
+//         parallelogram (widened vertically for x-major lines and horizontally for y-major lines, like OpenGL) and the
+//         quad of an analytic shape a polygon with the shape in rasterShapes. Each polygon is added, in draw order, to the bin of every tile its bounding box touches.
+// Caller: rasterizeFrame()
+void binFramePolygons() {
+    float scaleX = (float)(windowWidth / (clippingPlanRight - clippingPlanLeft));
+    float scaleY = (float)(windowHeight / (clippingPlanTop - clippingPlanBottom));
+    float offsetX = (float)-clippingPlanLeft * scaleX;
+    float offsetY = (float)-clippingPlanBottom * scaleY;
+    float halfWidth = lineWidth / 2;
+
+    rasterX.clear();
+    rasterY.clear();
+    rasterPolygons.clear();
+    rasterShapes.clear();
+    for (vector<int>& bin : tileBins) {
+        bin.clear();
+    }
+
+    // Adds the vertices appended since "first" as a polygon and bins it; false if it is off screen
+    auto addPolygon = [](int first, uint32_t color, int shape) {
+        int count = (int)rasterX.size() - first;
+        float xMin = *min_element(rasterX.begin() + first, rasterX.end());
+        float xMax = *max_element(rasterX.begin() + first, rasterX.end());
+        float yMin = *min_element(rasterY.begin() + first, rasterY.end());
+        float yMax = *max_element(rasterY.begin() + first, rasterY.end());
+        RasterPolygon polygon = { first, count, color,
+            max(cpuFramebufferX, (int)floor(xMin)), max(cpuFramebufferY, (int)floor(yMin)),
+            min(cpuFramebufferX + cpuFramebufferWidth, (int)ceil(xMax)), min(cpuFramebufferY + cpuFramebufferHeight, (int)ceil(yMax)), shape };
+        if (polygon.x0 >= polygon.x1 || polygon.y0 >= polygon.y1) {
+            rasterX.resize(first);
+            rasterY.resize(first);
+            return false; // Entirely off screen
+        }
+        int index = (int)rasterPolygons.size();
+        rasterPolygons.push_back(polygon);
+        for (int tileY = (polygon.y0 - cpuFramebufferY) / TILE_HEIGHT; tileY <= (polygon.y1 - 1 - cpuFramebufferY) / TILE_HEIGHT; tileY++) {
+            for (int tileX = (polygon.x0 - cpuFramebufferX) / TILE_WIDTH; tileX <= (polygon.x1 - 1 - cpuFramebufferX) / TILE_WIDTH; tileX++) {
+                tileBins[(size_t)tileY * tileColumns + tileX].push_back(index);
+            }
+        }
+        return true;
+    };
+
+    for (const MeshPrimitive& primitive : framePrimitives) {
+        if (primitive.mode == GL_QUADS) {
+            // The quad is the polygon, clipping the shape to the pixels it can reach
+            const ShapeVertex* q = &frameQuads[primitive.first];
+            int first = (int)rasterX.size();
+            for (int i = 0; i < 4; i++) {
+                rasterX.push_back(q[i].x * scaleX + offsetX);
+                rasterY.push_back(q[i].y * scaleY + offsetY);
+            }
+            // Pixel-space change along u and v, inverted to get the change of u and v per pixel
+            float ax = (rasterX[first + 1] - rasterX[first]) / (q[1].u - q[0].u), ay = (rasterY[first + 1] - rasterY[first]) / (q[1].u - q[0].u);
+            float bx = (rasterX[first + 3] - rasterX[first]) / (q[3].v - q[0].v), by = (rasterY[first + 3] - rasterY[first]) / (q[3].v - q[0].v);
+            float det = ax * by - ay * bx;
+            if (det == 0) {
+                rasterX.resize(first);
+                rasterY.resize(first);
+                continue;
+            }
+            RasterShape shape;
+            shape.x = rasterX[first];
+            shape.y = rasterY[first];
+            shape.u = q[0].u;
+            shape.v = q[0].v;
+            shape.ux = by / det;
+            shape.uy = -bx / det;
+            shape.vx = -ay / det;
+            shape.vy = ax / det;
+            // Largest singular value of the 2x2 matrix
+            float sum = shape.ux * shape.ux + shape.uy * shape.uy + shape.vx * shape.vx + shape.vy * shape.vy;
+            float product = shape.ux * shape.vy - shape.uy * shape.vx;
+            shape.stretch = sqrt((sum + sqrt(max(sum * sum - 4 * product * product, 0.0f))) / 2);
+            shape.kind = (ShapeKind)(int)q[0].kind;
+            shape.sweep = (ShapeSweep)(int)q[0].sweep;
+            if (shape.sweep == SWEEP_FULL) {
+                shape.start[0] = shape.end[0] = 1e6f;
+                shape.start[1] = shape.start[2] = shape.end[1] = shape.end[2] = 0;
+            }
+            else {
+                // The first edge is positive on its counterclockwise side and the last one on its clockwise side
+                float sx = q[0].startX, sy = q[0].startY, ex = q[0].endX, ey = q[0].endY;
+                float start[3] = { sx * shape.v - sy * shape.u, sx * shape.vx - sy * shape.ux, sx * shape.vy - sy * shape.uy };
+                float end[3] = { shape.u * ey - shape.v * ex, shape.ux * ey - shape.vx * ex, shape.uy * ey - shape.vy * ex };
+                float startLength = max(hypot(start[1], start[2]), 1e-6f), endLength = max(hypot(end[1], end[2]), 1e-6f);
+                for (int i = 0; i < 3; i++) {
+                    shape.start[i] = start[i] / startLength;
+                    shape.end[i] = end[i] / endLength;
+                }
+            }
+            shape.red = q[0].r * 255.0f;
+            shape.green = q[0].g * 255.0f;
+            shape.blue = q[0].b * 255.0f;
+            if (addPolygon(first, packColor(q[0].r, q[0].g, q[0].b), (int)rasterShapes.size())) {
+                rasterShapes.push_back(shape);
+            }
+            continue;
+        }
+        const BatchVertex* v = primitive.mode == GL_TRIANGLES ? &frameTriangles[primitive.first] : &frameLines[primitive.first];
+        uint32_t color = packColor(v[0].r, v[0].g, v[0].b);
+
+        if (primitive.mode == GL_TRIANGLES) {
+            // The fan (v0, v1, v2), (v0, v2, v3), ... outlines the polygon v0, v1, v2, v3, ..., which is convex unless
+            // it is a filled arc of more than 180 degrees around v0. Such a fan is cut from v0 into convex pieces: a
+            // piece ends at the last vertex less than half a turn from its first edge, and the next one starts there
+            int first = (int)rasterX.size();
+            float centerX = v[0].x * scaleX + offsetX, centerY = v[0].y * scaleY + offsetY;
+            float edgeX = 0, edgeY = 0, turn = 0; // The piece's first edge from v0, and the side the fan turns to
+            rasterX.push_back(centerX);
+            rasterY.push_back(centerY);
+            for (int i = 1; i < primitive.count; i++) {
+                if (i >= 3 && i % 3 != 2) {
+                    continue;
+                }
+                float x = v[i].x * scaleX + offsetX, y = v[i].y * scaleY + offsetY;
+                int pieceVertices = (int)rasterX.size() - first;
+                if (pieceVertices == 1) {
+                    edgeX = x - centerX;
+                    edgeY = y - centerY;
+                }
+                else {
+                    float cross = edgeX * (y - centerY) - edgeY * (x - centerX);
+                    if (turn == 0) {
+                        turn = cross;
+                    }
+                    else if (cross * turn <= 0) {
+                        float lastX = rasterX.back(), lastY = rasterY.back();
+                        addPolygon(first, color, -1);
+                        first = (int)rasterX.size();
+                        rasterX.insert(rasterX.end(), { centerX, lastX });
+                        rasterY.insert(rasterY.end(), { centerY, lastY });
+                        edgeX = lastX - centerX;
+                        edgeY = lastY - centerY;
+                        turn = edgeX * (y - centerY) - edgeY * (x - centerX);
+                    }
+                }
+                rasterX.push_back(x);
+                rasterY.push_back(y);
+            }
+            addPolygon(first, color, -1);
+            continue;
+        }
+
+        for (int i = 0; i + 1 < primitive.count; i += 2) {
+            float x0 = v[i].x * scaleX + offsetX, y0 = v[i].y * scaleY + offsetY;
+            float x1 = v[i + 1].x * scaleX + offsetX, y1 = v[i + 1].y * scaleY + offsetY;
+            if (x0 == x1 && y0 == y1) {
+                continue; // Zero-length lines produce no pixels
+            }
+            int first = (int)rasterX.size();
+            if (fabs(x1 - x0) >= fabs(y1 - y0)) {
+                // X-major line: widen vertically
+                rasterX.insert(rasterX.end(), { x0, x1, x1, x0 });
+                rasterY.insert(rasterY.end(), { y0 - halfWidth, y1 - halfWidth, y1 + halfWidth, y0 + halfWidth });
+            }
+            else {
+                // Y-major line: widen horizontally
+                rasterX.insert(rasterX.end(), { x0 - halfWidth, x1 - halfWidth, x1 + halfWidth, x0 + halfWidth });
+                rasterY.insert(rasterY.end(), { y0, y1, y1, y0 });
+            }
+            addPolygon(first, color, -1);
+        }
+    }
+}
+
+// What: Function to rasterize one screen tile
+// Input: tile - index of the tile, row by row from the bottom left
+// Output: None
+// Action: For every dirty rectangle overlapping the tile, the function clears the overlap or copies it from the
+//         static layer (as passBase says), then fills, in draw order and clipped to the overlap, the polygons of the
+//         pass binned into the tile.
+// Caller: runTileQueue()
+void rasterizeTile(int tile) {
+    int tileX0 = cpuFramebufferX + tile % tileColumns * TILE_WIDTH, tileY0 = cpuFramebufferY + tile / tileColumns * TILE_HEIGHT;
+    int tileX1 = min(tileX0 + TILE_WIDTH, cpuFramebufferX + cpuFramebufferWidth), tileY1 = min(tileY0 + TILE_HEIGHT, cpuFramebufferY + cpuFramebufferHeight);
+    long long written = 0;
+    for (const PixelRect& rect : dirtyRects) {
+        int x0 = max(tileX0, rect.x0), y0 = max(tileY0, rect.y0), x1 = min(tileX1, rect.x1), y1 = min(tileY1, rect.y1);
+        if (x0 >= x1 || y0 >= y1) {
+            continue;
+        }
+        for (int row = y0; row < y1 && passBase != TILE_KEEP; row++) {
+            size_t offset = (size_t)(row - cpuFramebufferY) * cpuFramebufferWidth + x0 - cpuFramebufferX;
+            if (passBase == TILE_CLEAR) {
+                fillSpan(&cpuFramebuffer[offset], x1 - x0, cpuClearColor);
+            }
+            else {
+                memcpy(&cpuFramebuffer[offset], &cpuStaticLayer[offset], (x1 - x0) * sizeof(uint32_t));
+            }
+            written += x1 - x0;
+        }
+        for (int index : tileBins[tile]) {
+            if (index < passFirstPolygon || index >= passEndPolygon) {
+                continue;
+            }
+            const RasterPolygon& polygon = rasterPolygons[index];
+            if (polygon.shape >= 0) {
+                written += rasterizeShape(rasterShapes[polygon.shape], polygon.color,
+                    max(x0, polygon.x0), max(y0, polygon.y0), min(x1, polygon.x1), min(y1, polygon.y1));
+                continue;
+            }
+            written += rasterizeConvexPolygon(&rasterX[polygon.first], &rasterY[polygon.first], polygon.count, polygon.color,
+                max(x0, polygon.x0), max(y0, polygon.y0), min(x1, polygon.x1), min(y1, polygon.y1));
+        }
+    }
+    framePixelsWritten += written;
+}
+
+// What: Function to rasterize tiles until there are none left
+// Input: worker - index of the thread's own queue
+// Output: None
+// Action: The function takes tiles from the front of its own queue. When that queue is empty, it steals tiles from
+//         the back of the other queues, and it returns when every queue is empty.
+// Caller: rasterizeFrame() and rasterWorker()
+void runTileQueue(int worker) {
+    for (int i = 0; i < renderThreads; i++) {
+        TileQueue& queue = tileQueues[(worker + i) % renderThreads];
+        bool own = i == 0;
+        uint64_t range = queue.range.load();
+        for (;;) {
+            uint32_t next = (uint32_t)range, end = (uint32_t)(range >> 32);
+            if (next >= end) {
+                break; // This queue is empty, try the next one
+            }
+            uint64_t taken = own ? (uint64_t)(next + 1) | ((uint64_t)end << 32) : (uint64_t)next | ((uint64_t)(end - 1) << 32);
+            if (queue.range.compare_exchange_weak(range, taken)) {
+                rasterizeTile(own ? next : end - 1);
+                range = queue.range.load();
+            }
+        }
+    }
+}
+
+// What: Function run by every rasterizer worker thread
+// Input: worker - index of the worker's queue (1 to renderThreads - 1, the main thread uses queue 0)
+// Output: None
+// Action: The function waits for a new frame, rasterizes tiles with runTileQueue() and reports when it is done,
+//         until the workers are stopped.
+// Caller: rasterizeFrame(), through std::thread
+void rasterWorker(int worker) {
+    int generation = 0;
+    for (;;) {
+        {
+            unique_lock<mutex> lock(rasterMutex);
+            rasterStart.wait(lock, [&] { return rasterGeneration != generation || rasterShutdown; });
+            if (rasterShutdown) {
+                return;
+            }
+            generation = rasterGeneration;
+        }
+        runTileQueue(worker);
+        {
+            lock_guard<mutex> lock(rasterMutex);
+            if (--rasterWorkersBusy == 0) {
+                rasterDone.notify_one();
+            }
+        }
+    }
+}
+
+// What: Function to stop the rasterizer worker threads
+// Input: None
+// Output: None
+// Action: The function wakes the workers up, waits for them to exit and forgets the tile queues, so the next
+//         frame starts renderThreads fresh threads.
+// Caller: runScalingBenchmark() and atexit()
+void stopRasterWorkers() {
+    {
+        lock_guard<mutex> lock(rasterMutex);
+        rasterShutdown = true;
+    }
+    rasterStart.notify_all();
+    for (thread& worker : rasterWorkers) {
+        worker.join();
+    }
+    rasterWorkers.clear();
+    tileQueues.reset();
+    rasterGeneration = 0;
+}
+
+
+// Below are implementation of some objects
+
+// What: Function to draw the whole scene
+// Input: None (uses animation)
+// Output: None
+// Action: The function scales the character and appends Doraemon, the bamboo copter and the balloons to the frame command buffer.
+//         In crowd mode it draws the crowd instead. The meshes with pickable shapes it submits replace those of
+//         the last frame for the next click.
+// Caller: myDisplay() and runLodCheck()
+void drawScene() {
+    framePickSubmissions.clear();
+    framePickShapes.clear();
+    pickIndexValid = false; // The next click collects this frame's shapes
+    pickRecording = true;
+    if (crowdSize > 0) {
+        drawCrowd();
+    }
+    else {
+        // Translate to the current y position
+        pushTransform(); // Save the current transform
+        scaleTransform(animation.scaleCharacter, animation.scaleCharacter); // Scale the character
+
+        // Draw the Doraemon character, a Bamboo Copter, and balloons
+        drawCharacter();
+        if (selectedCharacter == 0) {
+            drawSelectionBox();
+        }
+
+        popTransform(); // Restore the saved transform
+    }
+    pickRecording = false;
+}
+
+// What: Function to draw one character
+// Input: None (uses animation and balloonFill)
+// Output: None
+// Action: The function draws the character of the scene file under the current transform if one is loaded, and
+//         Doraemon, the bamboo copter and the balloons otherwise.
+// Caller: drawScene() and drawCrowd()
+void drawCharacter() {
+    if (scene) {
+        drawSceneCharacter();
+        return;
+    }
+    drawDoraemon();
+    drawBambooCopter();
+    drawBalloons();
+}
+
+// What: Function to show the selected character
+// Input: None
+// Output: None
+// Action: The function draws CHARACTER_BOUNDS, the box around a character at scale 1, in red lines under the current transform.
+// Caller: drawScene() and drawCrowd()
+void drawSelectionBox() {
+    const float* b = CHARACTER_BOUNDS;
+    drawLine(b[0], b[1], b[2], b[1], 1.0, 0.0, 0.0);
+    drawLine(b[2], b[1], b[2], b[3], 1.0, 0.0, 0.0);
+    drawLine(b[2], b[3], b[0], b[3], 1.0, 0.0, 0.0);
+    drawLine(b[0], b[3], b[0], b[1], 1.0, 0.0, 0.0);
+}
+
+// What: Function to place the characters of the crowd
+//       The characters are spread over the view and half a view beyond each of its edges, so about a quarter of
+//       them are on screen. They get smaller as the crowd grows to keep it about as dense. Positions, sizes, phases
+//       and colors come from a fixed xorshift sequence, so every run and every backend draws the same crowd.
+// Input: count - the number of characters
+// Output: None
+// Action: The function fills crowd and sorts it from the top of the view down, so lower characters are drawn in front.
+// Caller: drawCrowd() and runAnimationBenchmark()
+void buildCrowd(int count) {
+    uint32_t seed = 2463534242u;
+    auto random = [&seed]() { // Uniform in [0, 1)
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return (seed >> 8) * (1.0f / 16777216.0f);
+    };
+    double width = clippingPlanRight - clippingPlanLeft, height = clippingPlanTop - clippingPlanBottom;
+    float baseScale = min(1.0f, 1.6f / sqrt((float)count));
+
+    struct Character {
+        float x, y, scale, phase;
+        GLfloat balloonColor[3];
+    };
+    vector<Character> characters(count);
+    for (Character& character : characters) {
+        character.x = (float)(clippingPlanLeft - width / 2 + 2 * width * random());
+        character.y = (float)(clippingPlanBottom - height / 2 + 2 * height * random());
+        character.scale = baseScale * (0.7f + 0.6f * random());
+        character.phase = (float)(int)(CROWD_PHASES * random());
+        for (GLfloat& channel : character.balloonColor) {
+            channel = 0.2f + 0.8f * random();
+        }
+    }
+    sort(characters.begin(), characters.end(), [](const Character& a, const Character& b) { return a.y > b.y; });
+
+    // Scatter the sorted characters into the arrays
+    crowd.x.resize(count);
+    crowd.y.resize(count);
+    crowd.scale.resize(count);
+    crowd.phase.resize(count);
+    crowd.balloonColor.resize((size_t)count * 6);
+    for (int i = 0; i < count; i++) {
+        crowd.x[i] = characters[i].x;
+        crowd.y[i] = characters[i].y;
+        crowd.scale[i] = characters[i].scale;
+        crowd.phase[i] = characters[i].phase;
+        copy(characters[i].balloonColor, characters[i].balloonColor + 3, &crowd.balloonColor[(size_t)i * 6]); // Both balloons
+        copy(characters[i].balloonColor, characters[i].balloonColor + 3, &crowd.balloonColor[(size_t)i * 6 + 3]);
+    }
+    vector<float>* channels[] = { &crowd.angle, &crowd.growth, &crowd.scaleRightLeg, &crowd.scaleLeftLeg, &crowd.balloonAngle };
+    for (vector<float>* channel : channels) {
+        channel->resize(count);
+    }
+    crowdLabelQuads.clear(); // Laid out again, for the new count, when the labels are next drawn
+    crowdLabelStart.clear();
+    crowdLabelWidth.clear();
+    selectedCharacter = -1; // It was a character of another crowd
+}
+
+// What: Function to draw the crowd
+//       Every character submits the same cached meshes under its own transform, so a crowd costs no tessellation
+//       and, with the OpenGL backend, two glDrawArrays calls per batch. A character whose bounds, widened by the
+//       line width, miss the viewing volume set up by myReshape() is skipped. The animation channels of all
+//       characters are brought to the frame's time at once by updateCrowdAnimation(). All meshes use the level of
+//       detail of the largest character, since a level per character would tessellate them again and again within
+//       the frame. The draw-order layers of a batch run out after FRAME_LAYER_LIMIT primitives; the OpenGL backend
+//       then draws the batch and clears the depth buffer, so later characters still cover earlier ones.
+// Input: None (uses crowdSize and animationTime)
+// Output: None
+// Action: The function builds the crowd if its size changed and updates its animation channels, then draws every
+//         visible character with its channels, its scale and its balloon color, and counts them in crowdVisible.
+// Caller: drawScene()
+void drawCrowd() {
+    if ((int)crowd.x.size() != crowdSize) {
+        buildCrowd(crowdSize);
+    }
+    updateCrowdAnimation(crowd, animationTime);
+
+    // One level of detail for all, that of the largest character with a stretched leg
+    float largest = 0;
+    for (float scale : crowd.scale) {
+        largest = max(largest, scale);
+    }
+    pushTransform();
+    scaleTransform(largest, largest * 1.2f);
+    lodLevelOverride = currentLodLevel();
+    popTransform();
+
+    // A line sticks out of a shape by half its width
+    float marginX = (float)(lineWidth / 2 * (clippingPlanRight - clippingPlanLeft) / windowWidth);
+    float marginY = (float)(lineWidth / 2 * (clippingPlanTop - clippingPlanBottom) / windowHeight);
+    AnimationState current = animation;
+    crowdVisible = 0;
+    for (int i = 0; i < crowdSize; i++) {
+        float x = crowd.x[i], y = crowd.y[i], scale = crowd.scale[i] * crowd.growth[i];
+        if (x + CHARACTER_BOUNDS[2] * scale + marginX < clippingPlanLeft
+            || x + CHARACTER_BOUNDS[0] * scale - marginX > clippingPlanRight
+            || y + CHARACTER_BOUNDS[3] * scale + marginY < clippingPlanBottom
+            || y + CHARACTER_BOUNDS[1] * scale - marginY > clippingPlanTop) {
+            continue; // Off screen
+        }
+        if (renderBackend == BACKEND_OPENGL && frameLayer > FRAME_LAYER_LIMIT - 1024) {
+            flushFrame(); // Out of layers: draw this batch, the next one is drawn over it
+            glClear(GL_DEPTH_BUFFER_BIT);
+            PROFILE_COUNT(COUNT_GL_CALLS, 1);
+        }
+        animation.angle = crowd.angle[i];
+        animation.scaleRightLeg = crowd.scaleRightLeg[i];
+        animation.scaleLeftLeg = crowd.scaleLeftLeg[i];
+        animation.balloonAngle = crowd.balloonAngle[i];
+        balloonFill = &crowd.balloonColor[(size_t)i * 6];
+        pickCharacter = i;
+
+        pushTransform();
+        translateTransform(x, y);
+        scaleTransform(scale, scale);
+        drawCharacter();
+        if (i == selectedCharacter) {
+            drawSelectionBox();
+        }
+        popTransform();
+        if (crowdLabels && openGLContext) {
+            // Centered above the balloons, from the labels laid out by the first frame that shows them
+            if (crowdLabelStart.empty()) {
+                for (int j = 0; j < crowdSize; j++) {
+                    char label[32];
+                    snprintf(label, sizeof(label), "Doraemon %d", j);
+                    crowdLabelStart.push_back((int)crowdLabelQuads.size());
+                    crowdLabelWidth.push_back(textWidth(label));
+                    layoutText(label, crowdLabelQuads);
+                }
+                crowdLabelStart.push_back((int)crowdLabelQuads.size());
+            }
+            float width = crowdLabelWidth[i] * (float)((clippingPlanRight - clippingPlanLeft) / windowWidth);
+            placeText(&crowdLabelQuads[crowdLabelStart[i]], crowdLabelStart[i + 1] - crowdLabelStart[i],
+                x - width / 2, y + CHARACTER_BOUNDS[3] * scale + marginY);
+        }
+        crowdVisible++;
+    }
+    animation = current;
+    balloonFill = balloonColor;
+    pickCharacter = 0;
+    lodLevelOverride = INT_MIN;
+}
+
+
+// Below is the animation of the crowd
+//   stepAnimation() advances one character by accumulating floats, so a state can only be reached by stepping
+//   through all the states before it. The crowd's channels are instead functions of time: the copter turns
+//   angularSpeed per step, the balloons swing 2 degrees per step between -26 and 26, and the character grows
+//   scaleSpeedCharacter per step for GROWTH_STEPS steps, moving its legs while it grows. Every frame computes them
+//   from the character's time (the frame's time plus its phase) for all characters at once, 4 (SSE2) or 8 (AVX2)
+//   at a time. The cost is the same for every frame, and any frame can be drawn on its own, as --jobs needs.
+//   Every path does the same float operations in the same order, so they give the same bits.
+
+// What: Function to compute a sine quickly
+//       The angle is reduced to [0, 2 pi) with 2 pi split into a short and a long part (Cody-Waite), so the reduction
+//       adds no error for the angles of the crowd, then folded into [-pi/2, pi/2], where the Taylor series up to x^9
+//       is within 3.6e-6 of the sine. Together with rounding, the result is within FAST_SINE_ERROR of sin().
+// Input: x - an angle in radians, at least 0 and below 2^24 / (2 pi)
+// Output: The sine of x
+// Action: The function reduces and folds x and evaluates the polynomial; the SIMD paths do the same per lane.
+// Caller: updateCrowdRange() and runAnimationBenchmark()
+inline float fastSine(float x) {
+    const float turn = (float)(1 / (2 * PI)), twoPiHigh = 6.28125f, twoPiLow = (float)(2 * PI - 6.28125);
+    const float pi = (float)PI, halfPi = (float)(PI / 2);
+    float turns = (float)(int)(x * turn);
+    x = x - turns * twoPiHigh - turns * twoPiLow;
+    x = x > halfPi ? pi - x : x;
+    x = x < -halfPi ? -pi - x : x;
+    float x2 = x * x;
+    return x * (1 + x2 * (-1.0f / 6 + x2 * (1.0f / 120 + x2 * (-1.0f / 5040 + x2 * (1.0f / 362880)))));
+}
+
+// What: Function to update the animation channels of some characters, one at a time
+// Input: actors - the crowd
+//        begin, end - the range of characters
+//        cycleTime - the frame's time within CROWD_CYCLE, in steps
+//        growthTime - the frame's time, at most GROWTH_STEPS
+// Output: None
+// Action: The function computes the copter angle, growth, leg scales and balloon angle of every character of the range.
+// Caller: updateCrowdAnimation() and the SIMD paths, for the characters after the last full vector
+void updateCrowdRange(CrowdActors& actors, int begin, int end, float cycleTime, float growthTime) {
+    for (int i = begin; i < end; i++) {
+        float phase = actors.phase[i];
+        float t = cycleTime + phase;
+        t = t >= CROWD_CYCLE ? t - CROWD_CYCLE : t;
+        float angle = t * angularSpeed;
+        angle = angle - 360.0f * (float)(int)(angle * (1.0f / 360));
+        actors.angle[i] = angle;
+
+        float grown = min(growthTime + phase, GROWTH_STEPS);
+        float swing = (MAX_LEG_SCALE - MIN_LEG_SCALE) * (fastSine(LEG_FREQUENCY * angle) + 1) * 0.5f;
+        actors.scaleRightLeg[i] = grown < GROWTH_STEPS ? MIN_LEG_SCALE + swing : 1.0f;
+        actors.scaleLeftLeg[i] = grown < GROWTH_STEPS ? MAX_LEG_SCALE - swing : 1.0f;
+        actors.growth[i] = (initialAnimation.scaleCharacter + grown * scaleSpeedCharacter) * (1 / MAX_CHARACTER_SCALE);
+
+        float swingStep = t - BALLOON_PERIOD * (float)(int)(t * (1 / BALLOON_PERIOD));
+        swingStep = swingStep + BALLOON_PERIOD / 4;
+        swingStep = swingStep >= BALLOON_PERIOD ? swingStep - BALLOON_PERIOD : swingStep;
+        actors.balloonAngle[i] = BALLOON_PERIOD / 2 - 2 * fabs(swingStep - BALLOON_PERIOD / 2);
+    }
+}
+
+#ifdef HW05_X86
+// What: Function to update the animation channels of the crowd with SSE2, 4 characters per instruction
+//       Every lane runs the same operations as updateCrowdRange(), truncations included, so the channels are
+//       bit-identical to the scalar path's.
+// Input: actors - the crowd
+//        count - the number of characters
+//        cycleTime - the frame's time within CROWD_CYCLE, in steps
+//        growthTime - the frame's time, at most GROWTH_STEPS
+// Output: None
+// Action: The function computes the copter angle, growth, leg scales and balloon angle of 4 characters at a time and
+//         leaves the characters after the last full vector to updateCrowdRange().
+// Caller: updateCrowdAnimation()
+void updateCrowdAnimationSSE2(CrowdActors& actors, int count, float cycleTime, float growthTime) {
+    const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps(), signBit = _mm_set1_ps(-0.0f);
+    const __m128 pi = _mm_set1_ps((float)PI), halfPi = _mm_set1_ps((float)(PI / 2));
+    const __m128 period = _mm_set1_ps(BALLOON_PERIOD), cycle = _mm_set1_ps(CROWD_CYCLE), growthSteps = _mm_set1_ps(GROWTH_STEPS);
+    auto select = [](__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); };
+    auto truncate = [](__m128 x) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(x)); };
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 phase = _mm_loadu_ps(&actors.phase[i]);
+        __m128 t = _mm_add_ps(_mm_set1_ps(cycleTime), phase);
+        t = _mm_sub_ps(t, _mm_and_ps(_mm_cmpge_ps(t, cycle), cycle));
+        __m128 angle = _mm_mul_ps(t, _mm_set1_ps(angularSpeed));
+        angle = _mm_sub_ps(angle, _mm_mul_ps(_mm_set1_ps(360.0f), truncate(_mm_mul_ps(angle, _mm_set1_ps(1.0f / 360)))));
+        _mm_storeu_ps(&actors.angle[i], angle);
+
+        // fastSine(LEG_FREQUENCY * angle)
+        __m128 x = _mm_mul_ps(_mm_set1_ps(LEG_FREQUENCY), angle);
+        __m128 turns = truncate(_mm_mul_ps(x, _mm_set1_ps((float)(1 / (2 * PI)))));
+        x = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(turns, _mm_set1_ps(6.28125f))), _mm_mul_ps(turns, _mm_set1_ps((float)(2 * PI - 6.28125))));
+        x = select(_mm_cmpgt_ps(x, halfPi), _mm_sub_ps(pi, x), x);
+        x = select(_mm_cmplt_ps(x, _mm_sub_ps(zero, halfPi)), _mm_sub_ps(_mm_sub_ps(zero, pi), x), x);
+        __m128 x2 = _mm_mul_ps(x, x);
+        __m128 sine = _mm_add_ps(_mm_set1_ps(-1.0f / 5040), _mm_mul_ps(x2, _mm_set1_ps(1.0f / 362880)));
+        sine = _mm_add_ps(_mm_set1_ps(1.0f / 120), _mm_mul_ps(x2, sine));
+        sine = _mm_add_ps(_mm_set1_ps(-1.0f / 6), _mm_mul_ps(x2, sine));
+        sine = _mm_mul_ps(x, _mm_add_ps(one, _mm_mul_ps(x2, sine)));
+
+        __m128 grown = _mm_min_ps(_mm_add_ps(_mm_set1_ps(growthTime), phase), growthSteps);
+        __m128 growing = _mm_cmplt_ps(grown, growthSteps);
+        __m128 swing = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(MAX_LEG_SCALE - MIN_LEG_SCALE), _mm_add_ps(sine, one)), _mm_set1_ps(0.5f));
+        _mm_storeu_ps(&actors.scaleRightLeg[i], select(growing, _mm_add_ps(_mm_set1_ps(MIN_LEG_SCALE), swing), one));
+        _mm_storeu_ps(&actors.scaleLeftLeg[i], select(growing, _mm_sub_ps(_mm_set1_ps(MAX_LEG_SCALE), swing), one));
+        _mm_storeu_ps(&actors.growth[i], _mm_mul_ps(_mm_add_ps(_mm_set1_ps(initialAnimation.scaleCharacter),
+            _mm_mul_ps(grown, _mm_set1_ps(scaleSpeedCharacter))), _mm_set1_ps(1 / MAX_CHARACTER_SCALE)));
+
+        __m128 swingStep = _mm_sub_ps(t, _mm_mul_ps(period, truncate(_mm_mul_ps(t, _mm_set1_ps(1 / BALLOON_PERIOD)))));
+        swingStep = _mm_add_ps(swingStep, _mm_set1_ps(BALLOON_PERIOD / 4));
+        swingStep = _mm_sub_ps(swingStep, _mm_and_ps(_mm_cmpge_ps(swingStep, period), period));
+        __m128 distance = _mm_andnot_ps(signBit, _mm_sub_ps(swingStep, _mm_set1_ps(BALLOON_PERIOD / 2)));
+        _mm_storeu_ps(&actors.balloonAngle[i], _mm_sub_ps(_mm_set1_ps(BALLOON_PERIOD / 2), _mm_mul_ps(_mm_set1_ps(2.0f), distance)));
+    }
+    updateCrowdRange(actors, i, count, cycleTime, growthTime);
+}
+
+// What: Function to update the animation channels of the crowd with AVX2, 8 characters per instruction
+//       The same operations as updateCrowdAnimationSSE2(), with a rounding instruction for the truncations and blends
+//       for the selections. There is no AVX-512 path, this one also runs on AVX-512 processors.
+// Input: actors - the crowd
+//        count - the number of characters
+//        cycleTime - the frame's time within CROWD_CYCLE, in steps
+//        growthTime - the frame's time, at most GROWTH_STEPS
+// Output: None
+// Action: The function computes the copter angle, growth, leg scales and balloon angle of 8 characters at a time and
+//         leaves the characters after the last full vector to updateCrowdRange().
+// Caller: updateCrowdAnimation()
+HW05_TARGET("avx2") void updateCrowdAnimationAVX2(CrowdActors& actors, int count, float cycleTime, float growthTime) {
+    const __m256 one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps(), signBit = _mm256_set1_ps(-0.0f);
+    const __m256 pi = _mm256_set1_ps((float)PI), halfPi = _mm256_set1_ps((float)(PI / 2));
+    const __m256 period = _mm256_set1_ps(BALLOON_PERIOD), cycle = _mm256_set1_ps(CROWD_CYCLE), growthSteps = _mm256_set1_ps(GROWTH_STEPS);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 phase = _mm256_loadu_ps(&actors.phase[i]);
+        __m256 t = _mm256_add_ps(_mm256_set1_ps(cycleTime), phase);
+        t = _mm256_sub_ps(t, _mm256_and_ps(_mm256_cmp_ps(t, cycle, _CMP_GE_OQ), cycle));
+        __m256 angle = _mm256_mul_ps(t, _mm256_set1_ps(angularSpeed));
+        __m256 wraps = _mm256_round_ps(_mm256_mul_ps(angle, _mm256_set1_ps(1.0f / 360)), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        angle = _mm256_sub_ps(angle, _mm256_mul_ps(_mm256_set1_ps(360.0f), wraps));
+        _mm256_storeu_ps(&actors.angle[i], angle);
+
+        // fastSine(LEG_FREQUENCY * angle)
+        __m256 x = _mm256_mul_ps(_mm256_set1_ps(LEG_FREQUENCY), angle);
+        __m256 turns = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps((float)(1 / (2 * PI)))), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        x = _mm256_sub_ps(_mm256_sub_ps(x, _mm256_mul_ps(turns, _mm256_set1_ps(6.28125f))), _mm256_mul_ps(turns, _mm256_set1_ps((float)(2 * PI - 6.28125))));
+        x = _mm256_blendv_ps(x, _mm256_sub_ps(pi, x), _mm256_cmp_ps(x, halfPi, _CMP_GT_OQ));
+        x = _mm256_blendv_ps(x, _mm256_sub_ps(_mm256_sub_ps(zero, pi), x), _mm256_cmp_ps(x, _mm256_sub_ps(zero, halfPi), _CMP_LT_OQ));
+        __m256 x2 = _mm256_mul_ps(x, x);
+        __m256 sine = _mm256_add_ps(_mm256_set1_ps(-1.0f / 5040), _mm256_mul_ps(x2, _mm256_set1_ps(1.0f / 362880)));
+        sine = _mm256_add_ps(_mm256_set1_ps(1.0f / 120), _mm256_mul_ps(x2, sine));
+        sine = _mm256_add_ps(_mm256_set1_ps(-1.0f / 6), _mm256_mul_ps(x2, sine));
+        sine = _mm256_mul_ps(x, _mm256_add_ps(one, _mm256_mul_ps(x2, sine)));
+
+        __m256 grown = _mm256_min_ps(_mm256_add_ps(_mm256_set1_ps(growthTime), phase), growthSteps);
+        __m256 growing = _mm256_cmp_ps(grown, growthSteps, _CMP_LT_OQ);
+        __m256 swing = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(MAX_LEG_SCALE - MIN_LEG_SCALE), _mm256_add_ps(sine, one)), _mm256_set1_ps(0.5f));
+        _mm256_storeu_ps(&actors.scaleRightLeg[i], _mm256_blendv_ps(one, _mm256_add_ps(_mm256_set1_ps(MIN_LEG_SCALE), swing), growing));
+        _mm256_storeu_ps(&actors.scaleLeftLeg[i], _mm256_blendv_ps(one, _mm256_sub_ps(_mm256_set1_ps(MAX_LEG_SCALE), swing), growing));
+        _mm256_storeu_ps(&actors.growth[i], _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(initialAnimation.scaleCharacter),
+            _mm256_mul_ps(grown, _mm256_set1_ps(scaleSpeedCharacter))), _mm256_set1_ps(1 / MAX_CHARACTER_SCALE)));
+
+        __m256 swings = _mm256_round_ps(_mm256_mul_ps(t, _mm256_set1_ps(1 / BALLOON_PERIOD)), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        __m256 swingStep = _mm256_add_ps(_mm256_sub_ps(t, _mm256_mul_ps(period, swings)), _mm256_set1_ps(BALLOON_PERIOD / 4));
+        swingStep = _mm256_sub_ps(swingStep, _mm256_and_ps(_mm256_cmp_ps(swingStep, period, _CMP_GE_OQ), period));
+        __m256 distance = _mm256_andnot_ps(signBit, _mm256_sub_ps(swingStep, _mm256_set1_ps(BALLOON_PERIOD / 2)));
+        _mm256_storeu_ps(&actors.balloonAngle[i], _mm256_sub_ps(_mm256_set1_ps(BALLOON_PERIOD / 2), _mm256_mul_ps(_mm256_set1_ps(2.0f), distance)));
+    }
+    _mm256_zeroupper(); // The compiler does not always do it before the tail call, and SSE code after AVX code is slow
+    updateCrowdRange(actors, i, count, cycleTime, growthTime);
+}
+#endif
+
+// What: Function to bring the crowd's animation channels to a point of the animation
+// Input: actors - the crowd
+//        time - the time, in animation steps since frame 0, fractions included
+// Output: None
+// Action: The function reduces the time to the crowd's cycle and computes every character's channels with the widest
+//         path simdLevel allows (the AVX2 path also serves AVX-512).
+// Caller: drawCrowd() and runAnimationBenchmark()
+void updateCrowdAnimation(CrowdActors& actors, double time) {
+    int count = (int)actors.phase.size();
+    float cycleTime = (float)fmod(time, (double)CROWD_CYCLE), growthTime = (float)min(time, (double)GROWTH_STEPS);
+    PROFILE_COUNT(COUNT_TRIG, count); // One fastSine() per character for the legs
+#ifdef HW05_X86
+    if (simdLevel >= SIMD_AVX2) {
+        updateCrowdAnimationAVX2(actors, count, cycleTime, growthTime);
+        return;
+    }
+    if (simdLevel == SIMD_SSE2) {
+        updateCrowdAnimationSSE2(actors, count, cycleTime, growthTime);
+        return;
+    }
+#endif
+    updateCrowdRange(actors, 0, count, cycleTime, growthTime);
+}
+
+// What: Function to measure the crowd's animation update
+//       A frame at 144 Hz lasts 6.9 ms; the update should take a small part of it even for a million characters.
+//       The cost per character only levels off from about 100 characters: below that, the call and the scalar tail
+//       after the last full vector dominate.
+// Input: None
+// Output: 0 if fastSine() stays within FAST_SINE_ERROR and every path gives the same channels, 1 otherwise
+// Action: The function measures the largest error of fastSine() over the angles the legs use, compares the channels
+//         of every path, then times updateCrowdAnimation() for 1, 10, ... 1,000,000 characters with the scalar path
+//         and the widest one simdLevel allows and prints, under the name of the path that ran, the nanoseconds per
+//         character and the milliseconds per update.
+// Caller: main()
+int runAnimationBenchmark() {
+    // The path updateCrowdAnimation() takes at a SIMD level: AVX2 also serves AVX-512, and only x86 has SIMD paths
+    auto pathName = [](int level) {
+#ifdef HW05_X86
+        return level >= SIMD_AVX2 ? "AVX2" : level == SIMD_SSE2 ? "SSE2" : "scalar";
+#else
+        (void)level;
+        return "scalar";
+#endif
+    };
+    SimdLevel widest = simdLevel;
+
+    // 1. The error of fastSine() over the leg angles of a whole copter turn
+    double largestError = 0;
+    for (float x = 0; x < LEG_FREQUENCY * 360; x += 1e-3f) {
+        largestError = max(largestError, fabs(fastSine(x) - sin((double)x)));
+    }
+    printf("fastSine: largest error %.2e over [0, %.0f) radians (bound %.0e).\n", largestError, LEG_FREQUENCY * 360, FAST_SINE_ERROR);
+
+    // 2. Every path must give the same bits
+    bool identical = true;
+    buildCrowd(100003);
+    vector<float> reference;
+    for (int level = SIMD_SCALAR; level <= min((int)widest, (int)SIMD_AVX2); level++) {
+        simdLevel = (SimdLevel)level;
+        vector<float> channels;
+        for (double time : { 0.0, 17.25, 129.5, 4321.75, 1e6 + 0.5 }) {
+            updateCrowdAnimation(crowd, time);
+            for (const vector<float>* channel : { &crowd.angle, &crowd.growth, &crowd.scaleRightLeg, &crowd.scaleLeftLeg, &crowd.balloonAngle }) {
+                channels.insert(channels.end(), channel->begin(), channel->end());
+            }
+        }
+        if (level == SIMD_SCALAR) {
+            reference = channels;
+        }
+        else if (memcmp(channels.data(), reference.data(), reference.size() * sizeof(float)) != 0) {
+            printf("The %s path does not match the scalar one.\n", pathName(level));
+            identical = false;
+        }
+    }
+
+    // 3. The cost per character
+    printf("%10s %22s %22s\n", "characters", "scalar ns/char (ms)", (string(pathName(widest)) + " ns/char (ms)").c_str());
+    for (int count = 1; count <= 1000000; count *= 10) {
+        buildCrowd(count);
+        printf("%10d", count);
+        for (SimdLevel level : { SIMD_SCALAR, widest }) {
+            simdLevel = level;
+            int updates = 0;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            double seconds = 0;
+            while (seconds < 0.2) {
+                for (int i = 0; i < 16; i++) {
+                    updateCrowdAnimation(crowd, updates++ * 0.5);
+                }
+                seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            }
+            printf("      %8.3f (%7.3f)", seconds * 1e9 / ((double)updates * count), seconds * 1e3 / updates);
+        }
+        printf("\n");
+    }
+    simdLevel = widest;
+    crowd = CrowdActors();
+    return largestError <= FAST_SINE_ERROR && identical ? 0 : 1;
+}
+
+// What: Function to draw a Bamboo Copter
+//       This function uses various shapes like lines and ellipses to draw a Bamboo Copter.
+//       The surface and the attacher are cached, only the fans are computed from animation.angle every frame.
+// Input: None
+// Output: None
+// Action: The function draws a Bamboo Copter with a surface, an attacher, and three fans.
+// Caller: drawScene()
 void drawBambooCopter() {
-    drawEllipse(0.0, 0.8, 0.1, 0.04, 1.0, 1.0, 0.8); // Draw the surface of the copter
-    drawLine(0.0, 0.7, 0.0, 0.8, 0.0, 0.0, 0.0); // Draw the attacher of the copter
-    drawLine(0.0, 0.8, 0.0 + 0.1 * cos(angle), 0.8 + 0.04 * sin(angle), 0.0, 0.0, 0.0); // Draw the first fan of the copter
-    drawLine(0.0, 0.8, 0.0 + 0.1 * cos(120 + angle), 0.8 + 0.04 * sin(120 + angle), 0.0, 0.0, 0.0); // Draw the second fan of the copter
-    drawLine(0.0, 0.8, 0.0 + 0.1 * cos(240 + angle), 0.8 + 0.04 * sin(240 + angle), 0.0, 0.0, 0.0); // Draw the third fan of the copter
+    PROFILE_SCOPE(ZONE_DRAW_COPTER);
+    drawCachedMesh(copterBaseMesh, [] {
+        drawEllipse(0.0, 0.8, 0.1, 0.04, 1.0, 1.0, 0.8); // Draw the surface of the copter
+        drawLine(0.0, 0.7, 0.0, 0.8, 0.0, 0.0, 0.0); // Draw the attacher of the copter
+    });
+    drawLine(0.0, 0.8, 0.0 + 0.1 * cos(animation.angle), 0.8 + 0.04 * sin(animation.angle), 0.0, 0.0, 0.0); // Draw the first fan of the copter
+    drawLine(0.0, 0.8, 0.0 + 0.1 * cos(120 + animation.angle), 0.8 + 0.04 * sin(120 + animation.angle), 0.0, 0.0, 0.0); // Draw the second fan of the copter
+    drawLine(0.0, 0.8, 0.0 + 0.1 * cos(240 + animation.angle), 0.8 + 0.04 * sin(240 + animation.angle), 0.0, 0.0, 0.0); // Draw the third fan of the copter
+    PROFILE_COUNT(COUNT_TRIG, 6);
 }
 
 // What: Function to draw balloons
 //       This function uses various shapes like lines and ellipses to draw balloons.
+//       The balloons are cached and only rotated every frame. They are filled with balloonFill when submitted,
+//       so changing the color, or giving every balloon of the crowd its own, does not tessellate them again.
 // Input: None
 // Output: None
 // Action: The function draws two balloons with threads and applies rotation to them.
-// Caller: myDisplay()
+// Caller: drawScene()
 void drawBalloons() {
+    PROFILE_SCOPE(ZONE_DRAW_BALLOONS);
     glColor3fv(balloonColor);
+    PROFILE_COUNT(COUNT_GL_CALLS, 1);
     // Draw the thread
-    drawLine(0.35, 0.3, 0.45, 0.63, 0.0, 0.0, 0.0); // Right balloon thread
-    drawLine(-0.35, 0.3, -0.45, 0.63, 0.0, 0.0, 0.0); // Left balloon thread
+    drawCachedMesh(balloonThreadsMesh, [] {
+        drawLine(0.35, 0.3, 0.45, 0.63, 0.0, 0.0, 0.0); // Right balloon thread
+        drawLine(-0.35, 0.3, -0.45, 0.63, 0.0, 0.0, 0.0); // Left balloon thread
+    });
 
     // Draw the balloon with rotation
-    glPushMatrix();
-    glTranslatef(0.45, 0.63, 0.0); // Move to the rotation point of the right balloon
-    glRotatef(balloonAngle, 0.0, 0.0, 1.0); // Rotate the right balloon around the Z-axis
-    glTranslatef(-0.45, -0.63, 0.0); // Move back
-    drawEllipse(0.45, 0.83, 0.1, 0.2, balloonColor[0], balloonColor[1], balloonColor[2]); // Draw the right balloon
-    glPopMatrix();
+    pushTransform();
+    translateTransform(0.45, 0.63); // Move to the rotation point of the right balloon
+    rotateTransform(animation.balloonAngle); // Rotate the right balloon around the Z-axis
+    translateTransform(-0.45, -0.63); // Move back
+    pickPart = PICK_RIGHT_BALLOON;
+    drawCachedMesh(rightBalloonMesh, [] {
+        drawEllipse(0.45, 0.83, 0.1, 0.2, balloonColor[3], balloonColor[4], balloonColor[5]); // Draw the right balloon
+    }, balloonFill + 3);
+    popTransform();
 
-    glPushMatrix();
-    glTranslatef(-0.45, 0.63, 0.0); // Move to the rotation point of the left balloon
-    glRotatef(balloonAngle, 0.0, 0.0, 1.0); // Rotate the left balloon around the Z-axis
-    glTranslatef(0.45, -0.63, 0.0); // Move back
-    drawEllipse(-0.45, 0.83, 0.1, 0.2, balloonColor[0], balloonColor[1], balloonColor[2]); // Draw the left balloon
-    glPopMatrix();
+    pushTransform();
+    translateTransform(-0.45, 0.63); // Move to the rotation point of the left balloon
+    rotateTransform(animation.balloonAngle); // Rotate the left balloon around the Z-axis
+    translateTransform(0.45, -0.63); // Move back
+    pickPart = PICK_LEFT_BALLOON;
+    drawCachedMesh(leftBalloonMesh, [] {
+        drawEllipse(-0.45, 0.83, 0.1, 0.2, balloonColor[0], balloonColor[1], balloonColor[2]); // Draw the left balloon
+    }, balloonFill);
+    popTransform();
+    pickPart = PICK_BODY;
 }
 
 // What: Function to draw a Doraemon character
 //       Doraemon is a popular Japanese manga series character
 //       This function uses various shapes like ellipses, arcs, lines, and rectangles to draw Doraemon.
+//       Everything except the legs is static, so it is tessellated once into doraemonBodyMesh.
 // Input: None
 // Output: None
 // Action: The function draws a Doraemon character by calling other functions to draw its 
 //         face, eyes, nose, mustache, smile, hands, fists, stomach, neck band, bell, and legs.
-// Caller: myDisplay()
+// Caller: drawScene()
 void drawDoraemon() {
-    // Draw the face and its features
-    drawEllipse(0.0, 0.5, 0.25, 0.2, 0.6, 0.8, 1.0); // Face
-    drawEllipse(0.0, 0.44, 0.22, 0.133, 1.0, 1.0, 1.0); // Face patch
-    drawEllipse(-0.04, 0.54, 0.04, 0.065, 1.0, 1.0, 1.0); // Left eye
-    drawEllipse(0.04, 0.54, 0.04, 0.065, 1.0, 1.0, 1.0); // Right eye
-    drawArc(-0.032, 0.51, 0.018, 0.025, 40, 180, 0.0, 0.0, 0.0); // Left pupil
-    drawArc(0.04, 0.51, 0.018, 0.025, 40, 180, 0.0, 0.0, 0.0); // Right pupil
-    drawEllipse(0.0, 0.461, 0.025, 0.025, 1.0, 0.0, 0.0); // Nose
-    drawLine(0.00, 0.436, 0.0, 0.411, 0.0, 0.0, 0.0); // Face-nose line
-
-    // Draw the mustache
-    drawLine(0.12, 0.44, 0.2, 0.47, 0.0, 0.0, 0.0); // Right upper
-    drawLine(0.12, 0.40, 0.2, 0.40, 0.0, 0.0, 0.0); // Right middle
-    drawLine(0.12, 0.36, 0.2, 0.33, 0.0, 0.0, 0.0); // Right lower
-    drawLine(-0.12, 0.44, -0.2, 0.47, 0.0, 0.0, 0.0); // Left upper
-    drawLine(-0.12, 0.40, -0.2, 0.40, 0.0, 0.0, 0.0); // Left middle
-    drawLine(-0.12, 0.36, -0.2, 0.33, 0.0, 0.0, 0.0); // Left lower
-
-    // Draw the smile
-    drawFilledArc(0.0, 0.413, 0.065, 0.065, 0, -180, 0.98, 0.012, 0.337);
-
-    // Draw the hands and fists
-    drawRectangle(-0.35, 0.28, -0.12, 0.21, 0.6, 0.8, 1.0); // Left hand
-    drawRectangle(0.35, 0.28, 0.12, 0.21, 0.6, 0.8, 1.0); // Right hand
-    drawEllipse(-0.35, 0.25, 0.05, 0.05, 1.0, 1.0, 1.0); // Left fist
-    drawEllipse(0.35, 0.25, 0.05, 0.05, 1.0, 1.0, 1.0); // Right fist
-
-    // Draw the stomach and its features
-    drawRectangle(-0.15, 0.28, 0.15, -0.03, 0.6, 0.8, 1.0); // Stomach
-    drawFilledArc(0, 0.275, 0.13, 0.22, 0, -180, 1.0, 1.0, 1.0); // White strip on stomach
-    drawArc(0, 0.16, 0.06, 0.06, 0, -180, 0.0, 0.0, 0.0); // Pocket
-    drawLine(-0.06, 0.16, 0.06, 0.16, 0.0, 0.0, 0.0); // Pocket line
-
-    // Draw the neck band and bell
-    drawRectangle(-0.12, 0.324, 0.12, 0.28, 1.0, 0.0, 0.0); // Neck band
-    drawEllipse(0.0, 0.275, 0.035, 0.035, 1.0, 0.6667, 0.1137); // Bell
+    PROFILE_SCOPE(ZONE_DRAW_DORAEMON);
+    drawCachedMesh(doraemonBodyMesh, [] {
+        // Draw the face and its features
+        drawEllipse(0.0, 0.5, 0.25, 0.2, 0.6, 0.8, 1.0); // Face
+        drawEllipse(0.0, 0.44, 0.22, 0.133, 1.0, 1.0, 1.0); // Face patch
+        drawEllipse(-0.04, 0.54, 0.04, 0.065, 1.0, 1.0, 1.0); // Left eye
+        drawEllipse(0.04, 0.54, 0.04, 0.065, 1.0, 1.0, 1.0); // Right eye
+        drawArc(-0.032, 0.51, 0.018, 0.025, 40, 180, 0.0, 0.0, 0.0); // Left pupil
+        drawArc(0.04, 0.51, 0.018, 0.025, 40, 180, 0.0, 0.0, 0.0); // Right pupil
+        drawEllipse(0.0, 0.461, 0.025, 0.025, 1.0, 0.0, 0.0); // Nose
+        drawLine(0.00, 0.436, 0.0, 0.411, 0.0, 0.0, 0.0); // Face-nose line
+
+        // Draw the mustache
+        drawLine(0.12, 0.44, 0.2, 0.47, 0.0, 0.0, 0.0); // Right upper
+        drawLine(0.12, 0.40, 0.2, 0.40, 0.0, 0.0, 0.0); // Right middle
+        drawLine(0.12, 0.36, 0.2, 0.33, 0.0, 0.0, 0.0); // Right lower
+        drawLine(-0.12, 0.44, -0.2, 0.47, 0.0, 0.0, 0.0); // Left upper
+        drawLine(-0.12, 0.40, -0.2, 0.40, 0.0, 0.0, 0.0); // Left middle
+        drawLine(-0.12, 0.36, -0.2, 0.33, 0.0, 0.0, 0.0); // Left lower
+
+        // Draw the smile
+        drawFilledArc(0.0, 0.413, 0.065, 0.065, 0, -180, 0.98, 0.012, 0.337);
+
+        // Draw the hands and fists
+        drawRectangle(-0.35, 0.28, -0.12, 0.21, 0.6, 0.8, 1.0); // Left hand
+        drawRectangle(0.35, 0.28, 0.12, 0.21, 0.6, 0.8, 1.0); // Right hand
+        drawEllipse(-0.35, 0.25, 0.05, 0.05, 1.0, 1.0, 1.0); // Left fist
+        drawEllipse(0.35, 0.25, 0.05, 0.05, 1.0, 1.0, 1.0); // Right fist
+
+        // Draw the stomach and its features
+        drawRectangle(-0.15, 0.28, 0.15, -0.03, 0.6, 0.8, 1.0); // Stomach
+        drawFilledArc(0, 0.275, 0.13, 0.22, 0, -180, 1.0, 1.0, 1.0); // White strip on stomach
+        drawArc(0, 0.16, 0.06, 0.06, 0, -180, 0.0, 0.0, 0.0); // Pocket
+        drawLine(-0.06, 0.16, 0.06, 0.16, 0.0, 0.0, 0.0); // Pocket line
+
+        // Draw the neck band and bell
+        drawRectangle(-0.12, 0.324, 0.12, 0.28, 1.0, 0.0, 0.0); // Neck band
+        drawEllipse(0.0, 0.275, 0.035, 0.035, 1.0, 0.6667, 0.1137); // Bell
+    });
 
     // Draw the legs
-    glPushMatrix(); // Save the current matrix
-    glScalef(1.0, scaleLeftLeg, 1.0); // Scale the left leg
-    drawEllipse(-0.1, -0.08, 0.09, 0.05, 1.0, 1.0, 1.0); // Draw the left leg
-    glPopMatrix(); // Restore the saved matrix
-
-    glPushMatrix(); // Save the current matrix
-    glScalef(1.0, scaleRightLeg, 1.0); // Scale the right leg
-    drawEllipse(0.1, -0.08, 0.09, 0.05, 1.0, 1.0, 1.0); // Draw the right leg
-    glPopMatrix(); // Restore the saved matrix
-
-    drawLine(0, -0.035, 0, 0.03, 0.0, 0.0, 0.0); // Leg line
-}
\ No newline at end of file
+    pushTransform(); // Save the current transform
+    scaleTransform(1.0, animation.scaleLeftLeg); // Scale the left leg
+    drawCachedMesh(leftLegMesh, [] {
+        drawEllipse(-0.1, -0.08, 0.09, 0.05, 1.0, 1.0, 1.0); // Draw the left leg
+    });
+    popTransform(); // Restore the saved transform
+
+    pushTransform(); // Save the current transform
+    scaleTransform(1.0, animation.scaleRightLeg); // Scale the right leg
+    drawCachedMesh(rightLegMesh, [] {
+        drawEllipse(0.1, -0.08, 0.09, 0.05, 1.0, 1.0, 1.0); // Draw the right leg
+    });
+    popTransform(); // Restore the saved transform
+
+    drawCachedMesh(legLineMesh, [] {
+        drawLine(0, -0.035, 0, 0.03, 0.0, 0.0, 0.0); // Leg line
+    });
+}
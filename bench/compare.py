@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+# Compares results of the benchmark suite (HW05 --bench-suite --bench-json out.json) with a baseline.
+# The baseline and the results are each a result file or a directory of them, one per run of the suite, recorded on
+# the same machine: the "bench-baseline" target records the baseline, the "bench" target the results.
+# Every case is a time. Its value is the median over the runs, and its noise margin the larger of the noise the
+# suite measured within a run and the spread between the runs, on either side. A case regresses when it takes more
+# than the threshold plus its noise margin longer than in the baseline, so a case that is noisy on this machine does
+# not fail a clean tree.
+# A case of the baseline that the results lack fails the comparison too: a case that stopped running cannot be
+# told apart from one that broke.
+# Usage: compare.py baseline results [--threshold 0.10]
+#        compare.py --check-baseline baseline
+# Exits with status 1 if a case regressed or is missing, 2 if there is no baseline or a file cannot be read.
+
+import argparse
+import glob
+import json
+import os
+import statistics
+import sys
+
+
+def load(path):
+    try:
+        with open(path) as file:
+            data = json.load(file)
+    except (OSError, ValueError) as error:
+        print(f"Could not read {path}: {error}", file=sys.stderr)
+        sys.exit(2)
+    return data
+
+
+def files(path):
+    if os.path.isdir(path):
+        return sorted(glob.glob(os.path.join(path, "*.json")))
+    return [path] if os.path.isfile(path) else []
+
+
+def combine(paths):
+    """Returns the first run's header and, per case, its median value, noise margin and unit."""
+    runs = [load(path) for path in paths]
+    values, noises, units = {}, {}, {}
+    for run in runs:
+        for result in run["results"]:
+            values.setdefault(result["name"], []).append(result["value"])
+            noises.setdefault(result["name"], []).append(result.get("noise", 0.0))
+            units[result["name"]] = result["unit"]
+    cases = {}
+    for name, samples in values.items():
+        median = statistics.median(samples)
+        spread = (max(samples) - min(samples)) / median if median > 0 else 0.0
+        cases[name] = (median, max(spread, max(noises[name])), units[name])
+    return runs[0], cases
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Flag benchmark cases slower than a baseline.")
+    parser.add_argument("--check-baseline", action="store_true", help="only check that the baseline exists")
+    parser.add_argument("baseline")
+    parser.add_argument("results", nargs="?")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="largest accepted slowdown beyond the noise margin, 0.10 for 10%% (default)")
+    arguments = parser.parse_args()
+
+    baseline_paths = files(arguments.baseline)
+    if not baseline_paths:
+        print(f"No benchmark baseline in {arguments.baseline}. Record one on this machine first with "
+              f"\"cmake --build <build> --target bench-baseline\"; results from another machine cannot be compared.",
+              file=sys.stderr)
+        return 2
+    if arguments.check_baseline:
+        return 0
+    result_paths = files(arguments.results) if arguments.results else []
+    if not result_paths:
+        print(f"No benchmark results in {arguments.results}.", file=sys.stderr)
+        return 2
+
+    baseline, old = combine(baseline_paths)
+    current, new = combine(result_paths)
+    for key in ("simd", "threads", "renderer"):
+        if baseline.get(key) != current.get(key):
+            print(f"Note: {key} differs, {baseline.get(key)} in the baseline and {current.get(key)} now.")
+
+    regressions = 0
+    print(f"Medians of {len(baseline_paths)} baseline and {len(result_paths)} result run(s).")
+    print(f"{'case':32} {'baseline':>12} {'now':>12} {'change':>8} {'limit':>8}")
+    for name, (after, noise, unit) in new.items():
+        if name not in old:
+            print(f"{name:32} {'':>12} {after:12.3f} {'new':>8} {'':>8}  {unit}")
+            continue
+        before, old_noise, _ = old[name]
+        change = after / before - 1 if before > 0 else 0.0
+        limit = arguments.threshold + max(noise, old_noise)
+        flag = ""
+        if change > limit:
+            flag = "  REGRESSION"
+            regressions += 1
+        print(f"{name:32} {before:12.3f} {after:12.3f} {change:+8.1%} {limit:+8.1%}  {unit}{flag}")
+    missing = 0
+    for name, (before, _, unit) in old.items():
+        if name not in new:
+            print(f"{name:32} {before:12.3f} {'':>12} {'missing':>8} {'':>8}  MISSING")
+            missing += 1
+
+    if missing:
+        print(f"{missing} case(s) of the baseline missing from the results.")
+    if regressions:
+        print(f"{regressions} case(s) slower than the baseline by more than {arguments.threshold:.0%} plus their noise.")
+    if regressions or missing:
+        return 1
+    print(f"No case slower than the baseline by more than {arguments.threshold:.0%} plus its noise.")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())